@@ -1,13 +1,15 @@
 from gevent import monkey
 monkey.patch_all()
 from datetime import datetime, timedelta
-from flask import Flask, render_template
+import json
+from flask import Flask, render_template, jsonify
 from flask_socketio import SocketIO, emit
 import paho.mqtt.client as paho
 import os
 from flask_mqtt import Mqtt
 import pymysql
 import database
+import latency
 pymysql.install_as_MySQLdb()
 from dotenv import load_dotenv
 load_dotenv()
@@ -33,10 +35,11 @@ with app.app_context():
 
 # Konfiguracja MQTT
 app.config['MQTT_BROKER_URL'] = os.getenv('MQTT_BROKER_URL')
-app.config['MQTT_BROKER_PORT'] = 8883
+# Broker lokalny do testów (np. mosquitto bez TLS): MQTT_BROKER_PORT=1883, MQTT_TLS_ENABLED=0
+app.config['MQTT_BROKER_PORT'] = int(os.getenv('MQTT_BROKER_PORT', '8883'))
 app.config['MQTT_USERNAME'] = os.getenv('MQTT_USERNAME')
 app.config['MQTT_PASSWORD'] = os.getenv('MQTT_PASSWORD')
-app.config['MQTT_TLS_ENABLED'] = True
+app.config['MQTT_TLS_ENABLED'] = os.getenv('MQTT_TLS_ENABLED', '1') != '0'
 app.config['MQTT_KEEP_ALIVE'] = 60
 app.config['MQTT_TLS_VERSION'] = paho.ssl.PROTOCOL_TLS  
 
@@ -47,37 +50,120 @@ gr1_temperature_topic = "gr1/temperature"
 gr1_light_topic = "gr1/swiatlo"
 gr1_fan_topic = "gr1/wiatrak"
 gr1_humidity_topic = "gr1/wilgotnosc"
+gr1_trace_topic = "gr1/trace"
+gr1_node_topic = "gr1/node/+"
+gr1_node_prefix = "gr1/node/"
+gr1_stats_topic = "gr1/stats"
 
 gr1_light_topic_ui = "gr1_ui/swiatlo"
 gr1_fan_topic_ui = "gr1_ui/wiatrak"
 
+# Bieżące stany elementów (sensor_id -> 'on'/'off') z tematów stanów. Brama publikuje je
+# z flagą retain, więc broker przysyła je zaraz po subskrypcji, także po restarcie panelu.
+current_states = {}
+
 # Obsługa połączenia MQTT
 @mqtt.on_connect()
 def handle_connect(client, userdata, flags, rc):
     print(f"Connected to MQTT broker with result code {rc}")
     if rc == 0:
         mqtt.subscribe(gr1_temperature_topic)  
-        mqtt.subscribe(gr1_light_topic)  
-        mqtt.subscribe(gr1_fan_topic)  
+        # Stany elementów brama publikuje z QoS 1 - subskrypcja z QoS 0 obniżyłaby dostarczenie
+        mqtt.subscribe(gr1_light_topic, qos=1)
+        mqtt.subscribe(gr1_fan_topic, qos=1)
         mqtt.subscribe(gr1_humidity_topic)  
+        mqtt.subscribe(gr1_trace_topic)
+        mqtt.subscribe(gr1_node_topic)
+        mqtt.subscribe(gr1_stats_topic)
     else:
         print(f"Connection failed with error code {rc}")
 
+# Dane tematu: "<wartość>" albo "<wartość>;ts=<unix ms>" dla ramek odtworzonych
+# z bufora bramy po przerwie w połączeniu z brokerem. Zwraca wartość i czas odczytu.
+def split_payload(payload):
+    value, _, meta = payload.partition(';')
+    if meta.startswith('ts='):
+        try:
+            return value, datetime.fromtimestamp(int(meta[3:]) / 1000)
+        except ValueError:
+            print(f"Niepoprawny czas w wiadomości: {payload}")
+    return value, None
+
+def handle_temperature(temperature, measured_at):
+    measurement_date = (measured_at + timedelta(hours=1, seconds=10)).replace(microsecond=0).isoformat()
+    print(f"Odebrana temperatura to {temperature} i czas {measurement_date}")
+
+    with app.app_context():
+        socketio.emit('gr1_new_temperature_data', {'x': measurement_date.split("T")[1][:5], 'y': temperature})
+        database.add_measurement(3, measurement_date, temperature)
+
+def handle_humidity(humidity, measured_at):
+    measurement_date = (measured_at + timedelta(hours=1)).replace(microsecond=0).isoformat()
+    print(f"Odebrana wilgotnosc to {humidity} i czas {measurement_date}")
+
+    with app.app_context():
+        socketio.emit('gr1_new_humidity_data', {'x': measurement_date, 'y': humidity})
+        database.add_measurement(4, measurement_date, humidity)
+
+# Ostatni numer porcji z tematu urządzenia - luka oznacza utracone porcje
+node_batch_seq = {}
+
+# Zwarta porcja pomiarów urządzenia z bramy C6:
+# {"seq":<n>,"r":[[<unix ms>,<czujnik>,<temperatura>,<wilgotność>],...]}, wartości w setnych częściach.
+# Na wykresy trafia czujnik 0, jak przy tematach pól.
+def handle_node_batch(topic, payload):
+    try:
+        batch = json.loads(payload)
+        seq, readings = batch['seq'], batch['r']
+    except (ValueError, KeyError, TypeError):
+        print(f"Niepoprawna porcja pomiarów: {payload}")
+        return
+    last_seq = node_batch_seq.get(topic)
+    if last_seq is not None and seq != (last_seq + 1) % 65536:
+        print(f"Utracone porcje na temacie {topic}: po {last_seq} przyszła {seq}")
+    node_batch_seq[topic] = seq
+
+    for unix_ms, sensor, temperature, humidity in readings:
+        if sensor != 0:
+            continue
+        measured_at = datetime.fromtimestamp(unix_ms / 1000) if unix_ms else datetime.now()
+        handle_temperature(f"{temperature / 100:.2f}", measured_at)
+        handle_humidity(f"{humidity / 100:.2f}", measured_at)
+
+# Statystyki okna pomiarów czujnika 0 z węzła:
+# {"samples":<n>,"temperature":[<min>,<max>,<średnia>],"humidity":[...]}, wartości w setnych częściach
+def handle_window_stats(payload):
+    try:
+        stats = json.loads(payload)
+        window = {
+            'samples': stats['samples'],
+            'temperature': [value / 100 for value in stats['temperature']],
+            'humidity': [value / 100 for value in stats['humidity']],
+        }
+    except (ValueError, KeyError, TypeError):
+        print(f"Niepoprawne statystyki okna: {payload}")
+        return
+    with app.app_context():
+        socketio.emit('gr1_window_stats', window)
+
 # Obsługa wiadomości MQTT
 @mqtt.on_message()
 def handle_message(client, userdata, message):
     topic = message.topic 
     payload = message.payload.decode()  
     print(f"Odebrano wiadomość na temacie '{topic}': {payload}")
+    if topic.startswith(gr1_node_prefix):
+        handle_node_batch(topic, payload)
+        return
+    if topic == gr1_stats_topic:
+        handle_window_stats(payload)
+        return
+    if topic != gr1_trace_topic:
+        payload, measured_at = split_payload(payload)
+        measured_at = measured_at or datetime.now()
 
     if topic == gr1_temperature_topic:  # Obsługa temperatury
-        measurement_date = (datetime.now() + timedelta(hours=1, seconds=10)).replace(microsecond=0).isoformat()
-        temperature = payload
-        print(f"Odebrana temperatura to {temperature} i czas {measurement_date}")
-
-        with app.app_context():
-            socketio.emit('gr1_new_temperature_data', {'x': measurement_date.split("T")[1][:5], 'y': temperature})
-            database.add_measurement(3, measurement_date, temperature)
+        handle_temperature(payload, measured_at)
 
     elif topic == gr1_light_topic:  
         if payload in ['on', 'off']:
@@ -86,7 +172,9 @@ def handle_message(client, userdata, message):
 
             with app.app_context():
                 socketio.emit('gr1_light_state', {'state': payload})
-                database.update_sensor_state(1, payload) 
+                if current_states.get(1) != payload:
+                    database.update_sensor_state(1, payload)
+                current_states[1] = payload
                 """
                 Brak uniwersalności kodu. 
                 Opieram się na kolejności elementów w bazie zgodnie z: ["Czujnik światła", "Wiatrak", "Czujnik temperatury", "Czujnik wilogtności"]
@@ -101,7 +189,9 @@ def handle_message(client, userdata, message):
 
             with app.app_context():
                 socketio.emit('gr1_fan_state', {'state': payload})
-                database.update_sensor_state(2, payload)
+                if current_states.get(2) != payload:
+                    database.update_sensor_state(2, payload)
+                current_states[2] = payload
                 """
                 Brak uniwersalności kodu. 
                 Opieram się na kolejności elementów w bazie zgodnie z: ["Czujnik światła", "Wiatrak", "Czujnik temperatury", "Czujnik wilogtności"]
@@ -110,13 +200,13 @@ def handle_message(client, userdata, message):
                 """
 
     elif topic == gr1_humidity_topic:  
-        measurement_date = (datetime.now() + timedelta(hours=1)).replace(microsecond=0).isoformat()
-        humidity = payload
-        print(f"Odebrana wilgotnosc to {humidity} i czas {measurement_date}")
+        handle_humidity(payload, measured_at)
 
-        with app.app_context():
-            socketio.emit('gr1_new_humidity_data', {'x': measurement_date, 'y': humidity})
-            database.add_measurement(4, measurement_date, humidity)
+    elif topic == gr1_trace_topic:  # Echo polecenia ze śladem - czasy odcinków
+        sample = latency.collector.finish(payload)
+        if sample:
+            print(f"Ślad {sample['trace']}: {sample['hops']}")
+            socketio.emit('command_latency', sample)
 
 
 # Funkcja do obsługi komendy włącz/wyłącz światło
@@ -124,7 +214,8 @@ def handle_message(client, userdata, message):
 def handle_light_command(data):
     command = data['command']
     if command in ['on', 'off']:
-        mqtt.publish(gr1_light_topic_ui, command)
+        trace_id = latency.collector.start()
+        mqtt.publish(gr1_light_topic_ui, f"{command};trace={trace_id}")
         print(f"Wysłano komendę {command} do tematu {gr1_light_topic}")
 
 # Funkcja do obsługi komendy włącz/wyłącz wiatraka
@@ -132,17 +223,24 @@ def handle_light_command(data):
 def handle_fan_command(data):
     command = data['command']
     if command in ['on', 'off']:
-        mqtt.publish(gr1_fan_topic_ui, command)
+        trace_id = latency.collector.start()
+        mqtt.publish(gr1_fan_topic_ui, f"{command};trace={trace_id}")
         print(f"Wysłano komendę {command} do tematu {gr1_fan_topic}")
 
 # Inicjalne wysyłanie stanów sensorów do klienta
 @socketio.on('get_states')
 def send_states():
     try:
-        states = database.SensorsStates.query.all()
+        # Stany z bazy, nadpisane stanami znanymi już z brokera - sensor, którego stan
+        # jeszcze nie przyszedł, zostaje ze stanem z bazy
+        states = {
+            state.sensor_id: state.state
+            for state in database.SensorsStates.query.order_by(database.SensorsStates.id).all()
+        }
+        states.update(current_states)
         states_list = [
-            {'sensor_id': state.sensor_id, 'state': state.state}
-            for state in states
+            {'sensor_id': sensor_id, 'state': state}
+            for sensor_id, state in states.items()
         ]
         # Emitowanie do klienta
         print("Stany po odświeżeniu:", states_list)
@@ -170,3 +268,13 @@ def send_initial_chart_data():
 @app.route('/')
 def menu():
     return render_template('menu.html')
+
+# Podgląd opóźnień poleceń - percentyle odcinków i ostatnie ślady
+@app.route('/debug/latency')
+def debug_latency():
+    return render_template('latency.html', summary=latency.collector.summary(),
+                           percentiles=latency.PERCENTILES, hops=latency.HOPS)
+
+@app.route('/debug/latency.json')
+def debug_latency_json():
+    return jsonify(latency.collector.summary())
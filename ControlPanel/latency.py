@@ -0,0 +1,118 @@
+import json
+import threading
+import time
+from collections import deque
+
+# Zbieranie czasów poleceń ze śladem. Panel nadaje poleceniu identyfikator i zapamiętuje
+# chwilę wysłania, a brama C6 publikuje echo z czasami odcinków zmierzonymi w urządzeniach.
+# Zegary urządzeń nie są zsynchronizowane, więc odcinki łączy (MQTT, UART, Thread) to różnica
+# czasu w obie strony i czasów spędzonych w urządzeniach po obu stronach łącza.
+
+# Odcinki w kolejności drogi polecenia. Łącza liczone są w obie strony.
+HOPS = ['mqtt', 'c6', 'uart', 'h2', 'thread', 'node', 'total']
+HOP_NAMES = {
+    'mqtt': 'Panel <-> HiveMQ <-> C6',
+    'c6': 'Brama C6',
+    'uart': 'Łącze UART',
+    'h2': 'Brama H2',
+    'thread': 'Sieć Thread',
+    'node': 'Węzeł (polecenie -> GPIO)',
+    'total': 'Razem',
+}
+PERCENTILES = [50, 90, 99]
+
+history_size = 200        # liczba ostatnich śladów brana do percentyli
+pending_timeout_s = 30    # ślad bez echa po tym czasie uznawany jest za utracony
+
+
+def percentile(sorted_values, p):
+    """Percentyl metodą najbliższej pozycji z posortowanej listy."""
+    if not sorted_values:
+        return None
+    rank = max(1, -(-p * len(sorted_values) // 100))
+    return sorted_values[rank - 1]
+
+
+class LatencyCollector:
+    def __init__(self):
+        self._lock = threading.Lock()
+        self._next_id = 1
+        self._pending = {}  # identyfikator śladu -> chwila wysłania (time.monotonic)
+        self._history = deque(maxlen=history_size)
+        self.lost = 0
+
+    def start(self):
+        """Zwraca identyfikator śladu dla nowego polecenia (1..65535)."""
+        with self._lock:
+            now = time.monotonic()
+            for trace_id, sent in list(self._pending.items()):
+                if now - sent > pending_timeout_s:
+                    del self._pending[trace_id]
+                    self.lost += 1
+            trace_id = self._next_id
+            self._next_id = self._next_id % 65535 + 1
+            self._pending[trace_id] = now
+            return trace_id
+
+    def finish(self, payload):
+        """Przetwarza echo z tematu gr<N>/trace. Zwraca czasy odcinków w ms lub None."""
+        received = time.monotonic()
+        try:
+            echo = json.loads(payload)
+            trace_id = int(echo['trace'])
+        except (ValueError, KeyError, TypeError):
+            print(f"Niepoprawne echo śladu: {payload}")
+            return None
+
+        with self._lock:
+            sent = self._pending.pop(trace_id, None)
+            if sent is None:
+                return None  # ślad z innego panelu lub po upływie czasu
+            total_us = (received - sent) * 1e6
+            c6_us = echo['c6_down_us'] + echo['c6_up_us']
+            h2_us = echo['h2_down_us'] + echo['h2_up_us']
+            hops_us = {
+                'mqtt': total_us - c6_us - echo['uart_rtt_us'],
+                'c6': c6_us,
+                'uart': echo['uart_rtt_us'] - h2_us - echo['thread_rtt_us'],
+                'h2': h2_us,
+                'thread': echo['thread_rtt_us'] - echo['node_us'],
+                'node': echo['node_us'],
+                'total': total_us,
+            }
+            sample = {
+                'trace': trace_id,
+                'actuator': echo.get('actuator'),
+                'value': echo.get('value'),
+                'time': time.strftime('%H:%M:%S'),
+                # Zaokrąglenia czasów mogą dać niewielką wartość ujemną
+                'hops': {hop: max(0.0, us) / 1000 for hop, us in hops_us.items()},
+            }
+            self._history.append(sample)
+            return sample
+
+    def summary(self):
+        """Percentyle każdego odcinka (ms) z ostatnich śladów."""
+        with self._lock:
+            samples = list(self._history)
+            pending = len(self._pending)
+            lost = self.lost
+        hops = []
+        for hop in HOPS:
+            values = sorted(sample['hops'][hop] for sample in samples)
+            hops.append({
+                'hop': hop,
+                'name': HOP_NAMES[hop],
+                'percentiles': {p: percentile(values, p) for p in PERCENTILES},
+                'max': values[-1] if values else None,
+            })
+        return {
+            'count': len(samples),
+            'pending': pending,
+            'lost': lost,
+            'hops': hops,
+            'recent': samples[-20:][::-1],
+        }
+
+
+collector = LatencyCollector()
@@ -38,6 +38,12 @@ function updateHumidityDisplay(value) {
     $('#gr1_humidityDisplay').text(value);
 }
 
+// Statystyki okna pomiarów z węzła: [min, max, średnia]
+function updateWindowStats(element, samples, stats, unit) {
+    $(element).text('Okno ' + samples + ' próbek: min ' + stats[0].toFixed(2) + unit +
+                    ', max ' + stats[1].toFixed(2) + unit + ', średnia ' + stats[2].toFixed(2) + unit);
+}
+
 
 /*
 Brak uniwersalności kodu. 
@@ -45,6 +45,12 @@ socket.on('gr1_new_humidity_data', function(data) {
     }
 });
 
+// Statystyki okna pomiarów - pod wykresami
+socket.on('gr1_window_stats', function(data) {
+    updateWindowStats('#gr1_temperatureStats', data.samples, data.temperature, '°C');
+    updateWindowStats('#gr1_humidityStats', data.samples, data.humidity, '%');
+});
+
 // Obsługa pobierania stanów z serwera po załadowaniu strony.
 $(document).ready(function () {
     // Po nawiązaniu połączenia WebSocket
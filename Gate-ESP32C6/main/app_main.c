@@ -14,6 +14,7 @@
 #include "esp_system.h"
 #include "esp_partition.h"
 #include "nvs_flash.h"
+#include "nvs.h"
 #include "esp_event.h"
 #include "esp_netif.h"
 #include "protocol_examples_common.h"
@@ -22,30 +23,70 @@
 #include "mqtt_client.h"
 #include "esp_tls.h"
 #include "esp_ota_ops.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_netif_sntp.h"
 #include <sys/param.h>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/timers.h"
+#include "freertos/semphr.h"
 #include "driver/uart.h"
 
 #include "config.h"
+#include "sh_proto.h"
+#include "sh_link.h"
+#include "sh_latency.h"
+#include "sh_pool.h"
+#include "flash_ring.h"
+#include "compact_batch.h"
+#include "mqtt_outbox.h"
+#include "broker_transport.h"
+#include "ui_route.h"
 static const char *TAG = "ESP32-C6-GATE";
 
 #define UART_QUEUE_SIZE 20
+// Każdy kierunek może zapełnić swoją kolejkę i trzymać jeden blok w obróbce
+#define MSG_POOL_SIZE (2 * (UART_QUEUE_SIZE + 1))
 #define UART_BUFFER_SIZE 512
 
 #define TX_PIN 10           // Pin TX
 #define RX_PIN 11           // Pin RX
 #define QUEUE_SIZE 20       // Rozmiar kolejki zdarzeń
+#define UART_RX_TIMEOUT_SYMBOLS 3 // Cisza na linii (w czasach znaku), po której sterownik zgłasza odebrane dane
 
-typedef struct {
-    char topic[UART_BUFFER_SIZE];
-    char data[UART_BUFFER_SIZE];
-} mqtt_data_t;
+#define GROUP_ID 1          // Grupa panelu subskrybowana od startu, kolejne dochodzą z ramek węzłów
 
 // Kolejki
 QueueHandle_t uart_to_mqtt_queue;
 QueueHandle_t mqtt_to_uart_queue;
+static QueueHandle_t uart_event_queue;
+
+// Blok puli wiadomości - ramka z chwilą jej odebrania. Kolejki przekazywania
+// przenoszą wskaźniki do bloków, blok zwalnia zadanie, które wysłało ramkę dalej.
+typedef struct {
+    int64_t received_us;
+    uint8_t frame[SH_FRAME_MAX_LEN];
+} gate_msg_t;
+
+static gate_msg_t msg_blocks[MSG_POOL_SIZE];
+static sh_pool_t msg_pool;
+
+// Opóźnienia w bramie: MQTT -> UART i UART -> MQTT
+static sh_latency_t downlink_latency;
+static sh_latency_t uplink_latency;
+
+// Polecenia panelu ze śladem wysłane do bramy H2, czekające na echo SH_MSG_TRACE
+static sh_trace_table_t command_traces;
+
+// Broker w chmurze (HiveMQ, TLS) albo w sieci lokalnej do testów (np. mosquitto)
+#if CONFIG_GATE_BROKER_LAN
+#define BROKER_URI CONFIG_GATE_LAN_BROKER_URI
+#else
+#define BROKER_URI "mqtts://1855d1e75c264a00b0fdffc55e0ec025.s1.eu.hivemq.cloud:8883"
+#endif
+#define BROKER_URI_MAX_LEN 128
 
 #if CONFIG_BROKER_CERTIFICATE_OVERRIDDEN == 1
 static const uint8_t mqtt_eclipseprojects_io_pem_start[]  = "-----BEGIN CERTIFICATE-----\n" CONFIG_BROKER_CERTIFICATE_OVERRIDE "\n-----END CERTIFICATE-----";
@@ -54,31 +95,273 @@ extern const uint8_t mqtt_eclipseprojects_io_pem_start[]   asm("_binary_mqtt_ecl
 #endif
 extern const uint8_t mqtt_eclipseprojects_io_pem_end[]   asm("_binary_mqtt_eclipseprojects_io_pem_end");
 
+static uint16_t command_seq = 0;
+
+// Stan połączenia z brokerem - bez połączenia ramki trafiają do bufora we flash
+static bool mqtt_connected;
+
+// Grupy, dla których subskrybowane są polecenia panelu (bit na grupę)
+static uint32_t known_groups[(SH_GROUP_ALL + 1) / 32];
+
+// Łącze UART z bramą H2 (ramki SLIP z CRC)
+static sh_link_encoder_t uart_link_tx;
+static sh_link_decoder_t uart_link_rx;
+#if CONFIG_GATE_UART_ACK
+// Polecenia czekające na ACK bramy H2. Wysyła je i powtarza mqtt_to_uart_task, ACK przychodzą w uart_to_mqtt_task.
+static sh_link_arq_t uart_link_window;
+static SemaphoreHandle_t uart_link_lock;
+static TaskHandle_t mqtt_to_uart_handle;
+#endif
+
+// Przekazuje kopię wiadomości do kolejki w bloku z puli
+static void queue_msg(QueueHandle_t queue, const gate_msg_t *msg, TickType_t wait)
+{
+    gate_msg_t *block = sh_pool_alloc(&msg_pool, wait);
+    if (block == NULL) {
+        ESP_LOGW("Queue", "Message pool empty, message dropped");
+        return;
+    }
+    *block = *msg;
+    if (xQueueSend(queue, &block, wait) != pdPASS) {
+        ESP_LOGW("Queue", "Failed to queue message");
+        sh_pool_free(&msg_pool, block);
+    }
+}
+
+// Sprawdza, czy temat lub dane (bez zakończenia '\0') jest równy podanemu napisowi
+static bool field_equals(const char *field, int field_len, const char *expected)
+{
+    return field_len == (int)strlen(expected) && strncmp(field, expected, field_len) == 0;
+}
+
+// Nazwa elementu wykonawczego w tematach "gr<N>/<nazwa>" i "gr<N>_ui/<nazwa>"
+static const char *const actuator_topics[SH_ACT_COUNT] = {
+    [SH_ACT_LIGHT] = "swiatlo",
+    [SH_ACT_FAN]   = "wiatrak",
+};
+
+// Zamienia wiadomość z panelu na ramkę polecenia. Zwraca długość ramki lub kod błędu.
+static int build_command_frame(esp_mqtt_event_handle_t event, uint8_t *buf, size_t buf_len)
+{
+    sh_frame_t frame = {
+        .type = SH_MSG_COMMAND,
+        .seq = command_seq++,
+    };
+    const char *name;
+    int name_len;
+
+    if (!ui_route_parse_topic(event->topic, event->topic_len, &frame.group, &name, &name_len)) {
+        return SH_ERR_TYPE;
+    }
+    const ui_route_t *route = ui_route_find(name, name_len);
+    if (route == NULL) {
+        return SH_ERR_TYPE;
+    }
+    frame.state.actuator = route->actuator;
+
+    // Dane "on" lub "off", opcjonalnie z identyfikatorem śladu panelu: "on;trace=<n>"
+    const char *trace = memchr(event->data, ';', event->data_len);
+    int value_len = trace != NULL ? trace - event->data : event->data_len;
+    if (field_equals(event->data, value_len, "on")) {
+        frame.state.value = 1;
+    } else if (field_equals(event->data, value_len, "off")) {
+        frame.state.value = 0;
+    } else {
+        return SH_ERR_RANGE;
+    }
+    if (trace != NULL) {
+        const char *end = event->data + event->data_len;
+        unsigned id = 0;
+        trace++;
+        if (end - trace <= 6 || strncmp(trace, "trace=", 6) != 0) {
+            return SH_ERR_RANGE;
+        }
+        for (trace += 6; trace < end && *trace >= '0' && *trace <= '9' && id <= UINT16_MAX; trace++) {
+            id = id * 10 + (*trace - '0');
+        }
+        if (trace != end || id == 0 || id > UINT16_MAX) {
+            return SH_ERR_RANGE;
+        }
+        frame.state.trace = (uint16_t)id;
+    }
+    return sh_frame_encode(&frame, buf, buf_len);
+}
+
+// Subskrybuje polecenia panelu dla jednej grupy
+static void subscribe_group(esp_mqtt_client_handle_t client, uint8_t group)
+{
+    char topic[24];
+    for (size_t i = 0; i < ui_route_count; i++) {
+        snprintf(topic, sizeof(topic), "gr%u_ui/%s", group, ui_routes[i].name);
+        esp_mqtt_client_subscribe(client, topic, 0);
+    }
+}
+
+// Dodaje grupę przy pierwszej ramce od jej węzłów. Po ponownym połączeniu
+// subskrypcje wszystkich znanych grup odnawia obsługa MQTT_EVENT_CONNECTED.
+static void add_known_group(esp_mqtt_client_handle_t client, uint8_t group)
+{
+    uint32_t bit = 1UL << (group % 32);
+    if (group == SH_GROUP_ALL || (known_groups[group / 32] & bit)) {
+        return;
+    }
+    known_groups[group / 32] |= bit;
+    if (client != NULL) {
+        ESP_LOGI(TAG, "New group %d, subscribing to its panel topics", group);
+        subscribe_group(client, group);
+    }
+}
+
+// Liczniki publikacji z ostatniej minuty. Przy QoS 0 każda publikacja wychodzi osobnym
+// zapisem do gniazda - przez TLS w osobnym rekordzie, więc do pakietu MQTT doliczany
+// jest narzut rekordu. Bajty to wartość szacunkowa, do porównania trybów publikacji.
+#define TLS_RECORD_OVERHEAD 29 // nagłówek 5 B, jawna część nonce 8 B i znacznik 16 B (AES-GCM)
+#define PUBLISH_COUNTERS_PERIOD_MS 60000
+static uint32_t publish_packets;
+static uint32_t publish_bytes;
+static bool publish_tls; // połączenie z brokerem przez TLS (mqtts://), ustawiane przed startem klienta
+
+static void count_publish(const char *topic, int len, int qos)
+{
+    // Bajt typu, długość reszty (1-3 bajty), temat z długością, identyfikator przy QoS > 0
+    size_t remaining = 2 + strlen(topic) + len + (qos > 0 ? 2 : 0);
+    size_t packet = 1 + (remaining < 128 ? 1 : remaining < 16384 ? 2 : 3) + remaining;
+    if (publish_tls) {
+        packet += TLS_RECORD_OVERHEAD;
+    }
+    __atomic_add_fetch(&publish_packets, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&publish_bytes, (uint32_t)packet, __ATOMIC_RELAXED);
+}
+
+// esp_mqtt_client_publish() z doliczeniem wysłanej wiadomości do liczników
+static int mqtt_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos, int retain)
+{
+    if (len == 0) {
+        len = strlen(data);
+    }
+    int msg_id = esp_mqtt_client_publish(client, topic, data, len, qos, retain);
+    if (msg_id >= 0) {
+        count_publish(topic, len, qos);
+    }
+    return msg_id;
+}
+
+static void publish_counters_timer_cb(TimerHandle_t timer)
+{
+    uint32_t packets = __atomic_exchange_n(&publish_packets, 0, __ATOMIC_RELAXED);
+    uint32_t bytes = __atomic_exchange_n(&publish_bytes, 0, __ATOMIC_RELAXED);
+    ESP_LOGI(TAG, "MQTT in the last minute: %lu %s, ~%lu bytes", (unsigned long)packets,
+             publish_tls ? "TLS records" : "TCP publish packets", (unsigned long)bytes);
+
+    mqtt_outbox_stats_t outbox;
+    mqtt_outbox_stats(&outbox);
+    ESP_LOGI(TAG, "State outbox: %lu queued, %lu delivered (mean %lu us, max %lu us), %lu superseded, %lu dropped, %lu expired",
+             (unsigned long)outbox.queued, (unsigned long)outbox.delivered,
+             (unsigned long)sh_latency_mean_us(&outbox.delivery), (unsigned long)outbox.delivery.max_us,
+             (unsigned long)outbox.superseded, (unsigned long)outbox.dropped, (unsigned long)outbox.expired);
+}
+
+// Przekazuje klientowi MQTT czekające stany, na ile pozwala okno wiadomości w drodze.
+// Stany są zachowywane przez broker (retain), nowy subskrybent dostaje je od razu.
+// esp_mqtt_client_enqueue() tylko dopisuje wiadomość do kolejki klienta, więc można ją
+// wywołać także z obsługi zdarzeń.
+static void pump_outbox(esp_mqtt_client_handle_t client)
+{
+    if (!__atomic_load_n(&mqtt_connected, __ATOMIC_RELAXED)) {
+        return;
+    }
+    mqtt_outbox_entry_t *entry;
+    while ((entry = mqtt_outbox_next()) != NULL) {
+        int len = strlen(entry->payload);
+        int msg_id = esp_mqtt_client_enqueue(client, entry->topic, entry->payload, len, 1, 1, true);
+        if (msg_id >= 0) {
+            count_publish(entry->topic, len, 1);
+            ESP_LOGI(TAG, "Published %s: %s   with msg_id=%d", entry->topic, entry->payload, msg_id);
+        }
+        mqtt_outbox_sent(entry, msg_id);
+        if (msg_id < 0) {
+            ESP_LOGW(TAG, "MQTT client outbox full, state publish deferred");
+            break;
+        }
+    }
+}
+
+// Początek ostatniej próby połączenia (MQTT_EVENT_BEFORE_CONNECT)
+static int64_t connect_started_us;
+
+// Czasy etapów łączenia z brokerem: DNS, TCP i TLS z transportu, CONNACK od końca
+// łączenia transportu do MQTT_EVENT_CONNECTED
+static void log_connect_timing(void)
+{
+    int64_t now = esp_timer_get_time();
+    const broker_transport_timing_t *timing = broker_transport_timing();
+    if (timing->connected_us < connect_started_us) {
+        // Domyślny transport klienta - znany tylko czas całości
+        ESP_LOGI(TAG, "Broker connected in %lu us", (unsigned long)sh_elapsed_us(connect_started_us, now));
+        return;
+    }
+    ESP_LOGI(TAG, "Broker connected in %lu us: DNS %lu us, TCP %lu us, TLS %lu us (%s), CONNACK %lu us",
+             (unsigned long)sh_elapsed_us(connect_started_us, now), (unsigned long)timing->dns_us,
+             (unsigned long)timing->tcp_us, (unsigned long)timing->tls_us,
+             timing->tls_us == 0 ? "plain TCP" :
+             timing->session_resumed ? "session resumed" :
+             timing->session_offered ? "session rejected, full handshake" : "full handshake",
+             (unsigned long)sh_elapsed_us(timing->connected_us, now));
+}
+
 static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data)
 {
     esp_mqtt_event_handle_t event = event_data;
     esp_mqtt_client_handle_t client = event->client;
 
     switch ((esp_mqtt_event_id_t)event_id) {
+    case MQTT_EVENT_BEFORE_CONNECT:
+        connect_started_us = esp_timer_get_time();
+        break;
+
     case MQTT_EVENT_CONNECTED:
         ESP_LOGI("MQTT", "MQTT_EVENT_CONNECTED");
-        
-        esp_mqtt_client_subscribe(client, "gr1_ui/swiatlo", 0);   
-        esp_mqtt_client_subscribe(client, "gr1_ui/wiatrak", 0);
+        log_connect_timing();
+        __atomic_store_n(&mqtt_connected, true, __ATOMIC_RELAXED);
+
+        for (int group = 0; group < SH_GROUP_ALL; group++) {
+            if (known_groups[group / 32] & (1UL << (group % 32))) {
+                subscribe_group(client, group);
+            }
+        }
+        pump_outbox(client);
+        break;
+
+    case MQTT_EVENT_DISCONNECTED:
+        ESP_LOGW("MQTT", "MQTT_EVENT_DISCONNECTED, buffering frames in flash");
+        __atomic_store_n(&mqtt_connected, false, __ATOMIC_RELAXED);
+        break;
+
+    // Potwierdzenie lub porzucenie stanu z QoS 1 zwalnia miejsce w oknie wiadomości w drodze
+    case MQTT_EVENT_PUBLISHED:
+        mqtt_outbox_published(event->msg_id);
+        pump_outbox(client);
+        break;
+
+    case MQTT_EVENT_DELETED:
+        mqtt_outbox_deleted(event->msg_id);
+        pump_outbox(client);
         break;
 
     case MQTT_EVENT_DATA:
         ESP_LOGI("MQTT", "Received topic: %.*s", event->topic_len, event->topic);
         ESP_LOGI("MQTT", "Received data: %.*s", event->data_len, event->data);
 
-        // Tworzenie obiektu do wysłania do kolejki
-        char formatted_message[UART_BUFFER_SIZE]; 
-        int len = snprintf(formatted_message, sizeof(formatted_message), "%.*s: %.*s", 
-                    event->topic_len, event->topic, event->data_len, event->data);
-        // Wysyłamy dane i temat do kolejki
-        if (xQueueSend(mqtt_to_uart_queue, formatted_message, portMAX_DELAY) != pdPASS) {
-            ESP_LOGW("Queue", "Failed to send data to mqtt_to_uart_queue");
+        // Tworzenie ramki polecenia do wysłania do kolejki
+        gate_msg_t command = { .received_us = esp_timer_get_time() };
+        int len = build_command_frame(event, command.frame, sizeof(command.frame));
+        if (len < 0) {
+            ESP_LOGW("MQTT", "Unsupported command, error: %d", len);
+            break;
         }
+        // Wysyłamy ramkę do kolejki. Zadanie klienta MQTT nie może czekać na wolne miejsce,
+        // przy pełnej kolejce polecenie przepada.
+        queue_msg(mqtt_to_uart_queue, &command, 0);
         break;
 
     default:
@@ -87,105 +370,648 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
 }
 
 
+#if CONFIG_GATE_UART_ACK
+static void uart_write_frame(const uint8_t *data, size_t len, void *ctx)
+{
+    uart_write_bytes(UART_NUM_1, data, len);
+}
+#endif
+
 static void mqtt_to_uart_task(void *param)
 {
-    esp_mqtt_client_handle_t client = (esp_mqtt_client_handle_t)param;
-    char formatted_message[UART_BUFFER_SIZE]; // Bufor na sformatowaną wiadomość
+    gate_msg_t *command; // Zakodowana ramka polecenia
+    uint8_t encoded[SH_LINK_MAX_ENCODED];
+#if CONFIG_GATE_UART_ACK
+    uint32_t reported_expired = 0;
+#endif
 
     while (1) {
+        TickType_t wait = portMAX_DELAY;
+#if CONFIG_GATE_UART_ACK
+        // Powtórzenia niepotwierdzonych poleceń. Przy pełnym oknie nowe polecenia czekają w kolejce.
+        xSemaphoreTake(uart_link_lock, portMAX_DELAY);
+        uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+        sh_link_arq_poll(&uart_link_window, now_ms, uart_write_frame, NULL);
+        bool window_full = sh_link_arq_full(&uart_link_window);
+        uint32_t wait_ms = sh_link_arq_wait_ms(&uart_link_window, now_ms);
+        uint32_t retransmits = uart_link_window.retransmits;
+        uint32_t expired = uart_link_window.expired;
+        xSemaphoreGive(uart_link_lock);
+        if (expired != reported_expired) {
+            reported_expired = expired;
+            ESP_LOGW(TAG, "UART link: %lu commands not acknowledged by H2, %lu retransmits",
+                     (unsigned long)expired, (unsigned long)retransmits);
+        }
+        if (wait_ms != UINT32_MAX) {
+            wait = pdMS_TO_TICKS(wait_ms) + 1;
+        }
+        if (window_full) {
+            ulTaskNotifyTake(pdTRUE, wait); // budzi ACK
+            continue;
+        }
+#endif
         // Czekamy na dane z MQTT (np. z funkcji store_mqtt_data)
-        if (xQueueReceive(mqtt_to_uart_queue, formatted_message, portMAX_DELAY) == pdPASS) {
+        if (xQueueReceive(mqtt_to_uart_queue, &command, wait) == pdPASS) {
             // Przesyłamy dane przez UART
-            uart_write_bytes(UART_NUM_1, formatted_message, strlen(formatted_message));
-            ESP_LOGI(TAG, "Message sent via UART: %s", formatted_message);
+            uint8_t link_seq = uart_link_tx.seq;
+            size_t len = sh_link_encode(&uart_link_tx, command->frame, sh_frame_len(command->frame[1]), encoded, sizeof(encoded));
+            int64_t received_us = command->received_us;
+            sh_frame_t frame;
+            if (sh_frame_decode(command->frame, sizeof(command->frame), &frame) >= 0 &&
+                frame.type == SH_MSG_COMMAND && frame.state.trace != 0) {
+                // Ślad zapisywany przed wysłaniem, aby echo nie wyprzedziło wpisu
+                sh_trace_begin(&command_traces, frame.state.trace, received_us, esp_timer_get_time());
+            }
+            sh_pool_free(&msg_pool, command);
+#if CONFIG_GATE_UART_ACK
+            xSemaphoreTake(uart_link_lock, portMAX_DELAY);
+            sh_link_arq_push(&uart_link_window, link_seq, encoded, len, (uint32_t)(esp_timer_get_time() / 1000));
+            xSemaphoreGive(uart_link_lock);
+#else
+            (void)link_seq;
+#endif
+            uart_write_bytes(UART_NUM_1, encoded, len);
+            sh_latency_record(&downlink_latency, received_us, esp_timer_get_time());
+            ESP_LOGI(TAG, "Command sent via UART: %d bytes, %lu us in gate (mean %lu us, max %lu us)", (int)len,
+                     (unsigned long)downlink_latency.last_us, (unsigned long)sh_latency_mean_us(&downlink_latency),
+                     (unsigned long)downlink_latency.max_us);
         }
+    }
+}
+
 
-        vTaskDelay(pdMS_TO_TICKS(100)); // Czekamy chwilę przed kolejną iteracją
+// Ramka łącza z poprawnym CRC - trafia do kolejki publikacji
+static void on_uart_frame(const uint8_t *payload, size_t len, void *ctx)
+{
+    const int64_t *received_us = ctx; // Chwila odebrania danych
+    sh_frame_t frame;
+    int frame_len = sh_frame_decode(payload, len, &frame);
+    if (frame_len < 0) {
+        ESP_LOGW(TAG, "Failed to decode UART frame, error: %d", frame_len);
+        return;
     }
+    ESP_LOGI(TAG, "Frame read via UART: type %d, seq %d", frame.type, frame.seq);
+    // Wysyłamy ramkę do kolejki
+    gate_msg_t msg = { .received_us = *received_us };
+    memcpy(msg.frame, payload, frame_len);
+    queue_msg(uart_to_mqtt_queue, &msg, portMAX_DELAY);
 }
 
+#if CONFIG_GATE_UART_ACK
+// Potwierdzenie ramki od H2. uart_write_bytes() zapisuje całą ramkę pod blokadą sterownika,
+// więc ACK nie rozdziela polecenia wysyłanego przez mqtt_to_uart_task.
+static void uart_send_ack(uint8_t seq, void *ctx)
+{
+    uint8_t encoded[8];
+    size_t len = sh_link_encode_ack(seq, encoded, sizeof(encoded));
+    uart_write_bytes(UART_NUM_1, encoded, len);
+}
 
-static void uart_to_mqtt_task(void *param)
+static void uart_peer_ack(uint8_t seq, void *ctx)
 {
-    esp_mqtt_client_handle_t client = (esp_mqtt_client_handle_t)param;
+    xSemaphoreTake(uart_link_lock, portMAX_DELAY);
+    sh_link_arq_ack(&uart_link_window, seq);
+    xSemaphoreGive(uart_link_lock);
+    xTaskNotifyGive(mqtt_to_uart_handle);
+}
+#endif
 
+// Zadanie budzone przez zdarzenia sterownika UART. Zdarzenie UART_DATA przychodzi
+// po przerwaniu RX timeout, czyli zaraz po końcu ramki, albo po zapełnieniu FIFO.
+static void uart_to_mqtt_task(void *param)
+{
     uint8_t data[UART_BUFFER_SIZE];
+    uart_event_t event;
+    int64_t received_us;
+    uint32_t reported_errors = 0;
+    sh_link_decoder_init(&uart_link_rx);
+#if CONFIG_GATE_UART_ACK
+    sh_link_decoder_set_ack(&uart_link_rx, uart_send_ack, uart_peer_ack, NULL);
+#endif
     while (1) {
-        int len = uart_read_bytes(UART_NUM_1, data, UART_BUFFER_SIZE, pdMS_TO_TICKS(100)); // Czekamy na dane przez 100ms
-        if (len > 0) {
-            data[len] = '\0'; // Zakończymy łańcuch znaków
-
-            ESP_LOGI(TAG, "Message read via UART: %s", data);
-            // Wysyłamy dane do kolejki
-            if (xQueueSend(uart_to_mqtt_queue, data, portMAX_DELAY) != pdPASS) {
-                ESP_LOGW("Queue", "Failed to send data to uart_to_mqtt_queue");
+        if (xQueueReceive(uart_event_queue, &event, portMAX_DELAY) != pdPASS) {
+            continue;
+        }
+        if (event.type == UART_FIFO_OVF || event.type == UART_BUFFER_FULL) {
+            // Dane zostały utracone - dekoder odrzuci niepełną ramkę przy następnym znaczniku END
+            ESP_LOGW(TAG, "UART RX overflow, flushing input");
+            uart_flush_input(UART_NUM_1);
+            xQueueReset(uart_event_queue);
+            continue;
+        }
+        if (event.type != UART_DATA) {
+            continue;
+        }
+
+        received_us = esp_timer_get_time();
+        size_t pending = event.size;
+        while (pending > 0) {
+            int len = uart_read_bytes(UART_NUM_1, data, MIN(pending, sizeof(data)), 0);
+            if (len <= 0) {
+                break;
             }
+            // Ramki mogą być podzielone między zdarzenia - dekoder składa je ze strumienia
+            sh_link_feed(&uart_link_rx, data, len, on_uart_frame, &received_us);
+            pending -= len;
         }
 
+        const sh_link_stats_t *link = &uart_link_rx.stats;
+        uint32_t errors = link->crc_errors + link->lost + link->overflows + link->duplicates;
+        if (errors != reported_errors) {
+            reported_errors = errors;
+            ESP_LOGW(TAG, "UART link: %lu frames, %lu CRC errors, %lu lost, %lu overflows, %lu duplicates",
+                     (unsigned long)link->frames, (unsigned long)link->crc_errors,
+                     (unsigned long)link->lost, (unsigned long)link->overflows,
+                     (unsigned long)link->duplicates);
+        }
     }
 }
 
+// Dane tematu. Ramki odtwarzane z bufora niosą czas odebrania: "<wartość>;ts=<unix ms>".
+static void format_payload(char *buf, size_t buf_len, const char *value, int64_t unix_ms)
+{
+    if (unix_ms != 0) {
+        snprintf(buf, buf_len, "%s;ts=%lld", value, (long long)unix_ms);
+    } else {
+        snprintf(buf, buf_len, "%s", value);
+    }
+}
+
+// Ostatnie opublikowane stany, bit (grupa * SH_ACT_COUNT + element). Tematy stanów są
+// zachowywane przez broker, więc ten sam stan nie jest publikowany ponownie - poza
+// odświeżeniem wszystkich stanów co GATE_STATE_REFRESH_S. Używa ich tylko zadanie publikacji.
+#define STATE_KEYS ((SH_GROUP_ALL + 1) * SH_ACT_COUNT)
+#define STATE_REFRESH_RETRY_MS 100 // ponowna próba, gdy kolejka stanów nie ma wolnych miejsc
+static uint32_t published_states[(STATE_KEYS + 31) / 32];
+static uint32_t published_values[(STATE_KEYS + 31) / 32];
+static TickType_t states_refreshed;
+static uint16_t refresh_key = STATE_KEYS; // następny stan do odświeżenia, STATE_KEYS - brak odświeżania
+
+// Dodaje stan do kolejki stanów i zapamiętuje go jako opublikowany
+static bool queue_state(uint16_t key, bool on, int64_t unix_ms)
+{
+    char topic[MQTT_OUTBOX_TOPIC_LEN];
+    char payload[MQTT_OUTBOX_PAYLOAD_LEN];
+    snprintf(topic, sizeof(topic), "gr%u/%s", key / SH_ACT_COUNT, actuator_topics[key % SH_ACT_COUNT]);
+    format_payload(payload, sizeof(payload), on ? "on" : "off", unix_ms);
+    if (!mqtt_outbox_push(key, topic, payload)) {
+        return false;
+    }
+    uint32_t bit = 1UL << (key % 32);
+    published_states[key / 32] |= bit;
+    if (on) {
+        published_values[key / 32] |= bit;
+    } else {
+        published_values[key / 32] &= ~bit;
+    }
+    return true;
+}
+
+// Publikuje zmianę stanu elementu wykonawczego na temacie jego grupy z QoS 1 i flagą
+// retain, przez kolejkę stanów
+static bool publish_state(esp_mqtt_client_handle_t client, uint8_t group, uint8_t actuator, bool on, int64_t unix_ms)
+{
+    uint16_t key = group * SH_ACT_COUNT + actuator;
+    uint32_t bit = 1UL << (key % 32);
+    bool published_on = (published_values[key / 32] & bit) != 0;
+    if ((published_states[key / 32] & bit) && published_on == on) {
+        return true;
+    }
+    bool queued = queue_state(key, on, unix_ms);
+    pump_outbox(client);
+    return queued;
+}
+
+// Odświeżanie zachowanych stanów, wywoływane w każdym obiegu zadania publikacji. Co
+// GATE_STATE_REFRESH_S publikuje ponownie każdy znany stan, co naprawia wartość utraconą
+// przez broker. Stany trafiają do kolejki tylko na wolne miejsca, więc odświeżanie nie
+// wypiera zmian czekających na wysłanie - przy pełnej kolejce kończy się w kolejnych
+// obiegach. Zwraca czas do następnego wywołania.
+static TickType_t refresh_states(esp_mqtt_client_handle_t client)
+{
+    const TickType_t period = pdMS_TO_TICKS(CONFIG_GATE_STATE_REFRESH_S * 1000);
+    TickType_t elapsed = xTaskGetTickCount() - states_refreshed;
+    if (refresh_key == STATE_KEYS) {
+        if (elapsed < period) {
+            return period - elapsed;
+        }
+        states_refreshed = xTaskGetTickCount();
+        refresh_key = 0;
+    }
+    if (!__atomic_load_n(&mqtt_connected, __ATOMIC_RELAXED)) {
+        return pdMS_TO_TICKS(STATE_REFRESH_RETRY_MS);
+    }
+
+    // Jedno wolne miejsce zostaje dla zmiany stanu, która nadejdzie w tym czasie
+    for (; refresh_key < STATE_KEYS && mqtt_outbox_free() > 1; refresh_key++) {
+        uint32_t bit = 1UL << (refresh_key % 32);
+        if (published_states[refresh_key / 32] & bit) {
+            queue_state(refresh_key, (published_values[refresh_key / 32] & bit) != 0, 0);
+        }
+    }
+    pump_outbox(client);
+    if (refresh_key < STATE_KEYS) {
+        return pdMS_TO_TICKS(STATE_REFRESH_RETRY_MS);
+    }
+    ESP_LOGI(TAG, "Actuator states refreshed");
+    return period;
+}
+
+// Publikuje pomiar temperatury i wilgotności (w setnych częściach) na tematach
+// grupy. Czujnik 0 używa tematów bez indeksu, kolejne dostają indeks na końcu tematu.
+static bool publish_telemetry(esp_mqtt_client_handle_t client, uint8_t group, uint8_t sensor,
+                              int16_t temperature, int16_t humidity, int64_t unix_ms)
+{
+    char value[10];
+    char temp_msg[32], humidity_msg[32];
+    char temp_topic[28], humidity_topic[28];
+    sh_format_centi(temperature, value, sizeof(value));
+    format_payload(temp_msg, sizeof(temp_msg), value, unix_ms);
+    sh_format_centi(humidity, value, sizeof(value));
+    format_payload(humidity_msg, sizeof(humidity_msg), value, unix_ms);
+    if (sensor > 0) {
+        snprintf(temp_topic, sizeof(temp_topic), "gr%u/temperature/%u", group, sensor);
+        snprintf(humidity_topic, sizeof(humidity_topic), "gr%u/wilgotnosc/%u", group, sensor);
+    } else {
+        snprintf(temp_topic, sizeof(temp_topic), "gr%u/temperature", group);
+        snprintf(humidity_topic, sizeof(humidity_topic), "gr%u/wilgotnosc", group);
+    }
+
+    bool sent = mqtt_publish(client, temp_topic, temp_msg, 0, 0, 0) >= 0;
+    sent = mqtt_publish(client, humidity_topic, humidity_msg, 0, 0, 0) >= 0 && sent;
+
+    ESP_LOGI(TAG, "Published %s: %s", temp_topic, temp_msg);
+    ESP_LOGI(TAG, "Published %s: %s", humidity_topic, humidity_msg);
+    return sent;
+}
+
+#if CONFIG_GATE_PUBLISH_COMPACT
+// Wysyła porcję urządzenia. Porcja zostaje, gdy publikacja się nie powiodła.
+static bool flush_batch(esp_mqtt_client_handle_t client, compact_batch_t *batch)
+{
+    char topic[24];
+    static char payload[COMPACT_PAYLOAD_MAX];
+    int len = compact_batch_encode(batch, topic, sizeof(topic), payload, sizeof(payload));
+    if (len < 0 || mqtt_publish(client, topic, payload, len, 0, 0) < 0) {
+        return false;
+    }
+    ESP_LOGI(TAG, "Published %s: %u readings, seq %u", topic, (unsigned)batch->count, batch->seq);
+    batch->seq++;
+    batch->count = 0;
+    return true;
+}
+
+// Odczyty porcji wracają do bufora flash jako ramki pomiarów. Dostają czas zapisu,
+// więc ich czas przesuwa się najwyżej o wiek porcji.
+static void requeue_batch(compact_batch_t *batch)
+{
+    for (size_t i = 0; i < batch->count; i++) {
+        const compact_reading_t *reading = &batch->readings[i];
+        const sh_frame_t frame = {
+            .type = SH_MSG_TELEMETRY,
+            .group = batch->group,
+            .device = batch->device,
+            .telemetry = {
+                .sensor = reading->sensor,
+                .temperature = reading->temperature,
+                .humidity = reading->humidity,
+            },
+        };
+        uint8_t raw[SH_FRAME_MAX_LEN];
+        int len = sh_frame_encode(&frame, raw, sizeof(raw));
+        if (len < 0 || flash_ring_push(raw, len) != ESP_OK) {
+            ESP_LOGW(TAG, "Reading lost, flash buffer unavailable");
+        }
+    }
+    batch->count = 0;
+}
+
+// Wysyła porcje gotowe do wysłania, a przy all - wszystkie niepuste. Porcja, której nie
+// udało się wysłać, wraca do bufora flash przy requeue, inaczej zostaje.
+// Zwraca false, gdy któraś porcja została.
+static bool flush_batches(esp_mqtt_client_handle_t client, bool all, bool requeue)
+{
+    const TickType_t flush_ticks = pdMS_TO_TICKS(CONFIG_GATE_BATCH_FLUSH_MS);
+    bool connected = __atomic_load_n(&mqtt_connected, __ATOMIC_RELAXED);
+    bool flushed = true;
+    for (size_t i = 0; i < COMPACT_MAX_DEVICES; i++) {
+        compact_batch_t *batch = compact_batch_at(i);
+        if (batch == NULL || batch->count == 0 || (!all && !compact_batch_due(batch, flush_ticks))) {
+            continue;
+        }
+        if (connected && flush_batch(client, batch)) {
+            continue;
+        }
+        if (requeue) {
+            requeue_batch(batch);
+        } else {
+            flushed = false;
+        }
+    }
+    return flushed;
+}
+#endif
+
+// Publikuje pomiar czujnika. W trybie zwartym pomiar trafia do porcji urządzenia,
+// a pełna porcja jest najpierw wysyłana.
+static bool publish_reading(esp_mqtt_client_handle_t client, uint8_t group, uint8_t device, uint8_t sensor,
+                            int16_t temperature, int16_t humidity, int64_t unix_ms)
+{
+#if CONFIG_GATE_PUBLISH_COMPACT
+    compact_batch_t *batch = compact_batch_get(group, device);
+    if (batch != NULL) {
+        const compact_reading_t reading = {
+            .unix_ms = unix_ms != 0 ? unix_ms : flash_ring_unix_ms(),
+            .sensor = sensor,
+            .temperature = temperature,
+            .humidity = humidity,
+        };
+        if (!compact_batch_add(batch, &reading)) {
+            if (!flush_batch(client, batch)) {
+                return false;
+            }
+            compact_batch_add(batch, &reading);
+        }
+        return true;
+    }
+    // Brak miejsca na porcję - urządzenie publikuje na tematach pól
+#endif
+    return publish_telemetry(client, group, sensor, temperature, humidity, unix_ms);
+}
+
+// Na wykresy trafia ostatnia próbka, a statystyki okna na temat "gr<N>/stats" (czujnik 0)
+// lub "gr<N>/stats/<czujnik>": {"samples":<n>,"temperature":[<min>,<max>,<średnia>],
+// "humidity":[...]} w setnych częściach, z polem "ts" dla ramek z bufora
+static bool publish_stats(esp_mqtt_client_handle_t client, uint8_t group, uint8_t device, uint8_t sensor, uint8_t samples,
+                          const sh_stats_t *temperature, const sh_stats_t *humidity, int64_t unix_ms)
+{
+    char topic[24];
+    char payload[112];
+    if (sensor > 0) {
+        snprintf(topic, sizeof(topic), "gr%u/stats/%u", group, sensor);
+    } else {
+        snprintf(topic, sizeof(topic), "gr%u/stats", group);
+    }
+    int len = snprintf(payload, sizeof(payload), "{\"samples\":%u,\"temperature\":[%d,%d,%d],\"humidity\":[%d,%d,%d]",
+                       samples, temperature->min, temperature->max, temperature->mean,
+                       humidity->min, humidity->max, humidity->mean);
+    if (unix_ms != 0) {
+        len += snprintf(&payload[len], sizeof(payload) - len, ",\"ts\":%lld", (long long)unix_ms);
+    }
+    len += snprintf(&payload[len], sizeof(payload) - len, "}");
+    bool sent = mqtt_publish(client, topic, payload, len, 0, 0) >= 0;
+    ESP_LOGI(TAG, "Published %s: %s", topic, payload);
+    return publish_reading(client, group, device, sensor, temperature->last, humidity->last, unix_ms) && sent;
+}
+
+static bool publish_telemetry_frame(esp_mqtt_client_handle_t client, const sh_frame_t *frame, int64_t unix_ms)
+{
+    return publish_reading(client, frame->group, frame->device, frame->telemetry.sensor,
+                           frame->telemetry.temperature, frame->telemetry.humidity, unix_ms);
+}
+
+static bool publish_stats_frame(esp_mqtt_client_handle_t client, const sh_frame_t *frame, int64_t unix_ms)
+{
+    return publish_stats(client, frame->group, frame->device, frame->stats.sensor, frame->stats.samples,
+                         &frame->stats.temperature, &frame->stats.humidity, unix_ms);
+}
+
+static bool publish_state_frame(esp_mqtt_client_handle_t client, const sh_frame_t *frame, int64_t unix_ms)
+{
+    return publish_state(client, frame->group, frame->state.actuator, frame->state.value, unix_ms);
+}
+
+// Ramka zbiorcza - publikujemy każde obecne w niej pole
+static bool publish_report_frame(esp_mqtt_client_handle_t client, const sh_frame_t *frame, int64_t unix_ms)
+{
+    bool sent = true;
+    if (frame->report.fields & SH_REPORT_STATS) {
+        sent = publish_stats(client, frame->group, frame->device, frame->report.sensor, frame->report.samples,
+                             &frame->report.temperature, &frame->report.humidity, unix_ms);
+    }
+    for (uint8_t actuator = 0; actuator < SH_ACT_COUNT; actuator++) {
+        if (frame->report.actuators & (1 << actuator)) {
+            sent = publish_state(client, frame->group, actuator, frame->report.values & (1 << actuator), unix_ms) && sent;
+        }
+    }
+    return sent;
+}
+
+typedef bool (*frame_publisher_t)(esp_mqtt_client_handle_t client, const sh_frame_t *frame, int64_t unix_ms);
+
+// Publikacja według typu ramki. Typy bez wpisu nie trafiają do brokera.
+static const frame_publisher_t frame_publishers[] = {
+    [SH_MSG_TELEMETRY]       = publish_telemetry_frame,
+    [SH_MSG_STATE]           = publish_state_frame,
+    [SH_MSG_TELEMETRY_STATS] = publish_stats_frame,
+    [SH_MSG_REPORT]          = publish_report_frame,
+};
+
+// Publikuje pola ramki od węzła. unix_ms różny od 0 oznacza ramkę z bufora.
+// Zwraca false, gdy któraś publikacja się nie powiodła.
+static bool publish_frame(esp_mqtt_client_handle_t client, const sh_frame_t *frame, int64_t unix_ms)
+{
+    if (frame->type >= sizeof(frame_publishers) / sizeof(frame_publishers[0]) || frame_publishers[frame->type] == NULL) {
+        return true;
+    }
+    return frame_publishers[frame->type](client, frame, unix_ms);
+}
+
+// Publikuje stany elementów wykonawczych z ramki od razu przez kolejkę stanów, która
+// zastępuje starsze stany tego samego elementu i wysyła je po ponownym połączeniu. Zmiana
+// stanu nie czeka więc za odtwarzaniem bufora flash, do którego trafiają tylko pomiary.
+// Ramka zbiorcza zostaje bez stanów i jest kodowana ponownie do raw.
+// Zwraca false, gdy w ramce nie zostało nic do publikacji.
+static bool publish_frame_states(esp_mqtt_client_handle_t client, sh_frame_t *frame, uint8_t *raw, int *frame_len)
+{
+    if (frame->type == SH_MSG_STATE) {
+        if (!publish_state_frame(client, frame, 0)) {
+            ESP_LOGW(TAG, "State lost, state queue full");
+        }
+        return false;
+    }
+    if (frame->type != SH_MSG_REPORT || !(frame->report.fields & SH_REPORT_ACTUATORS)) {
+        return true;
+    }
+    for (uint8_t actuator = 0; actuator < SH_ACT_COUNT; actuator++) {
+        if ((frame->report.actuators & (1 << actuator)) &&
+            !publish_state(client, frame->group, actuator, frame->report.values & (1 << actuator), 0)) {
+            ESP_LOGW(TAG, "State lost, state queue full");
+        }
+    }
+    frame->report.fields &= ~SH_REPORT_ACTUATORS;
+    frame->report.actuators = 0;
+    frame->report.values = 0;
+    if (frame->report.fields == 0) {
+        return false;
+    }
+    *frame_len = sh_frame_encode(frame, raw, SH_FRAME_MAX_LEN);
+    return *frame_len > 0;
+}
+
+// Publikuje jedną porcję ramek z bufora, w kolejności ich odebrania. Porcja jest
+// zdejmowana z bufora dopiero po udanej publikacji całości, więc po zerwaniu
+// połączenia w trakcie część ramek może zostać opublikowana ponownie.
+static void replay_batch(esp_mqtt_client_handle_t client)
+{
+    static flash_ring_record_t records[CONFIG_GATE_REPLAY_BATCH];
+    size_t count = flash_ring_read(records, CONFIG_GATE_REPLAY_BATCH);
+    bool sent = true;
+    for (size_t i = 0; i < count && sent; i++) {
+        sh_frame_t frame;
+        if (sh_frame_decode(records[i].frame, records[i].len, &frame) < 0) {
+            continue;
+        }
+        sent = publish_frame(client, &frame, records[i].unix_ms);
+    }
+#if CONFIG_GATE_PUBLISH_COMPACT
+    // Przy niepustym buforze w porcjach są tylko odczyty z odtwarzanych ramek
+    sent = sent && flush_batches(client, true, false);
+    if (!sent) {
+        compact_batch_drop_all();
+    }
+#endif
+    if (!sent) {
+        ESP_LOGW(TAG, "Replay interrupted, %u frames still buffered", (unsigned)flash_ring_count());
+        return;
+    }
+    flash_ring_consume();
+    if (flash_ring_count() == 0) {
+        const flash_ring_stats_t *stats = flash_ring_stats();
+        ESP_LOGI(TAG, "Replay finished: %lu frames buffered, %lu replayed, %lu dropped",
+                 (unsigned long)stats->stored, (unsigned long)stats->replayed, (unsigned long)stats->dropped);
+    }
+}
+
+// Publikuje czasy odcinków polecenia ze śladem na temacie "gr<N>/trace". Czasy bramy C6
+// mierzone są tutaj, pozostałe przyszły w echu. Panel dolicza czas w obie strony przez MQTT.
+static void publish_trace(esp_mqtt_client_handle_t client, const sh_frame_t *frame, int64_t received_us)
+{
+    sh_trace_t trace;
+    if (!sh_trace_end(&command_traces, frame->trace.trace, &trace)) {
+        ESP_LOGW(TAG, "Echo of unknown trace %u", frame->trace.trace);
+        return;
+    }
+    char topic[24];
+    char payload[256];
+    snprintf(topic, sizeof(topic), "gr%u/trace", frame->group);
+    int len = snprintf(payload, sizeof(payload),
+                       "{\"trace\":%u,\"actuator\":\"%s\",\"value\":\"%s\",\"c6_down_us\":%lu,"
+                       "\"uart_rtt_us\":%lu,\"h2_down_us\":%lu,\"thread_rtt_us\":%lu,\"node_us\":%lu,"
+                       "\"h2_up_us\":%lu,\"c6_up_us\":%lu}",
+                       frame->trace.trace, actuator_topics[frame->trace.actuator],
+                       frame->trace.value ? "on" : "off",
+                       (unsigned long)sh_elapsed_us(trace.received_us, trace.sent_us),
+                       (unsigned long)sh_elapsed_us(trace.sent_us, received_us),
+                       (unsigned long)frame->trace.h2_down_us, (unsigned long)frame->trace.thread_rtt_us,
+                       (unsigned long)frame->trace.node_us, (unsigned long)frame->trace.h2_up_us,
+                       (unsigned long)sh_elapsed_us(received_us, esp_timer_get_time()));
+    mqtt_publish(client, topic, payload, len, 0, 0);
+    ESP_LOGI(TAG, "Published %s: %s", topic, payload);
+}
+
 static void mqtt_publish_task(void *param)
 {
     esp_mqtt_client_handle_t client = (esp_mqtt_client_handle_t)param;
+    const TickType_t replay_interval = pdMS_TO_TICKS(CONFIG_GATE_REPLAY_INTERVAL_MS);
+    TickType_t last_replay = xTaskGetTickCount();
+    TickType_t refresh_wait = 0;
+    states_refreshed = xTaskGetTickCount();
 
-    char data[UART_BUFFER_SIZE];
+    gate_msg_t *msg;
     while (1) {
+        // Z ramkami w buforze zadanie budzi się co najmniej raz na okres odtwarzania
+        TickType_t wait = portMAX_DELAY;
+        if (flash_ring_count() > 0) {
+            TickType_t elapsed = xTaskGetTickCount() - last_replay;
+            wait = elapsed < replay_interval ? replay_interval - elapsed : 0;
+        }
+#if CONFIG_GATE_PUBLISH_COMPACT
+        TickType_t batch_wait = compact_batch_wait(pdMS_TO_TICKS(CONFIG_GATE_BATCH_FLUSH_MS));
+        wait = batch_wait < wait ? batch_wait : wait;
+#endif
+        wait = refresh_wait < wait ? refresh_wait : wait;
         // Czekamy na dane w kolejce
-        if (xQueueReceive(uart_to_mqtt_queue, data, portMAX_DELAY) == pdPASS) {
-            // Publikujemy dane na brokerze MQTT
-            float temperature = 0.0f, humidity = 0.0f;
-            if (sscanf(data, "{temperature: %f, humidity: %f}", &temperature, &humidity) == 2) {
-                // Publikujemy dane temperatury i wilgotności na odpowiednich tematach
-                char temp_msg[10], humidity_msg[10];
-                snprintf(temp_msg, sizeof(temp_msg), "%.2f", temperature);
-                snprintf(humidity_msg, sizeof(humidity_msg), "%.2f", humidity);
-
-                int temp_msg_id = esp_mqtt_client_publish(client, "gr1/temperature", temp_msg, 0, 0, 0);
-                int humidity_msg_id = esp_mqtt_client_publish(client, "gr1/wilgotnosc", humidity_msg, 0, 0, 0);
-
-                ESP_LOGI(TAG, "Published gr1/temperature: %.2f", temperature);
-                ESP_LOGI(TAG, "Published gr1/wilgotnosc: %.2f", humidity);
-                if (strstr(data, "fan_state: 1")) {
-                    // Publikujemy wiadomość o stanie światła włączonym
-                    int msg_id = esp_mqtt_client_publish(client, "gr1/wiatrak", "on", 0, 0, 0);
-                    ESP_LOGI(TAG, "Published gr1/wiatrak: on   with msg_id=%d", msg_id);
-                } else if (strstr(data, "fan_state: 0")) {
-                    // Publikujemy wiadomość o stanie światła wyłączonym
-                    int msg_id = esp_mqtt_client_publish(client, "gr1/wiatrak", "off", 0, 0, 0);
-                    ESP_LOGI(TAG, "Published gr1/wiatrak: off   with msg_id=%d", msg_id);
+        if (xQueueReceive(uart_to_mqtt_queue, &msg, wait) == pdPASS) {
+            sh_frame_t frame;
+            uint8_t raw[SH_FRAME_MAX_LEN];
+            int frame_len = sh_frame_decode(msg->frame, sizeof(msg->frame), &frame);
+            int64_t received_us = msg->received_us;
+            memcpy(raw, msg->frame, sizeof(raw));
+            sh_pool_free(&msg_pool, msg);
+            if (frame_len < 0) {
+                continue;
+            }
+            // Grupę w ramce podaje węzeł, brama H2 przekazuje ją bez zmian
+            add_known_group(client, frame.group);
+
+            if (frame.type == SH_MSG_TRACE) {
+                publish_trace(client, &frame, received_us); // pomiar opóźnień nie ma sensu po czasie
+            } else if (publish_frame_states(client, &frame, raw, &frame_len) &&
+                       (!__atomic_load_n(&mqtt_connected, __ATOMIC_RELAXED) || flash_ring_count() > 0 ||
+                        !publish_frame(client, &frame, 0))) {
+                // Przy niepustym buforze nowe pomiary czekają za starszymi, aby zachować kolejność
+#if CONFIG_GATE_PUBLISH_COMPACT
+                flush_batches(client, true, true); // odczyty z porcji są starsze od ramki
+#endif
+                if (flash_ring_push(raw, frame_len) != ESP_OK) {
+                    ESP_LOGW(TAG, "Frame lost, flash buffer unavailable");
                 }
-                } 
-
-            else if (strstr(data, "light_state: 1")) {
-                // Publikujemy wiadomość o stanie światła włączonym
-                int msg_id = esp_mqtt_client_publish(client, "gr1/swiatlo", "on", 0, 0, 0);
-                ESP_LOGI(TAG, "Published gr1/swiatlo: on   with msg_id=%d", msg_id);
-            } else if (strstr(data, "light_state: 0")) {
-                // Publikujemy wiadomość o stanie światła wyłączonym
-                int msg_id = esp_mqtt_client_publish(client, "gr1/swiatlo", "off", 0, 0, 0);
-                ESP_LOGI(TAG, "Published gr1/swiatlo: off   with msg_id=%d", msg_id);
-            } else if (strstr(data, "fan_state: 1")) {
-                // Publikujemy wiadomość o stanie wentylatora włączonym
-                int msg_id = esp_mqtt_client_publish(client, "gr1/wiatrak", "on", 0, 0, 0);
-                ESP_LOGI(TAG, "Published gr1/wiatrak: on   with msg_id=%d", msg_id);
-            } else if (strstr(data, "fan_state: 0")) {
-                // Publikujemy wiadomość o stanie wentylatora wyłączonym
-                int msg_id = esp_mqtt_client_publish(client, "gr1/wiatrak", "off", 0, 0, 0);
-                ESP_LOGI(TAG, "Published gr1/wiatrak: off   with msg_id=%d", msg_id);
-            } 
-    
             }
+            sh_latency_record(&uplink_latency, received_us, esp_timer_get_time());
+            ESP_LOGI(TAG, "Frame handled, %lu us in gate (mean %lu us, max %lu us)",
+                     (unsigned long)uplink_latency.last_us, (unsigned long)sh_latency_mean_us(&uplink_latency),
+                     (unsigned long)uplink_latency.max_us);
+        }
+
+#if CONFIG_GATE_PUBLISH_COMPACT
+        flush_batches(client, false, true);
+#endif
+        if (flash_ring_count() > 0 && __atomic_load_n(&mqtt_connected, __ATOMIC_RELAXED) &&
+            xTaskGetTickCount() - last_replay >= replay_interval) {
+            last_replay = xTaskGetTickCount();
+            replay_batch(client);
         }
-        vTaskDelay(pdMS_TO_TICKS(100)); // Czekamy chwilę przed kolejną iteracją
+        refresh_wait = refresh_states(client);
+    }
 }
 
 
+// Adres brokera z NVS (przestrzeń "gate", klucz "broker_uri"), jeśli jest zapisany,
+// inaczej z konfiguracji projektu
+static void load_broker_uri(char *uri, size_t uri_len)
+{
+    snprintf(uri, uri_len, "%s", BROKER_URI);
+    nvs_handle_t nvs;
+    if (nvs_open("gate", NVS_READONLY, &nvs) != ESP_OK) {
+        return;
+    }
+    char stored[BROKER_URI_MAX_LEN];
+    size_t len = sizeof(stored);
+    if (nvs_get_str(nvs, "broker_uri", stored, &len) == ESP_OK) {
+        snprintf(uri, uri_len, "%s", stored);
+        ESP_LOGI(TAG, "Broker URI from NVS: %s", uri);
+    }
+    nvs_close(nvs);
+}
+
 static void mqtt_app_start(void)
 {
+    static char broker_uri[BROKER_URI_MAX_LEN];
+    load_broker_uri(broker_uri, sizeof(broker_uri));
+    bool tls = strncmp(broker_uri, "mqtts://", 8) == 0;
+    publish_tls = tls;
+
+    // Własny transport zachowuje sesję TLS między połączeniami i mierzy czasy łączenia.
+    // Klient MQTT zwalnia go razem z sobą.
+    esp_transport_handle_t transport = broker_transport_init(tls ? (const char *)mqtt_eclipseprojects_io_pem_start : NULL);
+    if (transport == NULL) {
+        ESP_LOGW(TAG, "Broker transport unavailable, using the default MQTT transport");
+    }
+
     const esp_mqtt_client_config_t mqtt_cfg = {
         .broker = {
-            .address.uri = "mqtts://1855d1e75c264a00b0fdffc55e0ec025.s1.eu.hivemq.cloud:8883",
+            .address.uri = broker_uri,
             .verification.certificate = (const char *)mqtt_eclipseprojects_io_pem_start
         },
         .credentials = {
@@ -194,24 +1020,55 @@ static void mqtt_app_start(void)
                 .password = PASSWORD
             }
         },
+        .network = {
+            .reconnect_timeout_ms = CONFIG_GATE_RECONNECT_MS,
+            .transport = transport,
+        },
     };
 
     ESP_LOGI(TAG, "[APP] Free memory: %" PRIu32 " bytes", esp_get_free_heap_size());
+    ESP_LOGI(TAG, "Connecting to %s over %s", broker_uri, tls ? "TLS" : "plain TCP");
     esp_mqtt_client_handle_t client = esp_mqtt_client_init(&mqtt_cfg);
     if (client == NULL) {
         ESP_LOGE(TAG, "Failed to initialize MQTT client");
         return;
     }
 
+    add_known_group(NULL, GROUP_ID);
     esp_mqtt_client_register_event(client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
     esp_mqtt_client_start(client);
 
+    TimerHandle_t counters_timer = xTimerCreate("publish_counters", pdMS_TO_TICKS(PUBLISH_COUNTERS_PERIOD_MS),
+                                                pdTRUE, NULL, publish_counters_timer_cb);
+    if (counters_timer == NULL || xTimerStart(counters_timer, 0) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start publish counters timer");
+    }
+
     // Tworzymy zadania z przekazaniem wskaźnika na klienta
+#if CONFIG_GATE_UART_ACK
+    sh_link_arq_init(&uart_link_window, CONFIG_GATE_UART_ACK_TIMEOUT_MS, CONFIG_GATE_UART_ACK_RETRIES);
+    uart_link_lock = xSemaphoreCreateMutex();
+    if (uart_link_lock == NULL) {
+        ESP_LOGE(TAG, "Failed to create UART link lock");
+    }
+    // Zadanie zapisu musi istnieć, zanim ACK zaczną je budzić
+    xTaskCreate(mqtt_to_uart_task, "mqtt_to_uart", 4096, client, 5, &mqtt_to_uart_handle);
+#else
     xTaskCreate(mqtt_to_uart_task, "mqtt_to_uart", 4096, client, 5, NULL);
+#endif
     xTaskCreate(uart_to_mqtt_task, "uart_to_mqtt", 4096, client, 5, NULL);
     xTaskCreate(mqtt_publish_task, "mqtt_publish_task", 4096, client, 5, NULL);
 }
 
+// Raport zajętości sterty przy starcie - pokazuje, ile pamięci zostaje dla MQTT i TLS
+static void report_heap(const char *stage)
+{
+    ESP_LOGI(TAG, "Heap %s: %lu bytes free, largest block %lu, minimum %lu", stage,
+             (unsigned long)esp_get_free_heap_size(),
+             (unsigned long)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT),
+             (unsigned long)esp_get_minimum_free_heap_size());
+}
+
 void app_main(void)
 {
     ESP_ERROR_CHECK(nvs_flash_init());
@@ -220,6 +1077,13 @@ void app_main(void)
 
     ESP_ERROR_CHECK(example_connect());
 
+    // Czas z SNTP oznacza ramki zapisywane w buforze podczas braku połączenia z brokerem
+    esp_sntp_config_t sntp_config = ESP_NETIF_SNTP_DEFAULT_CONFIG(CONFIG_GATE_SNTP_SERVER);
+    esp_netif_sntp_init(&sntp_config);
+    if (flash_ring_init() != ESP_OK) {
+        ESP_LOGW(TAG, "Flash buffer unavailable, frames will be lost while the broker is unreachable");
+    }
+
     // Konfiguracja UART
     const uart_config_t uart_config = {
         .baud_rate = 115200,
@@ -229,19 +1093,30 @@ void app_main(void)
         .flow_ctrl = UART_HW_FLOWCTRL_DISABLE
     };
 
+    uint32_t heap_before = esp_get_free_heap_size();
+    report_heap("before gate buffers");
+
     uart_param_config(UART_NUM_1, &uart_config);
-    uart_driver_install(UART_NUM_1, UART_BUFFER_SIZE, UART_BUFFER_SIZE, QUEUE_SIZE, NULL, 0);
+    uart_driver_install(UART_NUM_1, UART_BUFFER_SIZE, UART_BUFFER_SIZE, QUEUE_SIZE, &uart_event_queue, 0);
     uart_set_pin(UART_NUM_1, TX_PIN, RX_PIN, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
+    uart_set_rx_timeout(UART_NUM_1, UART_RX_TIMEOUT_SYMBOLS);
 
     // Tworzenie kolejki UART
-    uart_to_mqtt_queue = xQueueCreate(UART_QUEUE_SIZE, UART_BUFFER_SIZE);
+    uart_to_mqtt_queue = xQueueCreate(UART_QUEUE_SIZE, sizeof(gate_msg_t *));
     if (uart_to_mqtt_queue == NULL) {
         ESP_LOGE(TAG, "Failed to create UART queue");
     }
-    mqtt_to_uart_queue = xQueueCreate(UART_QUEUE_SIZE, UART_BUFFER_SIZE);
+    mqtt_to_uart_queue = xQueueCreate(UART_QUEUE_SIZE, sizeof(gate_msg_t *));
     if (mqtt_to_uart_queue == NULL) {
         ESP_LOGE(TAG, "Failed to create UART queue");
     }
+    ESP_ERROR_CHECK(sh_pool_init(&msg_pool, msg_blocks, sizeof(gate_msg_t), MSG_POOL_SIZE));
+    sh_trace_table_init(&command_traces);
+    mqtt_outbox_init();
+
+    report_heap("after gate buffers");
+    ESP_LOGI(TAG, "Gate buffers: %lu bytes of heap, %u bytes in static message pool",
+             (unsigned long)(heap_before - esp_get_free_heap_size()), (unsigned)sizeof(msg_blocks));
 
     mqtt_app_start();
 }
@@ -0,0 +1,316 @@
+#include "broker_transport.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netdb.h>
+#include <unistd.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/net_sockets.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/x509_crt.h"
+#include "mbedtls/error.h"
+#include "sh_latency.h"
+
+#define TAG "broker_transport"
+
+typedef struct {
+    bool tls;
+    mbedtls_net_context net;
+    // Konfiguracja TLS i CA wczytywane raz, kontekst połączenia tworzony przy łączeniu
+    mbedtls_ssl_config conf;
+    mbedtls_x509_crt ca;
+    mbedtls_entropy_context entropy;
+    mbedtls_ctr_drbg_context drbg;
+    mbedtls_ssl_context ssl;
+    bool ssl_active;
+    // Sesja z ostatniego uzgadniania, proponowana przy kolejnym połączeniu
+    mbedtls_ssl_session session;
+    bool session_valid;
+} transport_ctx_t;
+
+static broker_transport_timing_t timing;
+
+// Łączy gniazdo z adresem z limitem czasu. Zwraca deskryptor lub -1.
+static int tcp_connect(const struct addrinfo *addr, int timeout_ms)
+{
+    int fd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+    if (fd < 0) {
+        return -1;
+    }
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    if (connect(fd, addr->ai_addr, addr->ai_addrlen) < 0 && errno != EINPROGRESS) {
+        close(fd);
+        return -1;
+    }
+
+    fd_set writable;
+    FD_ZERO(&writable);
+    FD_SET(fd, &writable);
+    struct timeval tv = { .tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000 };
+    int error = 0;
+    socklen_t error_len = sizeof(error);
+    if (select(fd + 1, NULL, &writable, NULL, &tv) <= 0 ||
+        getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &error_len) < 0 || error != 0) {
+        close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, flags);
+    return fd;
+}
+
+// Czy serwer przyjął zaproponowaną sesję - przy wznowieniu odsyła jej identyfikator
+static bool session_resumed(const mbedtls_ssl_session *offered, const mbedtls_ssl_session *current)
+{
+    size_t len = mbedtls_ssl_session_get_id_len(offered);
+    return len > 0 && len == mbedtls_ssl_session_get_id_len(current) &&
+           memcmp(mbedtls_ssl_session_get_id(offered), mbedtls_ssl_session_get_id(current), len) == 0;
+}
+
+static int tls_handshake(transport_ctx_t *ctx, const char *host, int timeout_ms)
+{
+    mbedtls_ssl_init(&ctx->ssl);
+    ctx->ssl_active = true;
+    mbedtls_ssl_conf_read_timeout(&ctx->conf, timeout_ms);
+    int ret = mbedtls_ssl_setup(&ctx->ssl, &ctx->conf);
+    if (ret == 0) {
+        ret = mbedtls_ssl_set_hostname(&ctx->ssl, host);
+    }
+    if (ret != 0) {
+        return ret;
+    }
+    mbedtls_ssl_set_bio(&ctx->ssl, &ctx->net, mbedtls_net_send, NULL, mbedtls_net_recv_timeout);
+
+    timing.session_offered = ctx->session_valid && mbedtls_ssl_set_session(&ctx->ssl, &ctx->session) == 0;
+    while ((ret = mbedtls_ssl_handshake(&ctx->ssl)) != 0) {
+        if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+            // Serwer mógł odrzucić bilet - następne połączenie zaczyna od pełnego uzgadniania
+            if (ctx->session_valid) {
+                mbedtls_ssl_session_free(&ctx->session);
+                ctx->session_valid = false;
+            }
+            return ret;
+        }
+    }
+
+    mbedtls_ssl_session current;
+    mbedtls_ssl_session_init(&current);
+    if (mbedtls_ssl_get_session(&ctx->ssl, &current) == 0) {
+        timing.session_resumed = timing.session_offered && session_resumed(&ctx->session, &current);
+        if (ctx->session_valid) {
+            mbedtls_ssl_session_free(&ctx->session);
+        }
+        ctx->session = current;
+        ctx->session_valid = true;
+    } else {
+        mbedtls_ssl_session_free(&current);
+    }
+    return 0;
+}
+
+static int transport_close(esp_transport_handle_t t)
+{
+    transport_ctx_t *ctx = esp_transport_get_context_data(t);
+    if (ctx->ssl_active) {
+        mbedtls_ssl_close_notify(&ctx->ssl);
+        mbedtls_ssl_free(&ctx->ssl);
+        ctx->ssl_active = false;
+    }
+    mbedtls_net_free(&ctx->net);
+    return 0;
+}
+
+static int transport_connect(esp_transport_handle_t t, const char *host, int port, int timeout_ms)
+{
+    transport_ctx_t *ctx = esp_transport_get_context_data(t);
+    transport_close(t);
+    timing.tls_us = 0;
+    timing.session_offered = false;
+    timing.session_resumed = false;
+
+    int64_t start_us = esp_timer_get_time();
+    char port_str[6];
+    snprintf(port_str, sizeof(port_str), "%d", port);
+    const struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+    struct addrinfo *addr = NULL;
+    if (getaddrinfo(host, port_str, &hints, &addr) != 0 || addr == NULL) {
+        ESP_LOGE(TAG, "DNS lookup of %s failed", host);
+        return -1;
+    }
+    int64_t resolved_us = esp_timer_get_time();
+    timing.dns_us = sh_elapsed_us(start_us, resolved_us);
+
+    ctx->net.fd = tcp_connect(addr, timeout_ms);
+    freeaddrinfo(addr);
+    if (ctx->net.fd < 0) {
+        ESP_LOGE(TAG, "TCP connection to %s:%d failed, errno %d", host, port, errno);
+        return -1;
+    }
+    int64_t tcp_us = esp_timer_get_time();
+    timing.tcp_us = sh_elapsed_us(resolved_us, tcp_us);
+
+    if (ctx->tls) {
+        int ret = tls_handshake(ctx, host, timeout_ms);
+        if (ret != 0) {
+            ESP_LOGE(TAG, "TLS handshake with %s failed, error: -0x%04x", host, (unsigned)-ret);
+            transport_close(t);
+            return -1;
+        }
+        timing.tls_us = sh_elapsed_us(tcp_us, esp_timer_get_time());
+    }
+    timing.connected_us = esp_timer_get_time();
+    return 0;
+}
+
+static int transport_poll(transport_ctx_t *ctx, bool write, int timeout_ms)
+{
+    // Odszyfrowane dane czekające w mbedTLS nie są widoczne dla select()
+    if (!write && ctx->ssl_active && mbedtls_ssl_get_bytes_avail(&ctx->ssl) > 0) {
+        return 1;
+    }
+    fd_set fds, errors;
+    FD_ZERO(&fds);
+    FD_ZERO(&errors);
+    FD_SET(ctx->net.fd, &fds);
+    FD_SET(ctx->net.fd, &errors);
+    struct timeval tv = { .tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000 };
+    int ret = select(ctx->net.fd + 1, write ? NULL : &fds, write ? &fds : NULL, &errors, timeout_ms < 0 ? NULL : &tv);
+    return ret > 0 && FD_ISSET(ctx->net.fd, &errors) ? -1 : ret;
+}
+
+static int transport_poll_read(esp_transport_handle_t t, int timeout_ms)
+{
+    return transport_poll(esp_transport_get_context_data(t), false, timeout_ms);
+}
+
+static int transport_poll_write(esp_transport_handle_t t, int timeout_ms)
+{
+    return transport_poll(esp_transport_get_context_data(t), true, timeout_ms);
+}
+
+static int transport_read(esp_transport_handle_t t, char *buffer, int len, int timeout_ms)
+{
+    transport_ctx_t *ctx = esp_transport_get_context_data(t);
+    int ready = transport_poll(ctx, false, timeout_ms);
+    if (ready <= 0) {
+        return ready == 0 ? ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT : ERR_TCP_TRANSPORT_CONNECTION_FAILED;
+    }
+    int ret = ctx->tls ? mbedtls_ssl_read(&ctx->ssl, (unsigned char *)buffer, len) : recv(ctx->net.fd, buffer, len, 0);
+    if (ret > 0) {
+        return ret;
+    }
+    if (ret == 0 || ret == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY) {
+        return ERR_TCP_TRANSPORT_CONNECTION_CLOSED_BY_FIN;
+    }
+    if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+        return ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT;
+    }
+    return ERR_TCP_TRANSPORT_CONNECTION_FAILED;
+}
+
+static int transport_write(esp_transport_handle_t t, const char *buffer, int len, int timeout_ms)
+{
+    transport_ctx_t *ctx = esp_transport_get_context_data(t);
+    int written = 0;
+    while (written < len) {
+        int ready = transport_poll(ctx, true, timeout_ms);
+        if (ready <= 0) {
+            return ready == 0 ? ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT : ERR_TCP_TRANSPORT_CONNECTION_FAILED;
+        }
+        int ret = ctx->tls ? mbedtls_ssl_write(&ctx->ssl, (const unsigned char *)&buffer[written], len - written)
+                           : send(ctx->net.fd, &buffer[written], len - written, 0);
+        if (ret > 0) {
+            written += ret;
+        } else if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+            return ERR_TCP_TRANSPORT_CONNECTION_FAILED;
+        }
+    }
+    return written;
+}
+
+static void ctx_free(transport_ctx_t *ctx)
+{
+    if (ctx->tls) {
+        if (ctx->session_valid) {
+            mbedtls_ssl_session_free(&ctx->session);
+        }
+        mbedtls_ssl_config_free(&ctx->conf);
+        mbedtls_x509_crt_free(&ctx->ca);
+        mbedtls_ctr_drbg_free(&ctx->drbg);
+        mbedtls_entropy_free(&ctx->entropy);
+    }
+    free(ctx);
+}
+
+static int transport_destroy(esp_transport_handle_t t)
+{
+    transport_close(t);
+    ctx_free(esp_transport_get_context_data(t));
+    return 0;
+}
+
+static int tls_config_init(transport_ctx_t *ctx, const char *ca_pem)
+{
+    mbedtls_ssl_config_init(&ctx->conf);
+    mbedtls_x509_crt_init(&ctx->ca);
+    mbedtls_entropy_init(&ctx->entropy);
+    mbedtls_ctr_drbg_init(&ctx->drbg);
+
+    int ret = mbedtls_ctr_drbg_seed(&ctx->drbg, mbedtls_entropy_func, &ctx->entropy, NULL, 0);
+    if (ret == 0) {
+        ret = mbedtls_x509_crt_parse(&ctx->ca, (const unsigned char *)ca_pem, strlen(ca_pem) + 1);
+    }
+    if (ret == 0) {
+        ret = mbedtls_ssl_config_defaults(&ctx->conf, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                          MBEDTLS_SSL_PRESET_DEFAULT);
+    }
+    if (ret != 0) {
+        return ret;
+    }
+    mbedtls_ssl_conf_authmode(&ctx->conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+    mbedtls_ssl_conf_ca_chain(&ctx->conf, &ctx->ca, NULL);
+    mbedtls_ssl_conf_rng(&ctx->conf, mbedtls_ctr_drbg_random, &ctx->drbg);
+    mbedtls_ssl_conf_session_tickets(&ctx->conf, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+    return 0;
+}
+
+esp_transport_handle_t broker_transport_init(const char *ca_pem)
+{
+    transport_ctx_t *ctx = calloc(1, sizeof(*ctx));
+    if (ctx == NULL) {
+        return NULL;
+    }
+    mbedtls_net_init(&ctx->net);
+    ctx->tls = ca_pem != NULL;
+    if (ctx->tls) {
+        int ret = tls_config_init(ctx, ca_pem);
+        if (ret != 0) {
+            ESP_LOGE(TAG, "TLS configuration failed, error: -0x%04x", (unsigned)-ret);
+            ctx_free(ctx);
+            return NULL;
+        }
+    }
+
+    esp_transport_handle_t t = esp_transport_init();
+    if (t == NULL) {
+        ctx_free(ctx);
+        return NULL;
+    }
+    esp_transport_set_context_data(t, ctx);
+    esp_transport_set_func(t, transport_connect, transport_read, transport_write, transport_close,
+                           transport_poll_read, transport_poll_write, transport_destroy);
+    return t;
+}
+
+const broker_transport_timing_t *broker_transport_timing(void)
+{
+    return &timing;
+}
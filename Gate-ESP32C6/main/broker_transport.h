@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_transport.h"
+
+// Transport klienta esp-mqtt do brokera: zwykłe TCP albo TLS (mbedTLS) na tym samym
+// gnieździe. Przy TLS sesja z ostatniego uzgadniania (bilet sesji lub identyfikator)
+// jest zachowywana i proponowana przy kolejnym połączeniu, więc po zerwaniu łącza
+// brama pomija pełne uzgadnianie z kryptografią klucza publicznego.
+// Każde połączenie mierzy czasy DNS, TCP i uzgadniania TLS.
+//
+// Z transportu korzysta tylko zadanie klienta MQTT.
+
+typedef struct {
+    uint32_t dns_us;
+    uint32_t tcp_us;
+    uint32_t tls_us;        // 0 dla zwykłego TCP
+    bool session_offered;   // klient zaproponował zapamiętaną sesję
+    bool session_resumed;   // serwer ją przyjął
+    int64_t connected_us;   // koniec łączenia transportu, początek czekania na CONNACK
+} broker_transport_timing_t;
+
+// Tworzy transport. ca_pem - certyfikat CA w formacie PEM zakończony '\0', NULL dla TCP.
+esp_transport_handle_t broker_transport_init(const char *ca_pem);
+
+// Czasy ostatniego udanego połączenia
+const broker_transport_timing_t *broker_transport_timing(void);
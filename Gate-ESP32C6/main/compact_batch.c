@@ -0,0 +1,92 @@
+#include "compact_batch.h"
+
+#include <stdio.h>
+#include "freertos/task.h"
+
+static compact_batch_t batches[COMPACT_MAX_DEVICES];
+
+compact_batch_t *compact_batch_get(uint8_t group, uint8_t device)
+{
+    compact_batch_t *free_slot = NULL;
+    for (size_t i = 0; i < COMPACT_MAX_DEVICES; i++) {
+        compact_batch_t *batch = &batches[i];
+        if (batch->used && batch->group == group && batch->device == device) {
+            return batch;
+        }
+        if (!batch->used && free_slot == NULL) {
+            free_slot = batch;
+        }
+    }
+    if (free_slot != NULL) {
+        free_slot->used = true;
+        free_slot->group = group;
+        free_slot->device = device;
+        free_slot->seq = 0;
+        free_slot->count = 0;
+    }
+    return free_slot;
+}
+
+compact_batch_t *compact_batch_at(size_t index)
+{
+    return index < COMPACT_MAX_DEVICES && batches[index].used ? &batches[index] : NULL;
+}
+
+bool compact_batch_add(compact_batch_t *batch, const compact_reading_t *reading)
+{
+    if (batch->count >= CONFIG_GATE_BATCH_MAX_READINGS) {
+        return false;
+    }
+    if (batch->count == 0) {
+        batch->first_tick = xTaskGetTickCount();
+    }
+    batch->readings[batch->count++] = *reading;
+    return true;
+}
+
+bool compact_batch_due(const compact_batch_t *batch, TickType_t flush_ticks)
+{
+    return batch->count > 0 &&
+           (batch->count >= CONFIG_GATE_BATCH_MAX_READINGS || xTaskGetTickCount() - batch->first_tick >= flush_ticks);
+}
+
+TickType_t compact_batch_wait(TickType_t flush_ticks)
+{
+    TickType_t now = xTaskGetTickCount();
+    TickType_t wait = portMAX_DELAY;
+    for (size_t i = 0; i < COMPACT_MAX_DEVICES; i++) {
+        const compact_batch_t *batch = &batches[i];
+        if (!batch->used || batch->count == 0) {
+            continue;
+        }
+        if (compact_batch_due(batch, flush_ticks)) {
+            return 0;
+        }
+        TickType_t left = flush_ticks - (now - batch->first_tick);
+        wait = left < wait ? left : wait;
+    }
+    return wait;
+}
+
+void compact_batch_drop_all(void)
+{
+    for (size_t i = 0; i < COMPACT_MAX_DEVICES; i++) {
+        batches[i].count = 0;
+    }
+}
+
+int compact_batch_encode(const compact_batch_t *batch, char *topic, size_t topic_len, char *buf, size_t buf_len)
+{
+    snprintf(topic, topic_len, "gr%u/node/%u", batch->group, batch->device);
+
+    int len = snprintf(buf, buf_len, "{\"seq\":%u,\"r\":[", batch->seq);
+    for (size_t i = 0; i < batch->count && len > 0 && (size_t)len < buf_len; i++) {
+        const compact_reading_t *reading = &batch->readings[i];
+        len += snprintf(&buf[len], buf_len - len, "%s[%lld,%u,%d,%d]", i > 0 ? "," : "",
+                        (long long)reading->unix_ms, reading->sensor, reading->temperature, reading->humidity);
+    }
+    if (len > 0 && (size_t)len < buf_len) {
+        len += snprintf(&buf[len], buf_len - len, "]}");
+    }
+    return len > 0 && (size_t)len < buf_len ? len : -1;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+
+// Zwarty format publikacji pomiarów: jeden temat na urządzenie "gr<N>/node/<D>"
+// i porcja odczytów w jednej wiadomości:
+//
+//  {"seq":<n>,"r":[[<unix ms>,<czujnik>,<temperatura>,<wilgotność>],...]}
+//
+// Temperatura i wilgotność w setnych częściach, czas 0 - nieznany. seq rośnie
+// o jeden na wiadomość urządzenia, więc odbiorca widzi utracone porcje.
+// Porcje trzyma jedno zadanie publikacji - moduł nie ma blokad.
+
+#define COMPACT_MAX_DEVICES 8
+// Nagłówek i zakończenie wiadomości oraz najdłuższy zapis odczytu z przecinkiem
+#define COMPACT_PAYLOAD_MAX (24 + 42 * CONFIG_GATE_BATCH_MAX_READINGS)
+
+typedef struct {
+    int64_t unix_ms;
+    uint8_t sensor;
+    int16_t temperature;
+    int16_t humidity;
+} compact_reading_t;
+
+typedef struct {
+    bool used;
+    uint8_t group;
+    uint8_t device;
+    uint16_t seq;           // numer następnej wiadomości
+    size_t count;
+    TickType_t first_tick;  // chwila dodania najstarszego odczytu
+    compact_reading_t readings[CONFIG_GATE_BATCH_MAX_READINGS];
+} compact_batch_t;
+
+// Porcja urządzenia, tworzona przy pierwszym odczycie. NULL, gdy brak miejsca.
+compact_batch_t *compact_batch_get(uint8_t group, uint8_t device);
+
+// Porcja w miejscu index (0..COMPACT_MAX_DEVICES-1) lub NULL
+compact_batch_t *compact_batch_at(size_t index);
+
+// Dodaje odczyt. Zwraca false, gdy porcja jest pełna.
+bool compact_batch_add(compact_batch_t *batch, const compact_reading_t *reading);
+
+// Czy niepusta porcja jest pełna lub jej najstarszy odczyt czeka co najmniej flush_ticks
+bool compact_batch_due(const compact_batch_t *batch, TickType_t flush_ticks);
+
+// Czas do najbliższego terminu wysłania porcji, portMAX_DELAY - wszystkie porcje puste
+TickType_t compact_batch_wait(TickType_t flush_ticks);
+
+// Opróżnia wszystkie porcje bez wysyłania
+void compact_batch_drop_all(void);
+
+// Zapisuje temat i treść wiadomości porcji. Zwraca długość treści lub -1, gdy bufor jest za mały.
+int compact_batch_encode(const compact_batch_t *batch, char *topic, size_t topic_len, char *buf, size_t buf_len);
@@ -0,0 +1,240 @@
+#include "flash_ring.h"
+
+#include <stdbool.h>
+#include <string.h>
+#include <sys/time.h>
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "sh_link.h"
+
+#define TAG "flash_ring"
+#define PARTITION_LABEL "storebuf"
+#define SECTOR_SIZE 4096
+#define RECORD_SIZE 64
+#define RECORDS_PER_SECTOR (SECTOR_SIZE / RECORD_SIZE)
+#define SCAN_CHUNK_RECORDS 8
+#define RECORD_FREE 0xFFFFFFFF
+#define VALID_UNIX_MS 1704067200000LL // 2024-01-01 - wcześniejszy czas oznacza zegar nieustawiony po starcie
+
+// Rekord w partycji. Pole consumed jest jedynym zapisywanym ponownie - flash pozwala
+// zmienić bity z 1 na 0 bez kasowania, więc wysłanie ramki kosztuje jeden zapis 4 bajtów.
+typedef struct {
+    uint32_t seq;         // numer zapisu, RECORD_FREE - wolne miejsce po kasowaniu
+    uint32_t consumed;    // RECORD_FREE - do wysłania, 0 - wysłany
+    uint32_t boot_id;     // losowy numer uruchomienia, pozwala przeliczyć uptime_us na czas
+    uint8_t len;
+    uint8_t reserved;
+    uint16_t crc;         // CRC-16 rekordu z consumed = RECORD_FREE i crc = 0
+    int64_t uptime_us;
+    int64_t unix_ms;      // 0, gdy zegar nie był ustawiony w chwili zapisu
+    uint8_t frame[SH_FRAME_MAX_LEN];
+} stored_record_t;
+
+_Static_assert(sizeof(stored_record_t) == RECORD_SIZE, "record layout");
+
+static const esp_partition_t *partition;
+static size_t capacity;   // liczba rekordów w partycji
+static size_t head;       // najstarszy rekord do wysłania
+static size_t tail;       // miejsce następnego zapisu
+static size_t count;      // rekordy między head a tail, w tym pominięte przy odczycie
+static size_t read_end;   // koniec zakresu zwróconego przez flash_ring_read()
+static uint32_t next_seq;
+static uint32_t boot_id;
+static flash_ring_stats_t stats;
+
+static uint16_t record_crc(const stored_record_t *record)
+{
+    stored_record_t copy = *record;
+    copy.consumed = RECORD_FREE;
+    copy.crc = 0;
+    return sh_link_crc16((const uint8_t *)&copy, sizeof(copy));
+}
+
+static bool record_valid(const stored_record_t *record)
+{
+    return record->seq != RECORD_FREE && record->len <= SH_FRAME_MAX_LEN && record->crc == record_crc(record);
+}
+
+static bool record_blank(const stored_record_t *record)
+{
+    const uint8_t *bytes = (const uint8_t *)record;
+    for (size_t i = 0; i < sizeof(*record); i++) {
+        if (bytes[i] != 0xFF) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int64_t flash_ring_unix_ms(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    int64_t ms = (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+    return ms >= VALID_UNIX_MS ? ms : 0;
+}
+
+esp_err_t flash_ring_init(void)
+{
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, PARTITION_LABEL);
+    if (partition == NULL) {
+        ESP_LOGE(TAG, "Partition %s not found", PARTITION_LABEL);
+        return ESP_ERR_NOT_FOUND;
+    }
+    capacity = partition->size / SECTOR_SIZE * RECORDS_PER_SECTOR;
+    if (capacity < 2 * RECORDS_PER_SECTOR) {
+        ESP_LOGE(TAG, "Partition %s needs at least two sectors", PARTITION_LABEL);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    boot_id = esp_random();
+    // Stan wyłącznie z zawartości partycji, także przy ponownym wywołaniu
+    head = tail = count = read_end = 0;
+    next_seq = 0;
+    memset(&stats, 0, sizeof(stats));
+
+    // Najnowszy rekord wyznacza miejsce zapisu, najstarszy niewysłany - miejsce odczytu
+    stored_record_t records[SCAN_CHUNK_RECORDS];
+    bool found = false;
+    bool pending = false;
+    uint32_t max_seq = 0, min_pending_seq = 0;
+    size_t max_index = 0;
+    for (size_t index = 0; index < capacity; index += SCAN_CHUNK_RECORDS) {
+        esp_err_t err = esp_partition_read(partition, index * RECORD_SIZE, records, sizeof(records));
+        if (err != ESP_OK) {
+            return err;
+        }
+        for (size_t i = 0; i < SCAN_CHUNK_RECORDS; i++) {
+            const stored_record_t *record = &records[i];
+            if (!record_valid(record)) {
+                continue;
+            }
+            if (!found || (int32_t)(record->seq - max_seq) > 0) {
+                max_seq = record->seq;
+                max_index = index + i;
+            }
+            if (record->consumed == RECORD_FREE && (!pending || (int32_t)(record->seq - min_pending_seq) < 0)) {
+                min_pending_seq = record->seq;
+                head = index + i;
+                pending = true;
+            }
+            found = true;
+        }
+    }
+
+    if (found) {
+        next_seq = max_seq + 1;
+        tail = (max_index + 1) % capacity;
+        // Przerwany zapis zostawia niepusty rekord - zapis zaczyna się od następnego sektora
+        stored_record_t record;
+        if (tail % RECORDS_PER_SECTOR != 0 &&
+            (esp_partition_read(partition, tail * RECORD_SIZE, &record, sizeof(record)) != ESP_OK || !record_blank(&record))) {
+            tail = (tail / RECORDS_PER_SECTOR + 1) * RECORDS_PER_SECTOR % capacity;
+        }
+    }
+    if (pending) {
+        count = head == tail ? capacity : (tail + capacity - head) % capacity;
+    } else {
+        head = tail;
+    }
+    ESP_LOGI(TAG, "%u of %u records pending replay", (unsigned)count, (unsigned)capacity);
+    return ESP_OK;
+}
+
+esp_err_t flash_ring_push(const uint8_t *frame, size_t len)
+{
+    if (partition == NULL || len > SH_FRAME_MAX_LEN) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // Wejście do sektora wymaga jego skasowania. Leżące w nim niewysłane ramki są najstarsze.
+    if (tail % RECORDS_PER_SECTOR == 0) {
+        size_t sector_end = tail + RECORDS_PER_SECTOR;
+        if (count > 0 && head >= tail && head < sector_end) {
+            size_t lost = sector_end - head;
+            lost = lost < count ? lost : count;
+            count -= lost;
+            stats.dropped += lost;
+            head = sector_end % capacity;
+            ESP_LOGW(TAG, "Buffer full, dropped %u oldest frames", (unsigned)lost);
+        }
+        esp_err_t err = esp_partition_erase_range(partition, tail * RECORD_SIZE, SECTOR_SIZE);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to erase sector, error: %s", esp_err_to_name(err));
+            return err;
+        }
+        if (count == 0) {
+            head = tail;
+        }
+    }
+
+    stored_record_t record;
+    memset(&record, 0xFF, sizeof(record));
+    record.seq = next_seq;
+    record.boot_id = boot_id;
+    record.len = (uint8_t)len;
+    record.uptime_us = esp_timer_get_time();
+    record.unix_ms = flash_ring_unix_ms();
+    memcpy(record.frame, frame, len);
+    record.crc = record_crc(&record);
+
+    esp_err_t err = esp_partition_write(partition, tail * RECORD_SIZE, &record, sizeof(record));
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to write record, error: %s", esp_err_to_name(err));
+        return err;
+    }
+    next_seq++;
+    tail = (tail + 1) % capacity;
+    count++;
+    stats.stored++;
+    return ESP_OK;
+}
+
+size_t flash_ring_count(void)
+{
+    return count;
+}
+
+size_t flash_ring_read(flash_ring_record_t *records, size_t max)
+{
+    size_t index = head;
+    size_t remaining = count;
+    size_t returned = 0;
+    // Rekordy uszkodzone lub już wysłane (np. po restarcie w trakcie wysyłki) są pomijane,
+    // ale należą do zakresu zdejmowanego przez flash_ring_consume()
+    while (remaining > 0 && returned < max) {
+        stored_record_t record;
+        if (esp_partition_read(partition, index * RECORD_SIZE, &record, sizeof(record)) == ESP_OK &&
+            record_valid(&record) && record.consumed == RECORD_FREE) {
+            flash_ring_record_t *out = &records[returned++];
+            out->len = record.len;
+            memcpy(out->frame, record.frame, record.len);
+            out->unix_ms = record.unix_ms;
+            // Zegar ustawiony po zapisie - czas odtwarzany z uptime, jeśli nie było restartu
+            if (out->unix_ms == 0 && record.boot_id == boot_id && flash_ring_unix_ms() != 0) {
+                out->unix_ms = flash_ring_unix_ms() - (esp_timer_get_time() - record.uptime_us) / 1000;
+            }
+        }
+        index = (index + 1) % capacity;
+        remaining--;
+    }
+    read_end = index;
+    return returned;
+}
+
+void flash_ring_consume(void)
+{
+    const uint32_t consumed = 0;
+    while (head != read_end && count > 0) {
+        esp_partition_write(partition, head * RECORD_SIZE + offsetof(stored_record_t, consumed), &consumed, sizeof(consumed));
+        head = (head + 1) % capacity;
+        count--;
+        stats.replayed++;
+    }
+}
+
+const flash_ring_stats_t *flash_ring_stats(void)
+{
+    return &stats;
+}
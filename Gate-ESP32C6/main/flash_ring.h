@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "sh_proto.h"
+
+// Bufor ramek pomiarów w partycji flash "storebuf" (partitions.csv), zapisywany, gdy nie
+// ma połączenia z brokerem. Stany elementów wykonawczych idą przez kolejkę stanów
+// (mqtt_outbox.h). Ramki leżą w kolejnych rekordach jak w dzienniku, a sektor
+// jest kasowany dopiero wtedy, gdy zapis wraca na jego początek - każdy sektor jest
+// więc kasowany raz na pełny obieg partycji. Gdy partycja się zapełni, najstarszy
+// sektor oczekujących ramek jest nadpisywany. Wysłane ramki są oznaczane w rekordzie
+// bez kasowania, dlatego po restarcie odtwarzane są tylko niewysłane.
+//
+// Moduł nie ma blokad - wszystkie funkcje wywołuje jedno zadanie.
+
+typedef struct {
+    int64_t unix_ms; // chwila odebrania ramki, 0 - nieznana (zegar nie był ustawiony)
+    uint8_t len;
+    uint8_t frame[SH_FRAME_MAX_LEN];
+} flash_ring_record_t;
+
+typedef struct {
+    uint32_t stored;   // ramki zapisane od startu
+    uint32_t replayed; // ramki oznaczone jako wysłane
+    uint32_t dropped;  // ramki nadpisane przed wysłaniem
+} flash_ring_stats_t;
+
+// Odnajduje partycję i odtwarza stan bufora z rekordów zapisanych przed restartem
+esp_err_t flash_ring_init(void);
+
+// Zapisuje ramkę z bieżącym czasem
+esp_err_t flash_ring_push(const uint8_t *frame, size_t len);
+
+// Liczba rekordów czekających na wysłanie (po restarcie także uszkodzonych)
+size_t flash_ring_count(void);
+
+// Odczytuje najwyżej max najstarszych ramek bez usuwania. Zwraca ich liczbę - może
+// być 0, gdy odczytany zakres zawierał tylko uszkodzone rekordy.
+size_t flash_ring_read(flash_ring_record_t *records, size_t max);
+
+// Oznacza jako wysłany zakres odczytany przez ostatnie flash_ring_read().
+// Nie wolno wywołać flash_ring_push() między odczytem a oznaczeniem.
+void flash_ring_consume(void);
+
+const flash_ring_stats_t *flash_ring_stats(void);
+
+// Czas UTC używany do oznaczania ramek, w ms. 0, gdy SNTP jeszcze nie ustawił zegara.
+int64_t flash_ring_unix_ms(void);
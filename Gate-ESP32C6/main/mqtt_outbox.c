@@ -0,0 +1,200 @@
+#include "mqtt_outbox.h"
+
+#include <stdio.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#define TAG "mqtt_outbox"
+
+typedef enum {
+    ENTRY_FREE = 0,
+    ENTRY_QUEUED,    // czeka na wysłanie
+    ENTRY_SENDING,   // zajęty przez mqtt_outbox_next(), bez msg_id
+    ENTRY_IN_FLIGHT, // u klienta MQTT, czeka na PUBACK
+} entry_state_t;
+
+static mqtt_outbox_entry_t entries[CONFIG_GATE_OUTBOX_SIZE];
+static mqtt_outbox_stats_t stats;
+static uint32_t next_order;
+// PUBACK, który przyszedł, zanim wysyłające zadanie zapisało msg_id wpisu
+static int early_ack = -1;
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+void mqtt_outbox_init(void)
+{
+    portENTER_CRITICAL(&lock);
+    memset(entries, 0, sizeof(entries));
+    memset(&stats, 0, sizeof(stats));
+    early_ack = -1;
+    portEXIT_CRITICAL(&lock);
+}
+
+// Najstarszy wpis w danym stanie, opcjonalnie tylko elementu key. Wywoływane pod blokadą.
+static mqtt_outbox_entry_t *oldest(entry_state_t state, int key)
+{
+    mqtt_outbox_entry_t *found = NULL;
+    for (size_t i = 0; i < CONFIG_GATE_OUTBOX_SIZE; i++) {
+        mqtt_outbox_entry_t *entry = &entries[i];
+        if (entry->state == state && (key < 0 || entry->key == key) &&
+            (found == NULL || (int32_t)(entry->order - found->order) < 0)) {
+            found = entry;
+        }
+    }
+    return found;
+}
+
+static void complete(mqtt_outbox_entry_t *entry)
+{
+    sh_latency_record(&stats.delivery, entry->queued_us, esp_timer_get_time());
+    stats.delivered++;
+    entry->state = ENTRY_FREE;
+}
+
+bool mqtt_outbox_push(uint16_t key, const char *topic, const char *payload)
+{
+    // Treść formatowana przed blokadą, pod blokadą tylko kopiowana
+    char topic_copy[MQTT_OUTBOX_TOPIC_LEN];
+    char payload_copy[MQTT_OUTBOX_PAYLOAD_LEN];
+    snprintf(topic_copy, sizeof(topic_copy), "%s", topic);
+    snprintf(payload_copy, sizeof(payload_copy), "%s", payload);
+
+    bool accepted = true;
+    bool evicted = false;
+    portENTER_CRITICAL(&lock);
+    mqtt_outbox_entry_t *entry = oldest(ENTRY_QUEUED, key);
+    if (entry != NULL) {
+        stats.superseded++; // wpis zachowuje miejsce w kolejce, zmienia się tylko wartość
+    } else {
+        entry = oldest(ENTRY_FREE, -1);
+        if (entry == NULL) {
+            entry = oldest(ENTRY_QUEUED, -1);
+            evicted = entry != NULL;
+            stats.dropped++;
+        }
+        if (entry != NULL) {
+            entry->key = key;
+            entry->order = next_order++;
+        }
+    }
+    if (entry != NULL) {
+        entry->state = ENTRY_QUEUED;
+        entry->queued_us = esp_timer_get_time();
+        memcpy(entry->topic, topic_copy, sizeof(entry->topic));
+        memcpy(entry->payload, payload_copy, sizeof(entry->payload));
+        stats.queued++;
+    } else {
+        accepted = false;
+    }
+    portEXIT_CRITICAL(&lock);
+
+    if (evicted) {
+        ESP_LOGW(TAG, "Outbox full, dropped oldest queued message");
+    } else if (!accepted) {
+        ESP_LOGW(TAG, "Outbox full of unacknowledged messages, dropped %s: %s", topic, payload);
+    }
+    return accepted;
+}
+
+size_t mqtt_outbox_free(void)
+{
+    size_t free_entries = 0;
+    portENTER_CRITICAL(&lock);
+    for (size_t i = 0; i < CONFIG_GATE_OUTBOX_SIZE; i++) {
+        if (entries[i].state == ENTRY_FREE) {
+            free_entries++;
+        }
+    }
+    portEXIT_CRITICAL(&lock);
+    return free_entries;
+}
+
+mqtt_outbox_entry_t *mqtt_outbox_next(void)
+{
+    mqtt_outbox_entry_t *entry = NULL;
+    portENTER_CRITICAL(&lock);
+    size_t in_flight = 0;
+    for (size_t i = 0; i < CONFIG_GATE_OUTBOX_SIZE; i++) {
+        if (entries[i].state == ENTRY_SENDING || entries[i].state == ENTRY_IN_FLIGHT) {
+            in_flight++;
+        }
+    }
+    if (in_flight < CONFIG_GATE_OUTBOX_INFLIGHT) {
+        entry = oldest(ENTRY_QUEUED, -1);
+        if (entry != NULL) {
+            entry->state = ENTRY_SENDING;
+            entry->msg_id = -1;
+        }
+    }
+    portEXIT_CRITICAL(&lock);
+    return entry;
+}
+
+void mqtt_outbox_sent(mqtt_outbox_entry_t *entry, int msg_id)
+{
+    portENTER_CRITICAL(&lock);
+    if (msg_id < 0) {
+        entry->state = ENTRY_QUEUED;
+    } else if (msg_id == early_ack) {
+        early_ack = -1;
+        complete(entry);
+    } else {
+        entry->state = ENTRY_IN_FLIGHT;
+        entry->msg_id = msg_id;
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+void mqtt_outbox_published(int msg_id)
+{
+    portENTER_CRITICAL(&lock);
+    bool found = false;
+    bool sending = false;
+    for (size_t i = 0; i < CONFIG_GATE_OUTBOX_SIZE; i++) {
+        mqtt_outbox_entry_t *entry = &entries[i];
+        if (entry->state == ENTRY_IN_FLIGHT && entry->msg_id == msg_id) {
+            complete(entry);
+            found = true;
+            break;
+        }
+        sending = sending || entry->state == ENTRY_SENDING;
+    }
+    if (!found && sending) {
+        early_ack = msg_id;
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+void mqtt_outbox_deleted(int msg_id)
+{
+    bool requeued = false;
+    portENTER_CRITICAL(&lock);
+    for (size_t i = 0; i < CONFIG_GATE_OUTBOX_SIZE; i++) {
+        mqtt_outbox_entry_t *entry = &entries[i];
+        if (entry->state != ENTRY_IN_FLIGHT || entry->msg_id != msg_id) {
+            continue;
+        }
+        stats.expired++;
+        if (oldest(ENTRY_QUEUED, entry->key) != NULL) {
+            // Na wysłanie czeka już nowsza wartość tego elementu
+            stats.superseded++;
+            entry->state = ENTRY_FREE;
+        } else {
+            entry->state = ENTRY_QUEUED;
+            requeued = true;
+        }
+        break;
+    }
+    portEXIT_CRITICAL(&lock);
+
+    if (requeued) {
+        ESP_LOGW(TAG, "Message %d expired without PUBACK, sending again", msg_id);
+    }
+}
+
+void mqtt_outbox_stats(mqtt_outbox_stats_t *out)
+{
+    portENTER_CRITICAL(&lock);
+    *out = stats;
+    portEXIT_CRITICAL(&lock);
+}
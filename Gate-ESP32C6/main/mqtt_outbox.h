@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+#include "sh_latency.h"
+
+// Kolejka wiadomości o stanie elementów wykonawczych wysyłanych z QoS 1. Wpisy czekają
+// w stałej tablicy GATE_OUTBOX_SIZE miejsc, a do klienta MQTT trafia naraz najwyżej
+// GATE_OUTBOX_INFLIGHT niepotwierdzonych wiadomości. Wpis zwalnia dopiero PUBACK
+// (MQTT_EVENT_PUBLISHED). Wiadomość usunięta z kolejki klienta (MQTT_EVENT_DELETED)
+// wraca do wysłania.
+//
+// Nowy stan elementu zastępuje jego czekający stan - liczy się ostatnia wartość.
+// Gdy brak miejsca, wypada najstarszy czekający wpis, a gdy wszystkie są w drodze -
+// nowa wiadomość. Funkcje można wywoływać z wielu zadań.
+
+#define MQTT_OUTBOX_TOPIC_LEN 24
+#define MQTT_OUTBOX_PAYLOAD_LEN 32
+
+typedef struct {
+    uint16_t key;           // element wykonawczy, którego dotyczy wiadomość
+    uint8_t state;          // stan wpisu, wewnętrzny dla modułu
+    uint32_t order;         // kolejność dodania, wewnętrzna dla modułu
+    int msg_id;             // identyfikator nadany przez klienta, gdy wpis jest w drodze
+    int64_t queued_us;      // chwila dodania bieżącej wartości
+    char topic[MQTT_OUTBOX_TOPIC_LEN];
+    char payload[MQTT_OUTBOX_PAYLOAD_LEN];
+} mqtt_outbox_entry_t;
+
+typedef struct {
+    uint32_t queued;     // wiadomości przyjęte
+    uint32_t delivered;  // wiadomości potwierdzone przez broker
+    uint32_t superseded; // wartości zastąpione nowszą przed wysłaniem
+    uint32_t dropped;    // wiadomości usunięte z braku miejsca
+    uint32_t expired;    // wiadomości usunięte przez klienta bez potwierdzenia i wysłane ponownie
+    sh_latency_t delivery; // od dodania do PUBACK
+} mqtt_outbox_stats_t;
+
+void mqtt_outbox_init(void);
+
+// Dodaje wiadomość elementu key. Zwraca false, gdy nie było dla niej miejsca.
+bool mqtt_outbox_push(uint16_t key, const char *topic, const char *payload);
+
+// Liczba wolnych miejsc. Pozwala dodawać wiadomości o niskim priorytecie bez wypierania czekających.
+size_t mqtt_outbox_free(void);
+
+// Najstarszy czekający wpis, jeśli okno wiadomości w drodze nie jest pełne. Wpis jest
+// zajmowany do czasu wywołania mqtt_outbox_sent() i do tej chwili nie zmienia treści.
+mqtt_outbox_entry_t *mqtt_outbox_next(void);
+
+// Wynik przekazania wpisu klientowi. msg_id < 0 - wpis wraca do kolejki.
+void mqtt_outbox_sent(mqtt_outbox_entry_t *entry, int msg_id);
+
+// Obsługa MQTT_EVENT_PUBLISHED i MQTT_EVENT_DELETED
+void mqtt_outbox_published(int msg_id);
+void mqtt_outbox_deleted(int msg_id);
+
+// Kopia liczników (pod blokadą)
+void mqtt_outbox_stats(mqtt_outbox_stats_t *out);
@@ -0,0 +1,77 @@
+#include "ui_route.h"
+
+#include <string.h>
+#include "sh_proto.h"
+
+#define UI_ROUTE(name, actuator) { name, sizeof(name) - 1, actuator }
+
+// Kolejność według długości nazwy, potem bajtów (ui_route_find_sorted)
+const ui_route_t ui_routes[] = {
+    UI_ROUTE("swiatlo", SH_ACT_LIGHT),
+    UI_ROUTE("wiatrak", SH_ACT_FAN),
+};
+
+const size_t ui_route_count = sizeof(ui_routes) / sizeof(ui_routes[0]);
+
+const ui_route_t *ui_route_find_linear(const ui_route_t *routes, size_t count, const char *name, int name_len)
+{
+    for (size_t i = 0; i < count; i++) {
+        if (routes[i].name_len == name_len && memcmp(name, routes[i].name, name_len) == 0) {
+            return &routes[i];
+        }
+    }
+    return NULL;
+}
+
+const ui_route_t *ui_route_find_sorted(const ui_route_t *routes, size_t count, const char *name, int name_len)
+{
+    size_t low = 0;
+    size_t high = count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        int order = routes[mid].name_len != name_len ? routes[mid].name_len - name_len
+                                                     : memcmp(routes[mid].name, name, name_len);
+        if (order == 0) {
+            return &routes[mid];
+        }
+        if (order < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return NULL;
+}
+
+const ui_route_t *ui_route_find_in(const ui_route_t *routes, size_t count, const char *name, int name_len)
+{
+    if (count <= UI_ROUTE_LINEAR_MAX) {
+        return ui_route_find_linear(routes, count, name, name_len);
+    }
+    return ui_route_find_sorted(routes, count, name, name_len);
+}
+
+const ui_route_t *ui_route_find(const char *name, int name_len)
+{
+    return ui_route_find_in(ui_routes, ui_route_count, name, name_len);
+}
+
+bool ui_route_parse_topic(const char *topic, int topic_len, uint8_t *group, const char **name, int *name_len)
+{
+    int pos = 2;
+    unsigned value = 0;
+    if (topic_len < pos || strncmp(topic, "gr", pos) != 0) {
+        return false;
+    }
+    while (pos < topic_len && topic[pos] >= '0' && topic[pos] <= '9' && value < SH_GROUP_ALL) {
+        value = value * 10 + (topic[pos] - '0');
+        pos++;
+    }
+    if (pos == 2 || value >= SH_GROUP_ALL || topic_len - pos < 4 || strncmp(&topic[pos], "_ui/", 4) != 0) {
+        return false;
+    }
+    *group = (uint8_t)value;
+    *name = &topic[pos + 4];
+    *name_len = topic_len - pos - 4;
+    return true;
+}
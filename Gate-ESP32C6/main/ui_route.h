@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Tematy poleceń panelu "gr<N>_ui/<nazwa>". Grupa z tematu działa jak symbol
+// wieloznaczny, a nazwa wskazuje element wykonawczy przez tablicę tras posortowaną
+// według długości nazwy, potem jej bajtów. Do UI_ROUTE_LINEAR_MAX tras tablica jest
+// przeglądana po kolei z porównaniem długości, powyżej - wyszukiwaniem binarnym.
+// Próg wynika z pomiaru dla tablic różnej wielkości w test/test_ui_route.c. Moduł
+// nie zależy od ESP-IDF, więc jest też testowany na komputerze.
+
+#define UI_ROUTE_LINEAR_MAX 8
+
+typedef struct {
+    const char *name;
+    uint8_t name_len;
+    uint8_t actuator; // sh_actuator_t
+} ui_route_t;
+
+extern const ui_route_t ui_routes[];
+extern const size_t ui_route_count;
+
+// Trasa dla nazwy z tematu (bez zakończenia '\0') lub NULL
+const ui_route_t *ui_route_find(const char *name, int name_len);
+
+// Wyszukanie w dowolnej posortowanej tablicy tras, wybór sposobu według jej wielkości,
+// oraz oba sposoby osobno - do porównania w teście
+const ui_route_t *ui_route_find_in(const ui_route_t *routes, size_t count, const char *name, int name_len);
+const ui_route_t *ui_route_find_linear(const ui_route_t *routes, size_t count, const char *name, int name_len);
+const ui_route_t *ui_route_find_sorted(const ui_route_t *routes, size_t count, const char *name, int name_len);
+
+// Rozbiera temat panelu "gr<N>_ui/<nazwa>". Zwraca false dla innych tematów.
+bool ui_route_parse_topic(const char *topic, int topic_len, uint8_t *group, const char **name, int *name_len);
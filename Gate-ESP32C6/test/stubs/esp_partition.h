@@ -0,0 +1,38 @@
+#pragma once
+
+// Partycja flash w pamięci, z zachowaniem pamięci NOR: zapis zmienia bity tylko z 1
+// na 0, kasowanie ustawia cały sektor na 0xFF. Test może przerwać zapis lub kasowanie
+// po zadanej liczbie bajtów, jak zanik zasilania.
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef enum {
+    ESP_PARTITION_TYPE_DATA = 0x01,
+} esp_partition_type_t;
+
+typedef enum {
+    ESP_PARTITION_SUBTYPE_ANY = 0xff,
+} esp_partition_subtype_t;
+
+typedef struct {
+    esp_partition_type_t type;
+    esp_partition_subtype_t subtype;
+    uint32_t address;
+    uint32_t size;
+    uint32_t erase_size;
+    char label[17];
+} esp_partition_t;
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char *label);
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size);
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size);
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size);
+
+// Sterowanie partycją w teście
+void host_partition_create(const char *label, size_t sectors);
+uint8_t *host_partition_data(void);
+// Kolejny zapis lub kasowanie zmieni tylko tyle bajtów i zwróci błąd. -1 - bez awarii.
+void host_partition_fail_after(int bytes);
+uint32_t host_partition_erases(void);
@@ -0,0 +1,6 @@
+#pragma once
+
+#include <stdint.h>
+
+// Czas od startu w mikrosekundach, na komputerze zegar symulacji
+int64_t esp_timer_get_time(void);
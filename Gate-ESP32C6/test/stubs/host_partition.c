@@ -0,0 +1,118 @@
+// Partycja flash w pamięci i pozostałe funkcje ESP-IDF potrzebne modułom bramy na komputerze
+#include <stdlib.h>
+#include <string.h>
+#include "esp_partition.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+
+#define HOST_SECTOR_SIZE 4096
+
+static esp_partition_t partition;
+static uint8_t *data;
+static int fail_after = -1;
+static uint32_t erases;
+static int64_t now_us;
+
+void host_partition_create(const char *label, size_t sectors)
+{
+    free(data);
+    data = malloc(sectors * HOST_SECTOR_SIZE);
+    memset(data, 0xFF, sectors * HOST_SECTOR_SIZE);
+    memset(&partition, 0, sizeof(partition));
+    partition.type = ESP_PARTITION_TYPE_DATA;
+    partition.subtype = ESP_PARTITION_SUBTYPE_ANY;
+    partition.size = sectors * HOST_SECTOR_SIZE;
+    partition.erase_size = HOST_SECTOR_SIZE;
+    strncpy(partition.label, label, sizeof(partition.label) - 1);
+    fail_after = -1;
+    erases = 0;
+}
+
+uint8_t *host_partition_data(void)
+{
+    return data;
+}
+
+void host_partition_fail_after(int bytes)
+{
+    fail_after = bytes;
+}
+
+uint32_t host_partition_erases(void)
+{
+    return erases;
+}
+
+// Liczba bajtów, które operacja zdąży zmienić przed awarią
+static size_t allowed(size_t size, esp_err_t *err)
+{
+    *err = ESP_OK;
+    if (fail_after < 0 || (size_t)fail_after >= size) {
+        if (fail_after >= 0) {
+            fail_after -= size;
+        }
+        return size;
+    }
+    size = fail_after;
+    fail_after = -1;
+    *err = ESP_FAIL;
+    return size;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char *label)
+{
+    (void)type;
+    (void)subtype;
+    return data != NULL && strcmp(label, partition.label) == 0 ? &partition : NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *part, size_t src_offset, void *dst, size_t size)
+{
+    if (src_offset + size > part->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(dst, data + src_offset, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *part, size_t dst_offset, const void *src, size_t size)
+{
+    if (dst_offset + size > part->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    esp_err_t err;
+    size = allowed(size, &err);
+    const uint8_t *bytes = src;
+    for (size_t i = 0; i < size; i++) {
+        data[dst_offset + i] &= bytes[i];
+    }
+    return err;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *part, size_t offset, size_t size)
+{
+    if (offset % HOST_SECTOR_SIZE != 0 || size % HOST_SECTOR_SIZE != 0 || offset + size > part->size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err;
+    size = allowed(size, &err);
+    memset(data + offset, 0xFF, size);
+    erases++;
+    return err;
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    return code == ESP_OK ? "ESP_OK" : "ESP_FAIL";
+}
+
+uint32_t esp_random(void)
+{
+    return (uint32_t)rand();
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return now_us += 1000;
+}
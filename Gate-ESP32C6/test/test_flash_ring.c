@@ -0,0 +1,235 @@
+// Test bufora flash_ring na partycji w pamięci (stubs/host_partition.c). Restart bramy
+// to ponowne flash_ring_init() na tej samej zawartości partycji, zanik zasilania
+// w trakcie zapisu lub kasowania - operacja przerwana po części bajtów.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_partition.h"
+#include "flash_ring.h"
+
+static int failures;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+#define SECTORS 4
+#define RECORDS_PER_SECTOR 64
+#define CAPACITY (SECTORS * RECORDS_PER_SECTOR)
+#define RECORD_SIZE 64
+#define MAX_VALUES 1024
+
+static void fresh(void)
+{
+    host_partition_create("storebuf", SECTORS);
+    CHECK(flash_ring_init() == ESP_OK);
+}
+
+// Ramka niesie kolejną wartość, po której test rozpoznaje kolejność i zgubione ramki
+static esp_err_t push_value(uint32_t value)
+{
+    uint8_t frame[SH_FRAME_MAX_LEN];
+    memset(frame, (uint8_t)value, sizeof(frame));
+    memcpy(frame, &value, sizeof(value));
+    return flash_ring_push(frame, sizeof(frame));
+}
+
+static uint32_t value_of(const flash_ring_record_t *record)
+{
+    uint32_t value;
+    memcpy(&value, record->frame, sizeof(value));
+    return value;
+}
+
+// Odczytuje najwyżej max ramek (w porcjach po 10) i je oznacza, jeśli consume
+static size_t drain(uint32_t *values, size_t max, bool consume)
+{
+    size_t total = 0;
+    flash_ring_record_t records[10];
+    while (flash_ring_count() > 0 && total < max) {
+        size_t want = max - total < 10 ? max - total : 10;
+        size_t n = flash_ring_read(records, want);
+        for (size_t i = 0; i < n; i++) {
+            CHECK(records[i].len == SH_FRAME_MAX_LEN);
+            CHECK(records[i].frame[SH_FRAME_MAX_LEN - 1] == (uint8_t)value_of(&records[i]));
+            values[total++] = value_of(&records[i]);
+        }
+        if (!consume) {
+            break;
+        }
+        flash_ring_consume();
+    }
+    return total;
+}
+
+// Wartości ściśle rosnące - bufor nie zmienia kolejności i nie powtarza ramek
+static bool increasing(const uint32_t *values, size_t count)
+{
+    for (size_t i = 1; i < count; i++) {
+        if (values[i] <= values[i - 1]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void test_blank_and_garbage(void)
+{
+    fresh();
+    CHECK(flash_ring_count() == 0);
+
+    // Partycja z obcą zawartością: żadnego ważnego rekordu, pierwszy zapis kasuje sektor
+    memset(host_partition_data(), 0x5A, SECTORS * 4096);
+    CHECK(flash_ring_init() == ESP_OK);
+    CHECK(flash_ring_count() == 0);
+    CHECK(push_value(7) == ESP_OK);
+    uint32_t values[4];
+    CHECK(drain(values, 4, true) == 1 && values[0] == 7);
+}
+
+// Oznaczenie wysłanych ramek przetrwa restart, nieoznaczony odczyt wraca po restarcie
+static void test_consume_after_restart(void)
+{
+    fresh();
+    for (uint32_t i = 0; i < 100; i++) {
+        CHECK(push_value(i) == ESP_OK);
+    }
+    uint32_t values[MAX_VALUES];
+    CHECK(drain(values, 10, true) == 10 && values[0] == 0 && values[9] == 9);
+
+    CHECK(flash_ring_init() == ESP_OK);
+    CHECK(flash_ring_count() == 90);
+    CHECK(flash_ring_stats()->replayed == 0);
+
+    // Restart między odczytem a oznaczeniem - te same ramki wysyłane ponownie
+    CHECK(drain(values, 10, false) == 10 && values[0] == 10);
+    CHECK(flash_ring_init() == ESP_OK);
+    CHECK(flash_ring_count() == 90);
+    CHECK(drain(values, 10, false) == 10 && values[0] == 10);
+
+    // Zanik zasilania w trakcie oznaczania pierwszej ramki - częściowo wyzerowane pole
+    // wystarcza, ramka nie wraca
+    host_partition_fail_after(2);
+    flash_ring_consume();
+    CHECK(flash_ring_init() == ESP_OK);
+    CHECK(flash_ring_count() == 80);
+    size_t n = drain(values, MAX_VALUES, true);
+    CHECK(n == 80 && values[0] == 20 && values[79] == 99 && increasing(values, n));
+    CHECK(flash_ring_count() == 0);
+
+    CHECK(flash_ring_init() == ESP_OK);
+    CHECK(flash_ring_count() == 0);
+}
+
+// Przepełnienie kasuje cały sektor najstarszych ramek - bez oznaczonych jako wysłane
+static void test_sector_erase_loss(void)
+{
+    fresh();
+    uint32_t values[MAX_VALUES];
+    for (uint32_t i = 0; i < CAPACITY; i++) {
+        CHECK(push_value(i) == ESP_OK);
+    }
+    CHECK(flash_ring_count() == CAPACITY && flash_ring_stats()->dropped == 0);
+    CHECK(drain(values, 10, true) == 10);
+
+    // Zapis wraca na początek partycji: reszta pierwszego sektora przepada
+    CHECK(push_value(CAPACITY) == ESP_OK);
+    CHECK(flash_ring_stats()->dropped == RECORDS_PER_SECTOR - 10);
+    CHECK(flash_ring_count() == CAPACITY - RECORDS_PER_SECTOR + 1);
+
+    for (uint32_t i = CAPACITY + 1; i < 2 * CAPACITY; i++) {
+        CHECK(push_value(i) == ESP_OK);
+    }
+    uint32_t dropped = flash_ring_stats()->dropped;
+    CHECK((dropped - (RECORDS_PER_SECTOR - 10)) % RECORDS_PER_SECTOR == 0);
+    CHECK(flash_ring_stats()->stored == 2 * CAPACITY);
+    CHECK(flash_ring_count() == 2 * CAPACITY - 10 - dropped);
+    size_t count = flash_ring_count();
+
+    // Po restarcie te same ramki: najnowsze, w kolejności, bez luk
+    CHECK(flash_ring_init() == ESP_OK);
+    CHECK(flash_ring_count() == count);
+    size_t n = drain(values, MAX_VALUES, true);
+    CHECK(n == count && increasing(values, n));
+    CHECK(n > 0 && values[n - 1] == 2 * CAPACITY - 1 && values[n - 1] - values[0] == n - 1);
+    CHECK(host_partition_erases() == SECTORS * 2);
+    printf("sector erase: %u of %u frames dropped, %zu kept, %lu sector erases\n",
+           (unsigned)dropped, 2 * CAPACITY - 10, n, (unsigned long)host_partition_erases());
+}
+
+// Rekord przerwany w połowie zapisu: pomijany przy odczycie, a zapis po restarcie
+// zaczyna się od następnego sektora, bo przerwany rekord nie jest pusty
+static void test_torn_record_on_init(void)
+{
+    fresh();
+    uint32_t values[MAX_VALUES];
+    for (uint32_t i = 0; i < 20; i++) {
+        CHECK(push_value(i) == ESP_OK);
+    }
+    host_partition_fail_after(RECORD_SIZE / 2);
+    CHECK(push_value(20) != ESP_OK);
+
+    CHECK(flash_ring_init() == ESP_OK);
+    CHECK(flash_ring_count() == RECORDS_PER_SECTOR); // do końca sektora, z przerwanym i pustymi
+    for (uint32_t i = 21; i < 30; i++) {
+        CHECK(push_value(i) == ESP_OK);
+    }
+    CHECK(flash_ring_init() == ESP_OK);
+    size_t n = drain(values, MAX_VALUES, true);
+    CHECK(n == 29 && increasing(values, n));
+    CHECK(values[19] == 19 && values[20] == 21);
+    CHECK(flash_ring_count() == 0);
+
+    // Przerwany pierwszy rekord sektora
+    fresh();
+    for (uint32_t i = 0; i < RECORDS_PER_SECTOR; i++) {
+        CHECK(push_value(i) == ESP_OK);
+    }
+    host_partition_fail_after(4096 + 10); // kasowanie sektora i 10 bajtów rekordu
+    CHECK(push_value(RECORDS_PER_SECTOR) != ESP_OK);
+    CHECK(flash_ring_init() == ESP_OK);
+    CHECK(push_value(1000) == ESP_OK);
+    n = drain(values, MAX_VALUES, true);
+    CHECK(n == RECORDS_PER_SECTOR + 1 && increasing(values, n) && values[n - 1] == 1000);
+}
+
+// Zanik zasilania w trakcie kasowania sektora z najstarszymi ramkami: pozostałe
+// ramki nadal wychodzą w kolejności
+static void test_torn_erase(void)
+{
+    fresh();
+    uint32_t values[MAX_VALUES];
+    for (uint32_t i = 0; i < CAPACITY; i++) {
+        CHECK(push_value(i) == ESP_OK);
+    }
+    host_partition_fail_after(2048);
+    CHECK(push_value(CAPACITY) != ESP_OK);
+
+    CHECK(flash_ring_init() == ESP_OK);
+    for (uint32_t i = CAPACITY + 1; i < CAPACITY + 5; i++) {
+        CHECK(push_value(i) == ESP_OK);
+    }
+    size_t n = drain(values, MAX_VALUES, true);
+    CHECK(n > 0 && increasing(values, n) && values[n - 1] == CAPACITY + 4);
+    CHECK(n + flash_ring_stats()->dropped >= CAPACITY - RECORDS_PER_SECTOR + 4);
+}
+
+int main(void)
+{
+    test_blank_and_garbage();
+    test_consume_after_restart();
+    test_sector_erase_loss();
+    test_torn_record_on_init();
+    test_torn_erase();
+
+    if (failures > 0) {
+        printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("flash_ring: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,306 @@
+// Test tras tematów panelu i pomiar rozdziału poleceń oraz ramek: tablice kontra
+// łańcuchy if/strcmp, którymi brama C6 rozdzielała je wcześniej, oraz koszt wyszukania
+// nazwy w zależności od liczby tras - podstawa progu UI_ROUTE_LINEAR_MAX.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "sh_proto.h"
+#include "ui_route.h"
+
+static int failures;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+// Wcześniejszy rozdział nazw z tematu panelu
+static bool field_equals(const char *field, int field_len, const char *expected)
+{
+    return field_len == (int)strlen(expected) && strncmp(field, expected, field_len) == 0;
+}
+
+static int chain_actuator(const char *name, int name_len)
+{
+    if (field_equals(name, name_len, "swiatlo")) {
+        return SH_ACT_LIGHT;
+    } else if (field_equals(name, name_len, "wiatrak")) {
+        return SH_ACT_FAN;
+    }
+    return -1;
+}
+
+static int table_actuator(const char *name, int name_len)
+{
+    const ui_route_t *route = ui_route_find(name, name_len);
+    return route != NULL ? route->actuator : -1;
+}
+
+static const char *const topics[] = {
+    "gr1_ui/swiatlo", "gr1_ui/wiatrak", "gr12_ui/swiatlo", "gr254_ui/wiatrak",
+    "gr3_ui/swiatl", "gr3_ui/swiatlo2", "gr3_ui/wiatraki", "gr3_ui/", "gr3_ui/zamek",
+};
+
+static int route_order(const void *a, const void *b)
+{
+    const ui_route_t *ra = a;
+    const ui_route_t *rb = b;
+    if (ra->name_len != rb->name_len) {
+        return ra->name_len - rb->name_len;
+    }
+    return memcmp(ra->name, rb->name, ra->name_len);
+}
+
+// Wygenerowana tablica tras o nazwach różnej długości, posortowana jak ui_routes
+#define GEN_ROUTES_MAX 128
+static char gen_names[GEN_ROUTES_MAX][16];
+static ui_route_t gen_routes[GEN_ROUTES_MAX];
+
+static void generate_routes(size_t count)
+{
+    static const char *const stems[] = { "swiatlo", "wiatrak", "roleta", "brama", "pompa", "grzalka", "zawor", "dzwonek" };
+    for (size_t i = 0; i < count; i++) {
+        const char *stem = stems[i % 8];
+        int len = snprintf(gen_names[i], sizeof(gen_names[i]), "%.*s%u", (int)(i * 3 % strlen(stem)) + 1, stem,
+                           (unsigned)i);
+        gen_routes[i] = (ui_route_t){ gen_names[i], (uint8_t)len, (uint8_t)(i % SH_ACT_COUNT) };
+    }
+    qsort(gen_routes, count, sizeof(gen_routes[0]), route_order);
+}
+
+static void test_routes(void)
+{
+    // Tablica bramy jest posortowana, jak wymaga wyszukiwanie binarne
+    for (size_t i = 1; i < ui_route_count; i++) {
+        CHECK(route_order(&ui_routes[i - 1], &ui_routes[i]) < 0);
+    }
+    // Każda trasa znajduje samą siebie, długości w tablicy są zgodne z nazwami
+    for (size_t i = 0; i < ui_route_count; i++) {
+        CHECK(ui_routes[i].name_len == strlen(ui_routes[i].name));
+        CHECK(ui_route_find(ui_routes[i].name, strlen(ui_routes[i].name)) == &ui_routes[i]);
+    }
+    // Ta sama odpowiedź co łańcuch, także dla przedrostków, dłuższych nazw i nieznanych
+    for (size_t i = 0; i < sizeof(topics) / sizeof(topics[0]); i++) {
+        uint8_t group;
+        const char *name;
+        int name_len;
+        CHECK(ui_route_parse_topic(topics[i], strlen(topics[i]), &group, &name, &name_len));
+        CHECK(table_actuator(name, name_len) == chain_actuator(name, name_len));
+    }
+    CHECK(table_actuator("swiatlo", 7) == SH_ACT_LIGHT);
+    CHECK(table_actuator("wiatrak", 7) == SH_ACT_FAN);
+    CHECK(table_actuator("swiatlox", 7) == SH_ACT_LIGHT); // długość z tematu, bez '\0'
+}
+
+// Oba sposoby wyszukania dają tę samą odpowiedź dla tablic każdej wielkości
+static void test_generated_routes(void)
+{
+    static const size_t sizes[] = { 1, 2, 3, 8, 9, 31, 32, 128 };
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        size_t count = sizes[s];
+        generate_routes(count);
+        for (size_t i = 0; i < count; i++) {
+            const ui_route_t *route = &gen_routes[i];
+            CHECK(ui_route_find_sorted(gen_routes, count, route->name, route->name_len) == route);
+            CHECK(ui_route_find_linear(gen_routes, count, route->name, route->name_len) == route);
+            CHECK(ui_route_find_in(gen_routes, count, route->name, route->name_len) == route);
+            // Przedrostek i nazwa dłuższa o znak nie są trasą, chyba że tablica ma taką nazwę
+            char longer[20];
+            int len = snprintf(longer, sizeof(longer), "%sx", route->name);
+            CHECK(ui_route_find_sorted(gen_routes, count, longer, len) ==
+                  ui_route_find_linear(gen_routes, count, longer, len));
+            CHECK(ui_route_find_sorted(gen_routes, count, route->name, route->name_len - 1) ==
+                  ui_route_find_linear(gen_routes, count, route->name, route->name_len - 1));
+        }
+        CHECK(ui_route_find_sorted(gen_routes, count, "zamek", 5) == NULL);
+    }
+}
+
+static void test_parse_topic(void)
+{
+    uint8_t group;
+    const char *name;
+    int name_len;
+    CHECK(ui_route_parse_topic("gr7_ui/wiatrak", 14, &group, &name, &name_len));
+    CHECK(group == 7 && name_len == 7 && strncmp(name, "wiatrak", 7) == 0);
+    CHECK(!ui_route_parse_topic("gr_ui/wiatrak", 13, &group, &name, &name_len));
+    CHECK(!ui_route_parse_topic("gr7/wiatrak", 11, &group, &name, &name_len));
+    CHECK(!ui_route_parse_topic("gr255_ui/wiatrak", 16, &group, &name, &name_len)); // SH_GROUP_ALL
+    CHECK(!ui_route_parse_topic("g", 1, &group, &name, &name_len));
+    CHECK(!ui_route_parse_topic("gr7_u", 5, &group, &name, &name_len));
+}
+
+// Publikacja ramki według typu, jak publish_frame() w bramie - tu tylko liczniki
+static unsigned published[SH_MSG_REPORT + 1];
+
+__attribute__((noinline)) static bool count_telemetry(const sh_frame_t *frame) { published[frame->type]++; return true; }
+__attribute__((noinline)) static bool count_state(const sh_frame_t *frame) { published[frame->type]++; return true; }
+__attribute__((noinline)) static bool count_stats(const sh_frame_t *frame) { published[frame->type]++; return true; }
+__attribute__((noinline)) static bool count_report(const sh_frame_t *frame) { published[frame->type]++; return true; }
+
+typedef bool (*frame_publisher_t)(const sh_frame_t *frame);
+
+static const frame_publisher_t frame_publishers[] = {
+    [SH_MSG_TELEMETRY]       = count_telemetry,
+    [SH_MSG_STATE]           = count_state,
+    [SH_MSG_TELEMETRY_STATS] = count_stats,
+    [SH_MSG_REPORT]          = count_report,
+};
+
+__attribute__((noinline)) static bool table_publish(const sh_frame_t *frame)
+{
+    if (frame->type >= sizeof(frame_publishers) / sizeof(frame_publishers[0]) || frame_publishers[frame->type] == NULL) {
+        return true;
+    }
+    return frame_publishers[frame->type](frame);
+}
+
+__attribute__((noinline)) static bool chain_publish(const sh_frame_t *frame)
+{
+    if (frame->type == SH_MSG_TELEMETRY) {
+        return count_telemetry(frame);
+    } else if (frame->type == SH_MSG_TELEMETRY_STATS) {
+        return count_stats(frame);
+    } else if (frame->type == SH_MSG_STATE) {
+        return count_state(frame);
+    } else if (frame->type == SH_MSG_REPORT) {
+        return count_report(frame);
+    }
+    return true;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Czas rozdziału jednego tematu i jednej ramki. Wynik tylko raportowany - zależy od
+// komputera, na którym działa test.
+static void bench_dispatch(void)
+{
+    enum { ROUNDS = 2000000 };
+    enum { TOPICS = sizeof(topics) / sizeof(topics[0]) };
+    const char *names[TOPICS];
+    int name_lens[TOPICS];
+    for (int i = 0; i < TOPICS; i++) {
+        uint8_t group;
+        ui_route_parse_topic(topics[i], strlen(topics[i]), &group, &names[i], &name_lens[i]);
+    }
+    int hits = 0;
+    for (int i = 0; i < TOPICS; i++) {
+        hits += chain_actuator(names[i], name_lens[i]) >= 0;
+    }
+    volatile int sink = 0;
+
+    double start = now_ns();
+    for (int i = 0; i < ROUNDS; i++) {
+        sink += chain_actuator(names[i % TOPICS], name_lens[i % TOPICS]);
+    }
+    double chain_ns = (now_ns() - start) / ROUNDS;
+    start = now_ns();
+    for (int i = 0; i < ROUNDS; i++) {
+        sink += table_actuator(names[i % TOPICS], name_lens[i % TOPICS]);
+    }
+    double table_ns = (now_ns() - start) / ROUNDS;
+    printf("topic name (%zu routes, %d of %d names known): if/strcmp chain %.1f ns, table %.1f ns\n",
+           ui_route_count, hits, TOPICS, chain_ns, table_ns);
+
+    // Typy w proporcji ruchu: głównie pomiary, rzadziej stany i raporty
+    static const uint8_t types[] = {
+        SH_MSG_TELEMETRY, SH_MSG_TELEMETRY, SH_MSG_TELEMETRY_STATS, SH_MSG_TELEMETRY,
+        SH_MSG_STATE, SH_MSG_TELEMETRY, SH_MSG_REPORT, SH_MSG_TRACE,
+    };
+    sh_frame_t frames[sizeof(types)];
+    for (size_t i = 0; i < sizeof(types); i++) {
+        frames[i].type = types[i];
+    }
+    start = now_ns();
+    for (int i = 0; i < ROUNDS; i++) {
+        sink += chain_publish(&frames[i % sizeof(types)]);
+    }
+    chain_ns = (now_ns() - start) / ROUNDS;
+    start = now_ns();
+    for (int i = 0; i < ROUNDS; i++) {
+        sink += table_publish(&frames[i % sizeof(types)]);
+    }
+    table_ns = (now_ns() - start) / ROUNDS;
+    (void)sink;
+    CHECK(published[SH_MSG_TELEMETRY] == ROUNDS); // połowa ramek w każdym z dwóch przebiegów
+    printf("frame type (table of %zu entries): if chain %.1f ns, table %.1f ns\n",
+           sizeof(frame_publishers) / sizeof(frame_publishers[0]), chain_ns, table_ns);
+}
+
+typedef const ui_route_t *(*route_finder_t)(const ui_route_t *routes, size_t count, const char *name, int name_len);
+
+// Rozbiór tematu i wyszukanie nazwy dla tematów z losowymi grupami, 3/4 znanych nazw
+static double time_topics(route_finder_t find, size_t count, char topics_buf[][32], int topic_count, int rounds)
+{
+    volatile int sink = 0;
+    double start = now_ns();
+    for (int i = 0; i < rounds; i++) {
+        const char *topic = topics_buf[i % topic_count];
+        uint8_t group;
+        const char *name;
+        int name_len;
+        if (ui_route_parse_topic(topic, strlen(topic), &group, &name, &name_len)) {
+            const ui_route_t *route = find(gen_routes, count, name, name_len);
+            sink += route != NULL ? route->actuator + group : 0;
+        }
+    }
+    (void)sink;
+    return (now_ns() - start) / rounds;
+}
+
+// Koszt wyszukania względem liczby tras. Wynik tylko raportowany - próg przejścia
+// UI_ROUTE_LINEAR_MAX ustalono z tego pomiaru.
+static void bench_route_sweep(void)
+{
+    enum { ROUNDS = 1000000, TOPICS = 256 };
+    static const size_t sizes[] = { 2, 4, 8, 16, 32, 64, 128 };
+    static char topics_buf[TOPICS][32];
+    size_t crossover = 0;
+    printf("routes  linear ns  binary ns  chosen\n");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        size_t count = sizes[s];
+        generate_routes(count);
+        srand(1);
+        for (int i = 0; i < TOPICS; i++) {
+            const ui_route_t *route = &gen_routes[rand() % count];
+            snprintf(topics_buf[i], sizeof(topics_buf[i]), "gr%d_ui/%s%s", rand() % SH_GROUP_ALL, route->name,
+                     i % 4 == 3 ? "x" : "");
+        }
+        double linear_ns = time_topics(ui_route_find_linear, count, topics_buf, TOPICS, ROUNDS);
+        double sorted_ns = time_topics(ui_route_find_sorted, count, topics_buf, TOPICS, ROUNDS);
+        // Różnice poniżej 10% mieszczą się w rozrzucie pomiaru
+        if (crossover == 0 && sorted_ns < linear_ns * 0.9) {
+            crossover = count;
+        }
+        printf("%6zu  %9.1f  %9.1f  %s\n", count, linear_ns, sorted_ns,
+               count <= UI_ROUTE_LINEAR_MAX ? "linear" : "binary");
+    }
+    printf("binary search over 10%% faster from %zu routes on this machine, UI_ROUTE_LINEAR_MAX %d\n", crossover,
+           UI_ROUTE_LINEAR_MAX);
+}
+
+int main(void)
+{
+    test_routes();
+    test_generated_routes();
+    test_parse_topic();
+    bench_dispatch();
+    bench_route_sweep();
+
+    if (failures > 0) {
+        printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("ui_route: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,122 @@
+#include "device_registry.h"
+
+#include <string.h>
+
+static device_entry_t entries[DEVICE_REGISTRY_CAPACITY];
+static size_t entry_count;
+static uint32_t evicted;
+
+// FNV-1a - identyfikatory losowe lub z EUI-64, wystarczy proste mieszanie
+static uint32_t iid_hash(const uint8_t iid[DEVICE_IID_LEN])
+{
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < DEVICE_IID_LEN; i++) {
+        hash ^= iid[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Usuwa wpis z przesunięciem wstecz: kolejne wpisy łańcucha sondowania, które mogą
+// zająć zwolnione miejsce, przesuwają się bliżej swojego miejsca domowego. Łańcuchy
+// zostają ciągłe bez znaczników usunięcia, więc sondowanie nadal kończy się na
+// pierwszym wolnym miejscu.
+static void remove_at(size_t hole)
+{
+    size_t next = (hole + 1) & (DEVICE_REGISTRY_CAPACITY - 1);
+    while (entries[next].used) {
+        size_t home = iid_hash(entries[next].iid) & (DEVICE_REGISTRY_CAPACITY - 1);
+        // Wpis może się przesunąć, gdy zwolnione miejsce leży między jego miejscem domowym a nim
+        if (((next - home) & (DEVICE_REGISTRY_CAPACITY - 1)) >= ((next - hole) & (DEVICE_REGISTRY_CAPACITY - 1))) {
+            entries[hole] = entries[next];
+            hole = next;
+        }
+        next = (next + 1) & (DEVICE_REGISTRY_CAPACITY - 1);
+    }
+    entries[hole].used = false;
+    entry_count--;
+}
+
+// Usuwa najdawniej widziany węzeł. Przegląda całą tablicę, ale tylko przy dodawaniu
+// węzła do pełnego rejestru.
+static void evict_oldest(uint32_t now_ms)
+{
+    size_t oldest = DEVICE_REGISTRY_CAPACITY;
+    uint32_t oldest_age = 0;
+    for (size_t i = 0; i < DEVICE_REGISTRY_CAPACITY; i++) {
+        uint32_t age = now_ms - entries[i].last_seen_ms;
+        if (entries[i].used && (oldest == DEVICE_REGISTRY_CAPACITY || age > oldest_age)) {
+            oldest = i;
+            oldest_age = age;
+        }
+    }
+    remove_at(oldest);
+    evicted++;
+}
+
+device_entry_t *device_registry_lookup(const uint8_t iid[DEVICE_IID_LEN], uint8_t group, uint8_t device,
+                                       uint32_t now_ms)
+{
+    size_t index = iid_hash(iid) & (DEVICE_REGISTRY_CAPACITY - 1);
+    // Łańcuchy sondowania są ciągłe (remove_at), więc sondowanie kończy się na pierwszym wolnym miejscu
+    while (entries[index].used) {
+        device_entry_t *entry = &entries[index];
+        if (memcmp(entry->iid, iid, DEVICE_IID_LEN) == 0) {
+            if (entry->group != group || entry->device != device) {
+                entry->group = group;
+                entry->device = device;
+                memset(&entry->window, 0, sizeof(entry->window));
+                entry->actuators_known = 0;
+            }
+            entry->last_seen_ms = now_ms;
+            return entry;
+        }
+        index = (index + 1) & (DEVICE_REGISTRY_CAPACITY - 1);
+    }
+
+    if (entry_count >= DEVICE_REGISTRY_MAX_DEVICES) {
+        // Adres przestał być używany (np. nowy RLOC po zmianie rodzica) albo węzeł zniknął
+        evict_oldest(now_ms);
+        index = iid_hash(iid) & (DEVICE_REGISTRY_CAPACITY - 1);
+        while (entries[index].used) {
+            index = (index + 1) & (DEVICE_REGISTRY_CAPACITY - 1);
+        }
+    }
+    device_entry_t *entry = &entries[index];
+    memset(entry, 0, sizeof(*entry));
+    entry->used = true;
+    memcpy(entry->iid, iid, DEVICE_IID_LEN);
+    entry->group = group;
+    entry->device = device;
+    entry->last_seen_ms = now_ms;
+    entry_count++;
+    return entry;
+}
+
+bool device_registry_update_actuators(device_entry_t *entry, uint8_t actuators, uint8_t values)
+{
+    values &= actuators;
+    bool changed = (entry->actuators_known & actuators) != actuators ||
+                   (entry->actuator_values & actuators) != values;
+    entry->actuators_known |= actuators;
+    entry->actuator_values = (entry->actuator_values & ~actuators) | values;
+    return changed;
+}
+
+size_t device_registry_count(void)
+{
+    return entry_count;
+}
+
+uint32_t device_registry_evicted(void)
+{
+    return evicted;
+}
+
+const device_entry_t *device_registry_at(size_t index)
+{
+    if (index >= DEVICE_REGISTRY_CAPACITY || !entries[index].used) {
+        return NULL;
+    }
+    return &entries[index];
+}
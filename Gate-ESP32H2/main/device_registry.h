@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "seq_window.h"
+
+// Rejestr węzłów czujników widzianych przez bramę. Kluczem jest identyfikator
+// interfejsu (dolne 64 bity) adresu IPv6 nadawcy. Tablica mieszająca ma stały
+// rozmiar i adresowanie otwarte, więc czas wyszukania nie rośnie z liczbą węzłów.
+// Gdy rejestr jest pełny, nowy nadawca zastępuje węzeł najdawniej widziany - adres
+// węzła zmienia się np. po zmianie rodzica, a stare wpisy nie mogą zająć tablicy.
+//
+// Grupę i numer urządzenia podaje sam węzeł w ramce - węzeł przyjmuje tylko polecenia
+// swojej grupy, więc brama nie może ich zmienić. Ramki trafiają do C6 z grupą węzła,
+// a rejestr przypisuje do adresu stan nadawcy: okno numerów, RSSI i stany elementów.
+
+#define DEVICE_REGISTRY_CAPACITY 256 // potęga dwójki
+// Powyżej 3/4 zajętości sondowanie zaczyna się wydłużać - nowy węzeł wypiera najstarszy
+#define DEVICE_REGISTRY_MAX_DEVICES (DEVICE_REGISTRY_CAPACITY * 3 / 4)
+#define DEVICE_IID_LEN 8
+
+typedef struct {
+    bool used;
+    uint8_t iid[DEVICE_IID_LEN];
+    uint8_t group;          // grupa i urządzenie z ostatniej ramki nadawcy
+    uint8_t device;
+    int8_t rssi;            // siła sygnału ostatniej ramki (dBm)
+    uint32_t last_seen_ms;
+    seq_window_t window;
+    uint8_t actuators_known; // bit (1 << sh_actuator_t) - stan elementu przekazany do C6
+    uint8_t actuator_values; // bit (1 << sh_actuator_t) - element włączony
+} device_entry_t;
+
+// Zwraca wpis nadawcy, tworząc go przy pierwszej ramce, i zapisuje w nim chwilę now_ms.
+// Gdy węzeł zmienił grupę lub numer urządzenia, wpis jest przepisywany, a okno numerów
+// zaczyna się od nowa. Usunięcie wpisu może przesunąć inne, więc wskaźnik jest ważny
+// tylko do następnego wywołania.
+device_entry_t *device_registry_lookup(const uint8_t iid[DEVICE_IID_LEN], uint8_t group, uint8_t device,
+                                       uint32_t now_ms);
+
+// Zapamiętuje stany elementów wykonawczych z maski actuators. Zwraca true, gdy
+// któryś stan był nieznany lub się zmienił.
+bool device_registry_update_actuators(device_entry_t *entry, uint8_t actuators, uint8_t values);
+
+size_t device_registry_count(void);
+
+// Liczba węzłów usuniętych, aby zrobić miejsce nowym
+uint32_t device_registry_evicted(void);
+
+// Wpis w miejscu index tablicy (0..DEVICE_REGISTRY_CAPACITY-1) lub NULL dla wolnego miejsca
+const device_entry_t *device_registry_at(size_t index);
@@ -0,0 +1,50 @@
+#include "ingest_lane.h"
+
+#include <string.h>
+
+esp_err_t ingest_lane_init(ingest_lane_t *lane, sh_pool_t *pool, size_t depth, bool drop_oldest,
+                           ingest_lane_t *donor)
+{
+    memset(lane, 0, sizeof(*lane));
+    lane->queue = xQueueCreate(depth, sizeof(void *));
+    if (lane->queue == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    lane->pool = pool;
+    lane->drop_oldest = drop_oldest;
+    lane->donor = donor;
+    return ESP_OK;
+}
+
+bool ingest_lane_push(ingest_lane_t *lane, const void *msg)
+{
+    void *block = NULL;
+    if (lane->drop_oldest && uxQueueSpacesAvailable(lane->queue) == 0 &&
+        xQueueReceive(lane->queue, &block, 0) == pdPASS) {
+        lane->dropped++; // najstarsza ramka ustępuje miejsca, jej blok zostaje użyty ponownie
+    }
+    if (block == NULL) {
+        block = sh_pool_alloc(lane->pool, 0);
+    }
+    // Przy pustej puli ramka zabiera blok najstarszej ramce pasa dawcy
+    if (block == NULL && lane->donor != NULL && xQueueReceive(lane->donor->queue, &block, 0) == pdPASS) {
+        lane->donor->dropped++;
+    }
+    if (block == NULL) {
+        lane->dropped++;
+        return false;
+    }
+
+    memcpy(block, msg, lane->pool->block_size);
+    if (xQueueSend(lane->queue, &block, 0) != pdPASS) {
+        sh_pool_free(lane->pool, block);
+        lane->dropped++;
+        return false;
+    }
+    lane->queued++;
+    UBaseType_t depth = uxQueueMessagesWaiting(lane->queue);
+    if (depth > lane->high_watermark) {
+        lane->high_watermark = depth;
+    }
+    return true;
+}
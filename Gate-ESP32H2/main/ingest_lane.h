@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "esp_err.h"
+#include "sh_pool.h"
+
+// Pas kolejki od Thread do UART. Ramki dodaje pętla OpenThread, więc dodawanie nigdy
+// nie czeka na miejsce - nadmiarowe ramki są odrzucane i liczone. Kolejka przenosi
+// wskaźniki do bloków puli, blok zwalnia zadanie, które odebrało ramkę z pasa.
+// Liczniki zmienia tylko dodający, więc pas może mieć jednego producenta.
+typedef struct ingest_lane {
+    QueueHandle_t queue;
+    sh_pool_t *pool;
+    bool drop_oldest;          // pełny pas odrzuca najstarszą ramkę zamiast nowej
+    struct ingest_lane *donor; // przy pustej puli blok zabierany jest najstarszej ramce tego pasa
+    uint32_t queued;
+    uint32_t dropped;
+    uint32_t high_watermark;   // największa liczba ramek oczekujących w pasie
+} ingest_lane_t;
+
+esp_err_t ingest_lane_init(ingest_lane_t *lane, sh_pool_t *pool, size_t depth, bool drop_oldest,
+                           ingest_lane_t *donor);
+
+// Kopiuje wiadomość (pool->block_size bajtów) do bloku puli i dodaje ją do pasa bez
+// czekania. Zwraca false, gdy wiadomość została odrzucona.
+bool ingest_lane_push(ingest_lane_t *lane, const void *msg);
@@ -11,52 +11,112 @@
 #include "esp_netif.h"
 #include "nvs_flash.h"
 #include "openthread/thread.h"
+#include "openthread/server.h"
+#include "openthread/coap.h"
+#include "esp_openthread_lock.h"
 #include "openthread/link.h"
 #include "openthread/platform/radio.h"
 #include "esp_vfs_eventfd.h"
 #include "openthread/logging.h"
+#include "openthread/cli.h"
+#include "esp_openthread_cli.h"
 #include "esp_event.h"
 #include "esp_task.h"
 #include "esp_tls.h"
 #include "freertos/queue.h"
+#include "freertos/timers.h"
+#include "freertos/semphr.h"
 #include "driver/uart.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_system.h"
+#include "sh_proto.h"
+#include "seq_window.h"
+#include "device_registry.h"
+#include "sh_link.h"
+#include "sh_latency.h"
+#include "sh_pool.h"
+#include "ingest_lane.h"
 
 #define TAG "ESP32-H2-GATE"
 #define THREAD_UDP_PORT 12345 // Port, na którym nasłuchujemy danych
 #define UART_QUEUE_SIZE 10
+#define UART_HIGH_QUEUE_SIZE 6 // Pas stanów elementów wykonawczych w kierunku UART
+// Każda kolejka może się zapełnić, a każdy kierunek trzymać jeden blok w obróbce
+#define MSG_POOL_SIZE (UART_HIGH_QUEUE_SIZE + 2 * (UART_QUEUE_SIZE + 1))
 #define UART_BUFFER_SIZE 512
 
 
 #define TX_PIN 10           // Pin TX
 #define RX_PIN 11           // Pin RX
 #define QUEUE_SIZE 20       // Rozmiar kolejki zdarzeń
+#define UART_RX_TIMEOUT_SYMBOLS 3 // Cisza na linii (w czasach znaku), po której sterownik zgłasza odebrane dane
 
 
 
-static QueueHandle_t uart_write_queue;
 static QueueHandle_t uart_read_queue;
+static QueueHandle_t uart_event_queue;
 static otUdpSocket sUdpSocket;
 
+// Łącze UART z bramą C6 (ramki SLIP z CRC)
+static sh_link_encoder_t uart_link_tx;
+static sh_link_decoder_t uart_link_rx;
+#if CONFIG_GATE_UART_ACK
+// Ramki czekające na ACK bramy C6. Wysyła je i powtarza uart_write_task, ACK przychodzą w uart_read_task.
+static sh_link_arq_t uart_link_window;
+static SemaphoreHandle_t uart_link_lock;
+#endif
+
+// Blok puli wiadomości - ramka z chwilą jej odebrania. Kolejki przekazywania
+// przenoszą wskaźniki do bloków, blok zwalnia zadanie, które wysłało ramkę dalej.
 typedef struct {
-    float temperature;
-    float humidity;
-    bool fan_state;
-    bool light_state;
+    int64_t received_us;
+    uint8_t frame[SH_FRAME_MAX_LEN];
+} gate_msg_t;
 
-} sensor_data;
+static gate_msg_t msg_blocks[MSG_POOL_SIZE];
+static sh_pool_t msg_pool;
 
-typedef struct {
-    char topic[UART_BUFFER_SIZE];
-    char data[UART_BUFFER_SIZE];
-} mqtt_data_t;
+// Pasy od Thread do UART. Callback odbioru działa w pętli OpenThread, więc nigdy nie czeka na miejsce.
+static ingest_lane_t lane_high; // zmiany stanów, mają pierwszeństwo i zabierają bloki pomiarom
+static ingest_lane_t lane_low;  // pomiary, pełny pas odrzuca najstarszy
+static TaskHandle_t uart_write_task_handle;
+
+// Opóźnienia w bramie: Thread -> UART i UART -> Thread
+static sh_latency_t uplink_latency;
+static sh_latency_t downlink_latency;
+
+// Polecenia ze śladem wysłane do węzłów, czekające na echo SH_MSG_TRACE
+static sh_trace_table_t command_traces;
 
-static sensor_data current_sensor_data = {0};
+// Przekazuje kopię wiadomości do kolejki w bloku z puli
+static void queue_msg(QueueHandle_t queue, const gate_msg_t *msg) {
+    gate_msg_t *block = sh_pool_alloc(&msg_pool, portMAX_DELAY);
+    if (block == NULL) {
+        return;
+    }
+    *block = *msg;
+    if (xQueueSend(queue, &block, portMAX_DELAY) != pdPASS) {
+        ESP_LOGW("Queue", "Failed to queue message");
+        sh_pool_free(&msg_pool, block);
+    }
+}
 
-// Funkcja do wysyłania danych UDP
-void udp_send_data(const char *message) {
+// Przekazuje ramkę do pasa bez czekania. Zwraca false, gdy ramka została odrzucona.
+static bool ingest_msg(ingest_lane_t *lane, const gate_msg_t *msg) {
+    if (!ingest_lane_push(lane, msg)) {
+        return false;
+    }
+    if (uart_write_task_handle != NULL) {
+        xTaskNotifyGive(uart_write_task_handle);
+    }
+    return true;
+}
+
+// Wysyła dane UDP na podany adres. Wymaga blokady stosu OpenThread.
+static void udp_send_to(const otIp6Address *destinationAddr, uint16_t port, const uint8_t *data, size_t len) {
     otError error;
     otMessageInfo messageInfo;
-    otIp6Address  destinationAddr;
     otInstance *sInstance = esp_openthread_get_instance();
     if (!sInstance) {
         ESP_LOGE(TAG, "OpenThread instance not initialized.");
@@ -71,9 +131,8 @@ void udp_send_data(const char *message) {
     }
 
     memset(&messageInfo, 0, sizeof(messageInfo));
-    otIp6AddressFromString("ff03::1", &destinationAddr);
-    messageInfo.mPeerAddr = destinationAddr;
-    messageInfo.mPeerPort = THREAD_UDP_PORT;
+    messageInfo.mPeerAddr = *destinationAddr;
+    messageInfo.mPeerPort = port;
 
     otMessage *msg = otUdpNewMessage(sInstance, NULL);
     if (msg == NULL) {
@@ -82,7 +141,7 @@ void udp_send_data(const char *message) {
     }
 
     // Tworzenie wiadomości
-    error = otMessageAppend(msg, message, strlen(message));
+    error = otMessageAppend(msg, data, len);
     if (error != OT_ERROR_NONE) {
         ESP_LOGE(TAG, "Failed to append message, error: %d", error);
         otMessageFree(msg);
@@ -94,50 +153,236 @@ void udp_send_data(const char *message) {
     if (error != OT_ERROR_NONE) {
         ESP_LOGE(TAG, "Failed to send message, error: %d", error);
     } else {
-        // ESP_LOGI(TAG, "Message sent via Thread: %s", message);
+        // ESP_LOGI(TAG, "Frame sent via Thread: %d bytes", (int)len);
     }
 }
 
+// Funkcja do wysyłania danych UDP na adres multicast grupy (SH_GROUP_ALL - wszystkie grupy)
+void udp_send_data(uint8_t group, const uint8_t *data, size_t len) {
+    otIp6Address destinationAddr;
+    sh_group_multicast_addr(group, destinationAddr.mFields.m8);
+
+    esp_openthread_lock_acquire(portMAX_DELAY);
+    udp_send_to(&destinationAddr, THREAD_UDP_PORT, data, len);
+    esp_openthread_lock_release();
+}
+
+// Potwierdza ramkę bezpośrednio nadawcy. Wywoływane z callbacku odbioru,
+// który działa już z blokadą stosu OpenThread.
+static void send_ack(const sh_frame_t *frame, const otMessageInfo *aMessageInfo) {
+    sh_frame_t ack = {
+        .type = SH_MSG_ACK,
+        .group = frame->group,
+        .device = frame->device,
+        .seq = frame->seq,
+    };
+    ack.ack.seq = frame->seq;
+
+    uint8_t buf[SH_FRAME_MAX_LEN];
+    int len = sh_frame_encode(&ack, buf, sizeof(buf));
+    if (len > 0) {
+        udp_send_to(&aMessageInfo->mPeerAddr, aMessageInfo->mPeerPort, buf, len);
+    }
+}
+
+// Uzupełnia echo polecenia o czasy odcinka bramy H2 - od odebrania polecenia z UART
+// do odebrania echa z sieci Thread. Echo bez znanego śladu przechodzi bez zmian.
+static void complete_trace(gate_msg_t *msg) {
+    sh_frame_t frame;
+    sh_trace_t trace;
+    if (sh_frame_decode(msg->frame, sizeof(msg->frame), &frame) < 0 ||
+        !sh_trace_end(&command_traces, frame.trace.trace, &trace)) {
+        return;
+    }
+    frame.trace.h2_down_us = sh_elapsed_us(trace.received_us, trace.sent_us);
+    frame.trace.thread_rtt_us = sh_elapsed_us(trace.sent_us, msg->received_us);
+    sh_frame_encode(&frame, msg->frame, sizeof(msg->frame));
+}
+
 // Callback do odbioru danych
 static void udp_receive_callback(void *aContext, otMessage *aMessage, const otMessageInfo *aMessageInfo)
 {
-    char buffer[128]; // Bufor na odebrane dane
-    int length = otMessageRead(aMessage, otMessageGetOffset(aMessage), buffer, sizeof(buffer) - 1);
-    if (length > 0) {
-        buffer[length] = '\0'; // Dodaj zakończenie ciągu znaków
-        ESP_LOGI(TAG, "Received message from Thread: %s", buffer);
+    gate_msg_t msg = { .received_us = esp_timer_get_time() };
+    sh_frame_t frame;
+    int length = otMessageRead(aMessage, otMessageGetOffset(aMessage), msg.frame, SH_FRAME_MAX_LEN);
+    int frame_len = sh_frame_decode(msg.frame, length, &frame);
+    if (frame_len < 0) {
+        ESP_LOGW(TAG, "Failed to decode UDP message, error: %d", frame_len);
+        return;
+    }
+    ESP_LOGI(TAG, "Received frame from Thread: type %d, group %d, seq %d", frame.type, frame.group, frame.seq);
+    if (frame.type == SH_MSG_COMMAND || frame.type == SH_MSG_ACK) {
+        return; // własne polecenia odebrane z multicastu
+    }
 
-        char uart_message[UART_BUFFER_SIZE];
+    // Zmiana stanu jest potwierdzana zawsze, także gdy to powtórzenie po utraconym ACK
+    bool is_state = frame.type == SH_MSG_STATE ||
+                    (frame.type == SH_MSG_REPORT && (frame.report.fields & SH_REPORT_ACTUATORS));
+    // Nadawca rozpoznawany po adresie - identyfikator interfejsu to ostatnie 8 bajtów
+    device_entry_t *entry = device_registry_lookup(&aMessageInfo->mPeerAddr.mFields.m8[SH_IP6_ADDR_LEN - DEVICE_IID_LEN],
+                                                   frame.group, frame.device, (uint32_t)(msg.received_us / 1000));
+    entry->rssi = otMessageGetRss(aMessage);
+    seq_window_t *window = &entry->window;
+    if (seq_window_contains(window, frame.seq)) {
+        seq_window_update(window, frame.seq); // liczy duplikat już przekazany do C6
+        if (is_state) {
+            send_ack(&frame, aMessageInfo);
+        }
+        return;
+    }
 
-        // Szukanie "temperature" i "humidity"
-        if (strstr(buffer, "temperature") && strstr(buffer, "humidity")) {
-            float temperature = 0, humidity = 0;
+    if (frame.type == SH_MSG_TRACE) {
+        complete_trace(&msg);
+    }
 
-            if (sscanf(buffer, "{temperature: %f, humidity: %f}", &temperature, &humidity) == 2) {
-                snprintf(uart_message, sizeof(uart_message), "{temperature: %.2f, humidity: %.2f}", temperature, humidity);
-                xQueueSend(uart_write_queue, uart_message, portMAX_DELAY);
-            }
+    // Do bramy C6 przekazywane są tylko pomiary, zmiany stanów i echa poleceń, bez ponownego
+    // formatowania. Odrzucona zmiana stanu nie jest potwierdzana ani zapamiętana, więc węzeł ją powtórzy.
+    if (frame.type == SH_MSG_TELEMETRY || frame.type == SH_MSG_TELEMETRY_STATS || frame.type == SH_MSG_STATE ||
+        frame.type == SH_MSG_REPORT || frame.type == SH_MSG_TRACE) {
+        if (!ingest_msg(is_state ? &lane_high : &lane_low, &msg) && is_state) {
+            return;
+        }
+    }
+    seq_window_update(window, frame.seq);
+    if (frame.type == SH_MSG_STATE) {
+        device_registry_update_actuators(entry, 1 << frame.state.actuator, frame.state.value << frame.state.actuator);
+    } else if (is_state) {
+        device_registry_update_actuators(entry, frame.report.actuators, frame.report.values);
+    }
+    if (is_state) {
+        send_ack(&frame, aMessageInfo);
+    }
+}
 
-        // Szukanie "fan_state"
-        } else if (strstr(buffer, "fan_state")) {
-            int fan_state = 0;
+/////////////////////////////////////////////////
+// CoAP - odświeżanie stanu węzłów
 
-            if (sscanf(buffer, "{fan_state: %d}", &fan_state) == 1) {
-                snprintf(uart_message, sizeof(uart_message), "{fan_state: %d}", fan_state);
-                xQueueSend(uart_write_queue, uart_message, portMAX_DELAY);
-            }
+// Powiadomienia przychodzące po zakończeniu wymiany multicast trafiają do
+// on_coap_response tylko z tą opcją. Opcję ustawia CMakeLists.txt projektu.
+#if !OPENTHREAD_CONFIG_COAP_OBSERVE_API_ENABLE
+#error "CoAP Observe requires OPENTHREAD_CONFIG_COAP_OBSERVE_API_ENABLE"
+#endif
+
+// Odpowiedzi i powiadomienia zasobów węzłów niosą ramki sh_proto. Trafiają do tych
+// samych pasów co ramki UDP, ale bez okna numerów - numer to licznik Observe zasobu.
+// Stan elementu przekazywany jest do C6 tylko wtedy, gdy różni się od znanego.
+static void on_coap_response(void *aContext, otMessage *aMessage, const otMessageInfo *aMessageInfo, otError aResult)
+{
+    if (aResult != OT_ERROR_NONE || aMessage == NULL) {
+        return; // koniec oczekiwania na odpowiedzi multicast
+    }
+    if (otCoapMessageGetCode(aMessage) != OT_COAP_CODE_CONTENT) {
+        return;
+    }
+    gate_msg_t msg = { .received_us = esp_timer_get_time() };
+    sh_frame_t frame;
+    int length = otMessageRead(aMessage, otMessageGetOffset(aMessage), msg.frame, SH_FRAME_MAX_LEN);
+    int frame_len = sh_frame_decode(msg.frame, length, &frame);
+    if (frame_len < 0 || (frame.type != SH_MSG_TELEMETRY && frame.type != SH_MSG_STATE)) {
+        ESP_LOGW(TAG, "Unexpected CoAP payload, error: %d", frame_len);
+        return;
+    }
 
-        // Szukanie "light_state"
-        } else if (strstr(buffer, "light_state")) {
-            int light_state = 0;
+    device_entry_t *entry = device_registry_lookup(&aMessageInfo->mPeerAddr.mFields.m8[SH_IP6_ADDR_LEN - DEVICE_IID_LEN],
+                                                   frame.group, frame.device, (uint32_t)(msg.received_us / 1000));
+    entry->rssi = otMessageGetRss(aMessage);
+    if (frame.type == SH_MSG_STATE &&
+        !device_registry_update_actuators(entry, 1 << frame.state.actuator, frame.state.value << frame.state.actuator)) {
+        return;
+    }
+    ingest_msg(frame.type == SH_MSG_STATE ? &lane_high : &lane_low, &msg);
+}
 
-            if (sscanf(buffer, "{light_state: %d}", &light_state) == 1) {
-                snprintf(uart_message, sizeof(uart_message), "{light_state: %d}", light_state);
-                xQueueSend(uart_write_queue, uart_message, portMAX_DELAY);
-            }
-        }
-    } else {
-        ESP_LOGW(TAG, "Failed to read UDP message.");
+// Wysyła GET na adres multicast wszystkich grup. Odpowiedzi przychodzą z każdego węzła.
+static void coap_get_all(otInstance *instance, const char *uri, bool observe)
+{
+    otMessage *message = otCoapNewMessage(instance, NULL);
+    if (message == NULL) {
+        ESP_LOGW(TAG, "No buffer for CoAP GET %s", uri);
+        return;
+    }
+    otCoapMessageInit(message, OT_COAP_TYPE_NON_CONFIRMABLE, OT_COAP_CODE_GET);
+    otCoapMessageGenerateToken(message, OT_COAP_DEFAULT_TOKEN_LENGTH);
+    otError error = OT_ERROR_NONE;
+    if (observe) {
+        error = otCoapMessageAppendObserveOption(message, 0); // rejestracja lub odnowienie obserwacji
+    }
+    if (error == OT_ERROR_NONE) {
+        error = otCoapMessageAppendUriPathOptions(message, uri);
+    }
+    if (error == OT_ERROR_NONE) {
+        otMessageInfo info;
+        memset(&info, 0, sizeof(info));
+        sh_group_multicast_addr(SH_GROUP_ALL, info.mPeerAddr.mFields.m8);
+        info.mPeerPort = OT_DEFAULT_COAP_PORT;
+        error = otCoapSendRequest(instance, message, &info, on_coap_response, NULL);
+    }
+    if (error != OT_ERROR_NONE) {
+        ESP_LOGW(TAG, "Failed to send CoAP GET %s, error: %d", uri, error);
+        otMessageFree(message);
+    }
+}
+
+// Jedna runda zapytań odświeża stan wszystkich węzłów i odnawia obserwacje.
+// OpenThread trzyma subskrypcje poprzedniej rundy bez końca, więc przed rundą klient
+// CoAP jest restartowany - zwalnia to ich bufory, a węzły przejmują nowy token.
+// Wymaga blokady stosu OpenThread.
+static void resync_nodes(otInstance *instance)
+{
+    otCoapStop(instance);
+    otError error = otCoapStart(instance, OT_DEFAULT_COAP_PORT);
+    if (error != OT_ERROR_NONE) {
+        ESP_LOGE(TAG, "Failed to restart CoAP, error: %d", error);
+        return;
+    }
+    coap_get_all(instance, SH_COAP_URI_FAN, true);
+    coap_get_all(instance, SH_COAP_URI_LIGHT, true);
+    coap_get_all(instance, SH_COAP_URI_TEMPERATURE, false);
+    ESP_LOGI(TAG, "CoAP resync sent to all groups");
+}
+
+// Obserwacje wygasają w węzłach po SH_COAP_OBSERVE_LEASE_S, odnawiane są co pół okresu.
+// Działa w zadaniu timerów FreeRTOS, dlatego jego stos jest powiększony do 3072 B (sdkconfig).
+static void resync_timer_cb(TimerHandle_t timer)
+{
+    esp_openthread_lock_acquire(portMAX_DELAY);
+    otInstance *instance = esp_openthread_get_instance();
+    otDeviceRole role = otThreadGetDeviceRole(instance);
+    if (role != OT_DEVICE_ROLE_DISABLED && role != OT_DEVICE_ROLE_DETACHED) {
+        resync_nodes(instance);
+    }
+    esp_openthread_lock_release();
+}
+
+// Po dołączeniu do sieci brama od razu pyta węzły o stan
+static void on_thread_state_changed(otChangedFlags flags, void *context)
+{
+    static bool attached = false;
+    if (!(flags & OT_CHANGED_THREAD_ROLE)) {
+        return;
+    }
+    otInstance *instance = esp_openthread_get_instance();
+    otDeviceRole role = otThreadGetDeviceRole(instance);
+    bool now_attached = role == OT_DEVICE_ROLE_CHILD || role == OT_DEVICE_ROLE_ROUTER || role == OT_DEVICE_ROLE_LEADER;
+    if (now_attached && !attached) {
+        resync_nodes(instance);
+    }
+    attached = now_attached;
+}
+
+// Uruchamia klienta CoAP. Wymaga blokady stosu OpenThread.
+static void init_coap_client(otInstance *instance)
+{
+    otError error = otCoapStart(instance, OT_DEFAULT_COAP_PORT);
+    if (error != OT_ERROR_NONE) {
+        ESP_LOGE(TAG, "Failed to start CoAP, error: %d", error);
+        return;
+    }
+    otSetStateChangedCallback(instance, on_thread_state_changed, NULL);
+    TimerHandle_t timer = xTimerCreate("coap_resync", pdMS_TO_TICKS(SH_COAP_OBSERVE_LEASE_S * 1000 / 2),
+                                       pdTRUE, NULL, resync_timer_cb);
+    if (timer == NULL || xTimerStart(timer, 0) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start CoAP resync timer");
     }
 }
 
@@ -166,11 +411,9 @@ static void udp_to_uart_task(void *arg)
 
     init_udp_receiver(instance);
 
-    ESP_LOGI(TAG, "UDP receiver task started.");
-    while (1) {
-        // Obsługa pętli UDP jest automatyczna w OpenThread, więc nic więcej nie musimy tutaj robić
-        vTaskDelay(pdMS_TO_TICKS(1000)); // Po prostu czekamy
-    }
+    // Odbiór UDP obsługuje pętla OpenThread przez callback, zadanie nie jest już potrzebne
+    ESP_LOGI(TAG, "UDP receiver started.");
+    vTaskDelete(NULL);
 }
 
 
@@ -183,6 +426,27 @@ static void configure_thread_network(otInstance *instance) {
     ESP_LOGI(TAG, "Thread network configured as End Device.");
 }
 
+// Dodaje usługę bramy do lokalnych Network Data. OpenThread ponawia rejestrację
+// u lidera po każdym ponownym dołączeniu do sieci.
+static void register_gateway_service(otInstance *instance) {
+    otServiceConfig service;
+    memset(&service, 0, sizeof(service));
+    service.mEnterpriseNumber = SH_GW_SERVICE_ENTERPRISE;
+    service.mServiceDataLength = SH_GW_SERVICE_DATA_LEN;
+    memcpy(service.mServiceData, SH_GW_SERVICE_DATA, SH_GW_SERVICE_DATA_LEN);
+    service.mServerConfig.mStable = true;
+
+    otError error = otServerAddService(instance, &service);
+    if (error == OT_ERROR_NONE) {
+        error = otServerRegister(instance);
+    }
+    if (error != OT_ERROR_NONE) {
+        ESP_LOGE(TAG, "Failed to register gateway service, error: %d", error);
+        return;
+    }
+    ESP_LOGI(TAG, "Gateway service registered in Network Data.");
+}
+
 // Funkcja inicjalizująca OpenThread i sieć
 static esp_netif_t *init_openthread_netif(const esp_openthread_platform_config_t *config) {
     esp_netif_config_t cfg = ESP_NETIF_DEFAULT_OPENTHREAD();
@@ -193,6 +457,39 @@ static esp_netif_t *init_openthread_netif(const esp_openthread_platform_config_t
     return netif;
 }
 
+// Wiersz CLI z licznikami jednego pasa
+static void print_lane_stats(const char *name, const ingest_lane_t *lane) {
+    otCliOutputFormat("%s: %lu queued, %lu dropped, %u waiting, high watermark %lu\r\n", name,
+                      (unsigned long)lane->queued, (unsigned long)lane->dropped,
+                      (unsigned)uxQueueMessagesWaiting(lane->queue), (unsigned long)lane->high_watermark);
+}
+
+// Polecenie CLI "gwstats" - liczniki pasów, puli i łącza UART w trakcie pracy
+static otError cli_gwstats(void *aContext, uint8_t aArgsLength, char *aArgs[]) {
+    print_lane_stats("state lane", &lane_high);
+    print_lane_stats("telemetry lane", &lane_low);
+    otCliOutputFormat("message pool: %u of %u free, minimum %u, %lu exhausted\r\n",
+                      (unsigned)sh_pool_available(&msg_pool), (unsigned)msg_pool.count,
+                      (unsigned)msg_pool.min_free, (unsigned long)msg_pool.exhausted);
+    otCliOutputFormat("device registry: %u nodes, %lu evicted\r\n", (unsigned)device_registry_count(),
+                      (unsigned long)device_registry_evicted());
+    const sh_link_stats_t *link = &uart_link_rx.stats;
+    otCliOutputFormat("uart link: %lu frames, %lu CRC errors, %lu lost, %lu overflows, %lu duplicates, %lu out of order\r\n",
+                      (unsigned long)link->frames, (unsigned long)link->crc_errors,
+                      (unsigned long)link->lost, (unsigned long)link->overflows,
+                      (unsigned long)link->duplicates, (unsigned long)link->out_of_order);
+#if CONFIG_GATE_UART_ACK
+    otCliOutputFormat("uart window: %u unacknowledged, %lu retransmits, %lu expired\r\n",
+                      (unsigned)uart_link_window.count, (unsigned long)uart_link_window.retransmits,
+                      (unsigned long)uart_link_window.expired);
+#endif
+    return OT_ERROR_NONE;
+}
+
+static const otCliCommand cli_commands[] = {
+    {"gwstats", cli_gwstats},
+};
+
 // Task do konfiguracji i uruchamiania OpenThread
 static void ot_task_worker(void *pvParameter)
 {
@@ -206,6 +503,11 @@ static void ot_task_worker(void *pvParameter)
     // Inicjalizacja stosu OpenThread
     ESP_ERROR_CHECK(esp_openthread_init(&config));
 
+#if CONFIG_OPENTHREAD_CLI
+    esp_openthread_cli_init();
+    otCliSetUserCommands(cli_commands, sizeof(cli_commands) / sizeof(cli_commands[0]), NULL);
+#endif
+
 #if CONFIG_OPENTHREAD_LOG_LEVEL_DYNAMIC
     (void)otLoggingSetLevel(CONFIG_LOG_DEFAULT_LEVEL);
 #endif
@@ -217,6 +519,16 @@ static void ot_task_worker(void *pvParameter)
     // Konfiguracja sieci jako urządzenie końcowe
     configure_thread_network(esp_openthread_get_instance());
 
+    // Ogłoszenie bramy w Network Data, węzły wysyłają ramki na jej adres anycast
+    register_gateway_service(esp_openthread_get_instance());
+
+    // Klient CoAP odświeżający stan węzłów i obserwujący ich elementy wykonawcze
+    init_coap_client(esp_openthread_get_instance());
+
+#if CONFIG_OPENTHREAD_CLI
+    esp_openthread_cli_create_task();
+#endif
+
     // Uruchom główną pętlę OpenThread
     esp_openthread_launch_mainloop();
 
@@ -257,6 +569,52 @@ static void print_device_status_task(void *arg)
             }
 
             ESP_LOGI(TAG, "Device role: %s", role_str);
+            const sh_link_stats_t *link = &uart_link_rx.stats;
+            ESP_LOGI(TAG, "UART link: %lu frames, %lu CRC errors, %lu lost, %lu overflows, %lu duplicates",
+                     (unsigned long)link->frames, (unsigned long)link->crc_errors,
+                     (unsigned long)link->lost, (unsigned long)link->overflows,
+                     (unsigned long)link->duplicates);
+#if CONFIG_GATE_UART_ACK
+            ESP_LOGI(TAG, "UART window: %lu retransmits, %lu expired",
+                     (unsigned long)uart_link_window.retransmits, (unsigned long)uart_link_window.expired);
+#endif
+            ESP_LOGI(TAG, "Latency Thread->UART: %lu frames, mean %lu us, max %lu us",
+                     (unsigned long)uplink_latency.count, (unsigned long)sh_latency_mean_us(&uplink_latency),
+                     (unsigned long)uplink_latency.max_us);
+            ESP_LOGI(TAG, "State lane: %lu queued, %lu dropped, high watermark %lu",
+                     (unsigned long)lane_high.queued, (unsigned long)lane_high.dropped,
+                     (unsigned long)lane_high.high_watermark);
+            ESP_LOGI(TAG, "Telemetry lane: %lu queued, %lu dropped, high watermark %lu",
+                     (unsigned long)lane_low.queued, (unsigned long)lane_low.dropped,
+                     (unsigned long)lane_low.high_watermark);
+            ESP_LOGI(TAG, "Message pool: %u of %u free, minimum %u, %lu exhausted",
+                     (unsigned)sh_pool_available(&msg_pool), (unsigned)msg_pool.count,
+                     (unsigned)msg_pool.min_free, (unsigned long)msg_pool.exhausted);
+            ESP_LOGI(TAG, "Latency UART->Thread: %lu frames, mean %lu us, max %lu us",
+                     (unsigned long)downlink_latency.count, (unsigned long)sh_latency_mean_us(&downlink_latency),
+                     (unsigned long)downlink_latency.max_us);
+            ESP_LOGI(TAG, "Device registry: %u nodes, %lu evicted", (unsigned)device_registry_count(),
+                     (unsigned long)device_registry_evicted());
+            uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+            for (size_t i = 0; i < DEVICE_REGISTRY_CAPACITY; i++) {
+                // Rejestr zmienia się w zadaniu OpenThread, a usunięcie wpisu przesuwa inne -
+                // wpis kopiowany pod blokadą stosu
+                device_entry_t copy;
+                esp_openthread_lock_acquire(portMAX_DELAY);
+                const device_entry_t *entry = device_registry_at(i);
+                if (entry != NULL) {
+                    copy = *entry;
+                }
+                esp_openthread_lock_release();
+                if (entry != NULL) {
+                    entry = &copy;
+                    const seq_window_t *window = &entry->window;
+                    ESP_LOGI(TAG, "Node %d/%d: RSSI %d dBm, seen %lu s ago, %lu received, %lu lost, %lu duplicates, %lu restarts",
+                             entry->group, entry->device, entry->rssi, (unsigned long)((now_ms - entry->last_seen_ms) / 1000),
+                             (unsigned long)window->received, (unsigned long)window->lost,
+                             (unsigned long)window->duplicates, (unsigned long)window->restarts);
+                }
+            }
         }
         else
         {
@@ -267,72 +625,172 @@ static void print_device_status_task(void *arg)
 }
 
 
+#if CONFIG_GATE_UART_ACK
+static void uart_write_frame(const uint8_t *data, size_t len, void *ctx) {
+    uart_write_bytes(UART_NUM_1, data, len);
+}
+#endif
+
 void uart_write_task(void *pvParameters) {
-    char uart_buffer[UART_BUFFER_SIZE];
+    gate_msg_t *msg;
+    uint8_t encoded[SH_LINK_MAX_ENCODED];
 
     while (1) {
-        if (xQueueReceive(uart_write_queue, uart_buffer, portMAX_DELAY)) {
-            uart_write_bytes(UART_NUM_1, uart_buffer, strlen(uart_buffer));
-            ESP_LOGI(TAG, "Messagee sent via UART: %s", uart_buffer);
+        TickType_t wait = portMAX_DELAY;
+#if CONFIG_GATE_UART_ACK
+        // Powtórzenia niepotwierdzonych ramek. Przy pełnym oknie nowe ramki czekają w pasach.
+        xSemaphoreTake(uart_link_lock, portMAX_DELAY);
+        uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+        sh_link_arq_poll(&uart_link_window, now_ms, uart_write_frame, NULL);
+        bool window_full = sh_link_arq_full(&uart_link_window);
+        uint32_t wait_ms = sh_link_arq_wait_ms(&uart_link_window, now_ms);
+        xSemaphoreGive(uart_link_lock);
+        if (wait_ms != UINT32_MAX) {
+            wait = pdMS_TO_TICKS(wait_ms) + 1;
         }
+        if (window_full) {
+            ulTaskNotifyTake(pdTRUE, wait); // budzi ACK albo nowa ramka w pasie
+            continue;
+        }
+#endif
+        // Pas stanów jest zawsze opróżniany przed pasem pomiarów
+        if (xQueueReceive(lane_high.queue, &msg, 0) != pdPASS && xQueueReceive(lane_low.queue, &msg, 0) != pdPASS) {
+            ulTaskNotifyTake(pdTRUE, wait);
+            continue;
+        }
+        if (msg->frame[1] == SH_MSG_TRACE) {
+            // Czas echa w bramie kończy się tutaj, tuż przed zapisem do UART
+            sh_frame_t frame;
+            if (sh_frame_decode(msg->frame, sizeof(msg->frame), &frame) >= 0) {
+                frame.trace.h2_up_us = sh_elapsed_us(msg->received_us, esp_timer_get_time());
+                sh_frame_encode(&frame, msg->frame, sizeof(msg->frame));
+            }
+        }
+        uint8_t link_seq = uart_link_tx.seq;
+        size_t len = sh_link_encode(&uart_link_tx, msg->frame, sh_frame_len(msg->frame[1]), encoded, sizeof(encoded));
+        int64_t received_us = msg->received_us;
+        sh_pool_free(&msg_pool, msg);
+#if CONFIG_GATE_UART_ACK
+        xSemaphoreTake(uart_link_lock, portMAX_DELAY);
+        sh_link_arq_push(&uart_link_window, link_seq, encoded, len, (uint32_t)(esp_timer_get_time() / 1000));
+        xSemaphoreGive(uart_link_lock);
+#else
+        (void)link_seq;
+#endif
+        uart_write_bytes(UART_NUM_1, encoded, len);
+        sh_latency_record(&uplink_latency, received_us, esp_timer_get_time());
+        ESP_LOGI(TAG, "Frame sent via UART: %d bytes, %lu us in gate", (int)len, (unsigned long)uplink_latency.last_us);
     }
 }
 
+// Ramka łącza z poprawnym CRC. Polecenia i reguły automatyki przekazywane są do węzłów grupy.
+static void on_uart_frame(const uint8_t *payload, size_t len, void *ctx) {
+    const int64_t *received_us = ctx; // Chwila odebrania danych
+    sh_frame_t frame;
+    int frame_len = sh_frame_decode(payload, len, &frame);
+    if (frame_len < 0) {
+        ESP_LOGW(TAG, "Failed to decode UART frame, error: %d", frame_len);
+        return;
+    }
+    if (frame.type == SH_MSG_COMMAND || frame.type == SH_MSG_RULE) {
+        ESP_LOGI(TAG, "Frame read via UART: type %d, group %d", frame.type, frame.group);
+        gate_msg_t msg = { .received_us = *received_us };
+        memcpy(msg.frame, payload, frame_len);
+        queue_msg(uart_read_queue, &msg);
+    }
+}
 
-void uart_read_task(void *pvParameters){
-    char data[UART_BUFFER_SIZE];
-    while (1) {
-        int len = uart_read_bytes(UART_NUM_1, data, UART_BUFFER_SIZE, pdMS_TO_TICKS(100)); // Czekamy na dane przez 100ms
-
-        if (len > 0) {
-            data[len] = '\0'; // Zakończymy łańcuch znaków
-            ESP_LOGI(TAG, "Messagee read via UART: %s", data);
-            // Szukanie "gr1/wiatrak:"
-        if (strstr(data, "gr1_ui/wiatrak:")) {
-            if (strstr(data, "gr1_ui/wiatrak: on")) {
-                if (xQueueSend(uart_read_queue, "fan_state: on", portMAX_DELAY) != pdPASS) {
-                ESP_LOGW("Queue", "Failed to send data to uart_to_mqtt_queue");
-            }
+#if CONFIG_GATE_UART_ACK
+// Potwierdzenie ramki od C6. uart_write_bytes() zapisuje całą ramkę pod blokadą sterownika,
+// więc ACK nie rozdziela ramki wysyłanej przez uart_write_task.
+static void uart_send_ack(uint8_t seq, void *ctx) {
+    uint8_t encoded[8];
+    size_t len = sh_link_encode_ack(seq, encoded, sizeof(encoded));
+    uart_write_bytes(UART_NUM_1, encoded, len);
+}
 
-            } else if (strstr(data, "gr1_ui/wiatrak: off")) {
-                if (xQueueSend(uart_read_queue, "fan_state: off", portMAX_DELAY) != pdPASS) {
-                ESP_LOGW("Queue", "Failed to send data to uart_to_mqtt_queue");
-            }
-            }
+static void uart_peer_ack(uint8_t seq, void *ctx) {
+    xSemaphoreTake(uart_link_lock, portMAX_DELAY);
+    sh_link_arq_ack(&uart_link_window, seq);
+    xSemaphoreGive(uart_link_lock);
+    xTaskNotifyGive(uart_write_task_handle);
+}
+#endif
 
-        // Szukanie "gr1/swiatlo:"
-        } else if (strstr(data, "gr1_ui/swiatlo:")) {
-            if (strstr(data, "gr1_ui/swiatlo: on")) {
-                if (xQueueSend(uart_read_queue, "light_state: on", portMAX_DELAY) != pdPASS) {
-                ESP_LOGW("Queue", "Failed to send data to uart_to_mqtt_queue");
-            }
-            } else if (strstr(data, "gr1_ui/swiatlo: off")) {
-                if (xQueueSend(uart_read_queue, "light_state: off", portMAX_DELAY) != pdPASS) {
-                ESP_LOGW("Queue", "Failed to send data to uart_to_mqtt_queue");
-            }
+// Zadanie budzone przez zdarzenia sterownika UART. Zdarzenie UART_DATA przychodzi
+// po przerwaniu RX timeout, czyli zaraz po końcu ramki, albo po zapełnieniu FIFO.
+void uart_read_task(void *pvParameters){
+    uint8_t data[UART_BUFFER_SIZE];
+    uart_event_t event;
+    int64_t received_us;
+    sh_link_decoder_init(&uart_link_rx);
+#if CONFIG_GATE_UART_ACK
+    sh_link_decoder_set_ack(&uart_link_rx, uart_send_ack, uart_peer_ack, NULL);
+#endif
+    while (1) {
+        if (xQueueReceive(uart_event_queue, &event, portMAX_DELAY) != pdPASS) {
+            continue;
+        }
+        switch (event.type) {
+        case UART_DATA: {
+            received_us = esp_timer_get_time();
+            size_t pending = event.size;
+            while (pending > 0) {
+                int len = uart_read_bytes(UART_NUM_1, data, pending < sizeof(data) ? pending : sizeof(data), 0);
+                if (len <= 0) {
+                    break;
+                }
+                // Ramki mogą być podzielone między zdarzenia - dekoder składa je ze strumienia
+                sh_link_feed(&uart_link_rx, data, len, on_uart_frame, &received_us);
+                pending -= len;
             }
+            break;
         }
+        case UART_FIFO_OVF:
+        case UART_BUFFER_FULL:
+            // Dane zostały utracone - dekoder odrzuci niepełną ramkę przy następnym znaczniku END
+            ESP_LOGW(TAG, "UART RX overflow, flushing input");
+            uart_flush_input(UART_NUM_1);
+            xQueueReset(uart_event_queue);
+            break;
+        default:
+            break;
         }
-
-        vTaskDelay(pdMS_TO_TICKS(100)); // Czekamy na dane
     }
 }
 
 void uart_to_udp_task(void *pvParameters) {
-    char formatted_message[UART_BUFFER_SIZE];  // Bufor na odebraną wiadomość
+    gate_msg_t *msg;  // Odebrana ramka
 
     while (1) {
         // Sprawdź, czy są dane w kolejce
-        if (xQueueReceive(uart_read_queue, formatted_message, portMAX_DELAY)) {
-            char udp_message[128];
-            snprintf(udp_message, sizeof(udp_message), formatted_message);
+        if (xQueueReceive(uart_read_queue, &msg, portMAX_DELAY)) {
             // Wyślij dane za pomocą UDP
-            udp_send_data(udp_message);
-            ESP_LOGI(TAG, "Message sent via Thread: %s", udp_message);
+            // Bajt 2 ramki to identyfikator grupy - polecenie odbierają tylko jej węzły
+            uint8_t group = msg->frame[2];
+            sh_frame_t frame;
+            if (sh_frame_decode(msg->frame, sizeof(msg->frame), &frame) >= 0 &&
+                frame.type == SH_MSG_COMMAND && frame.state.trace != 0) {
+                // Ślad zapisywany przed wysłaniem, aby echo nie wyprzedziło wpisu
+                sh_trace_begin(&command_traces, frame.state.trace, msg->received_us, esp_timer_get_time());
+            }
+            udp_send_data(group, msg->frame, sh_frame_len(msg->frame[1]));
+            sh_latency_record(&downlink_latency, msg->received_us, esp_timer_get_time());
+            sh_pool_free(&msg_pool, msg);
+            ESP_LOGI(TAG, "Command sent via Thread to group %d, %lu us in gate", group,
+                     (unsigned long)downlink_latency.last_us);
         }
     }
 }
 
+// Raport zajętości sterty przy starcie - pokazuje, ile pamięci zajmują bufory bramy
+static void report_heap(const char *stage) {
+    ESP_LOGI(TAG, "Heap %s: %lu bytes free, largest block %lu, minimum %lu", stage,
+             (unsigned long)esp_get_free_heap_size(),
+             (unsigned long)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT),
+             (unsigned long)esp_get_minimum_free_heap_size());
+}
+
 void app_main(void)
 {
     esp_vfs_eventfd_config_t eventfd_config = {
@@ -353,27 +811,46 @@ void app_main(void)
         .flow_ctrl = UART_HW_FLOWCTRL_DISABLE
     };
 
+    uint32_t heap_before = esp_get_free_heap_size();
+    report_heap("before gate buffers");
+
     uart_param_config(UART_NUM_1, &uart_config);
-    uart_driver_install(UART_NUM_1, UART_BUFFER_SIZE, UART_BUFFER_SIZE, QUEUE_SIZE, NULL, 0);
+    uart_driver_install(UART_NUM_1, UART_BUFFER_SIZE, UART_BUFFER_SIZE, QUEUE_SIZE, &uart_event_queue, 0);
     uart_set_pin(UART_NUM_1, TX_PIN, RX_PIN, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
+    uart_set_rx_timeout(UART_NUM_1, UART_RX_TIMEOUT_SYMBOLS);
 
     // Tworzenie kolejki UART
-    uart_write_queue = xQueueCreate(UART_QUEUE_SIZE, UART_BUFFER_SIZE);
-    if (uart_write_queue == NULL) {
+    if (ingest_lane_init(&lane_high, &msg_pool, UART_HIGH_QUEUE_SIZE, false, &lane_low) != ESP_OK ||
+        ingest_lane_init(&lane_low, &msg_pool, UART_QUEUE_SIZE, true, NULL) != ESP_OK) {
         ESP_LOGE(TAG, "Failed to create UART queue");
     }
-    uart_read_queue = xQueueCreate(UART_QUEUE_SIZE, UART_BUFFER_SIZE);
+    uart_read_queue = xQueueCreate(UART_QUEUE_SIZE, sizeof(gate_msg_t *));
     if (uart_read_queue == NULL) {
         ESP_LOGE(TAG, "Failed to create UART queue");
     }
+    ESP_ERROR_CHECK(sh_pool_init(&msg_pool, msg_blocks, sizeof(gate_msg_t), MSG_POOL_SIZE));
+    sh_trace_table_init(&command_traces);
+#if CONFIG_GATE_UART_ACK
+    sh_link_arq_init(&uart_link_window, CONFIG_GATE_UART_ACK_TIMEOUT_MS, CONFIG_GATE_UART_ACK_RETRIES);
+    uart_link_lock = xSemaphoreCreateMutex();
+    if (uart_link_lock == NULL) {
+        ESP_LOGE(TAG, "Failed to create UART link lock");
+    }
+#endif
+
+    report_heap("after gate buffers");
+    ESP_LOGI(TAG, "Gate buffers: %lu bytes of heap, %u bytes in static message pool",
+             (unsigned long)(heap_before - esp_get_free_heap_size()), (unsigned)sizeof(msg_blocks));
+
+    // Zadanie zapisu do UART musi istnieć, zanim callback odbioru zacznie je budzić
+    xTaskCreate(uart_write_task, "uart_write_task", 4096, NULL, 5, &uart_write_task_handle);
 
     // Tworzenie taska dla OpenThread
     xTaskCreate(ot_task_worker, "ot_task_worker", 4096, NULL, 5, NULL);
 
     // Tworzenie taska do odbierania danych
     xTaskCreate(udp_to_uart_task, "udp_to_uart_task", 4096, NULL, 5, NULL);
-    xTaskCreate(uart_write_task, "uart_write_task", 4096, NULL, 5, NULL);
-    xTaskCreate(uart_read_task, "uart_write_task", 4096, NULL, 5, NULL);
+    xTaskCreate(uart_read_task, "uart_read_task", 4096, NULL, 5, NULL);
     xTaskCreate(uart_to_udp_task, "uart_to_udp_task", 4096, NULL, 5, NULL);
 
     // Tworzenie taska do monitorowania stanu urządzenia
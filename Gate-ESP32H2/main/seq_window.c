@@ -0,0 +1,60 @@
+#include "seq_window.h"
+
+// Początek okna: wcześniejszych numerów nie znamy, więc traktujemy je jak odebrane
+static void seq_window_restart(seq_window_t *window, uint16_t seq)
+{
+    window->valid = true;
+    window->top = seq;
+    window->mask = UINT32_MAX;
+}
+
+bool seq_window_update(seq_window_t *window, uint16_t seq)
+{
+    if (!window->valid) {
+        seq_window_restart(window, seq);
+        window->received++;
+        return true;
+    }
+
+    int16_t delta = (int16_t)(seq - window->top);
+    if (delta >= SEQ_WINDOW_RESTART || delta <= -SEQ_WINDOW_RESTART) {
+        // Nadawca uruchomił się ponownie z nowym numerem początkowym
+        seq_window_restart(window, seq);
+        window->restarts++;
+    } else if (delta > 0) {
+        // Numery wypadające z okna, których nie odebrano, są zgubione
+        if (delta >= SEQ_WINDOW_SIZE) {
+            window->lost += (SEQ_WINDOW_SIZE - __builtin_popcount(window->mask)) + (delta - SEQ_WINDOW_SIZE);
+            window->mask = 1;
+        } else {
+            uint32_t dropped = window->mask >> (SEQ_WINDOW_SIZE - delta);
+            window->lost += delta - __builtin_popcount(dropped);
+            window->mask = (window->mask << delta) | 1;
+        }
+        window->top = seq;
+    } else if (-delta < SEQ_WINDOW_SIZE) {
+        uint32_t bit = 1UL << -delta;
+        if (window->mask & bit) {
+            window->duplicates++;
+            return false;
+        }
+        window->mask |= bit; // ramka spóźniona lub powtórzona po utracie
+    } else {
+        // Ramka starsza niż okno - nie da się rozpoznać duplikatu, zaczynamy od niej
+        seq_window_restart(window, seq);
+    }
+    window->received++;
+    return true;
+}
+
+bool seq_window_contains(const seq_window_t *window, uint16_t seq)
+{
+    if (!window->valid) {
+        return false;
+    }
+    int16_t delta = (int16_t)(seq - window->top);
+    if (delta > 0 || -delta >= SEQ_WINDOW_SIZE) {
+        return false;
+    }
+    return (window->mask & (1UL << -delta)) != 0;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Okno odbioru numerów sekwencyjnych jednego nadawcy. Pamięta, które z ostatnich
+// 32 numerów dotarły, więc rozpoznaje duplikaty i ramki spóźnione, a numer, który
+// opuścił okno bez odbioru, liczy jako zgubiony.
+//
+// Nadawca po restarcie zaczyna numerację od losowej wartości, więc skok o co najmniej
+// SEQ_WINDOW_RESTART w dowolną stronę oznacza nowe uruchomienie, a nie zgubione ramki.
+
+#define SEQ_WINDOW_SIZE 32
+#define SEQ_WINDOW_RESTART 1024
+
+typedef struct {
+    bool valid;
+    uint16_t top;       // najwyższy odebrany numer
+    uint32_t mask;      // bit i - odebrano numer top - i
+    uint32_t received;
+    uint32_t lost;
+    uint32_t duplicates;
+    uint32_t restarts;
+} seq_window_t;
+
+// Rejestruje odebrany numer. Zwraca false dla duplikatu.
+bool seq_window_update(seq_window_t *window, uint16_t seq);
+
+// Sprawdza bez rejestrowania, czy numer został już odebrany
+bool seq_window_contains(const seq_window_t *window, uint16_t seq);
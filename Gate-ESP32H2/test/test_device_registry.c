@@ -0,0 +1,126 @@
+// Test rejestru węzłów bramy H2: wypieranie najdawniej widzianych węzłów z pełnego
+// rejestru i ciągłość łańcuchów sondowania po usunięciach z przesunięciem wstecz.
+// Nadawcy zmieniają adres jak węzły Thread po zmianie rodzica, więc rejestr
+// przechodzi wiele obiegów pełnej tablicy.
+
+#include <stdio.h>
+#include <string.h>
+#include "device_registry.h"
+
+static int failures;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+#define LIVE_NODES 20
+#define CHURN_ADDRESSES 20000
+
+// Identyfikator interfejsu nadawcy n, różny dla każdego n
+static void make_iid(uint32_t n, uint8_t iid[DEVICE_IID_LEN])
+{
+    memset(iid, 0, DEVICE_IID_LEN);
+    iid[3] = 0xff;
+    iid[4] = 0xfe;
+    iid[5] = n >> 16;
+    iid[6] = n >> 8;
+    iid[7] = n;
+}
+
+static device_entry_t *lookup(uint32_t n, uint32_t now_ms)
+{
+    uint8_t iid[DEVICE_IID_LEN];
+    make_iid(n, iid);
+    return device_registry_lookup(iid, 1, n & 0xff, now_ms);
+}
+
+static const device_entry_t *find(uint32_t n)
+{
+    uint8_t iid[DEVICE_IID_LEN];
+    make_iid(n, iid);
+    for (size_t i = 0; i < DEVICE_REGISTRY_CAPACITY; i++) {
+        const device_entry_t *entry = device_registry_at(i);
+        if (entry != NULL && memcmp(entry->iid, iid, DEVICE_IID_LEN) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+// Każdy wpis tablicy musi być osiągalny sondowaniem: wyszukanie zwraca ten sam wpis
+// i nie dodaje nowego
+static void check_reachable(uint32_t now_ms)
+{
+    size_t count = device_registry_count();
+    size_t used = 0;
+    for (size_t i = 0; i < DEVICE_REGISTRY_CAPACITY; i++) {
+        const device_entry_t *entry = device_registry_at(i);
+        if (entry == NULL) {
+            continue;
+        }
+        used++;
+        uint32_t last_seen_ms = entry->last_seen_ms;
+        CHECK(device_registry_lookup(entry->iid, entry->group, entry->device, now_ms) == entry);
+        ((device_entry_t *)entry)->last_seen_ms = last_seen_ms; // sprawdzenie nie odświeża wpisu
+    }
+    CHECK(used == count);
+    CHECK(device_registry_count() == count);
+}
+
+int main(void)
+{
+    uint32_t now_ms = 0;
+
+    // Zapełnienie rejestru - wszystkie węzły mieszczą się bez wypierania
+    for (uint32_t n = 0; n < DEVICE_REGISTRY_MAX_DEVICES; n++) {
+        device_entry_t *entry = lookup(n, ++now_ms);
+        entry->rssi = -(int8_t)(n % 100);
+    }
+    CHECK(device_registry_count() == DEVICE_REGISTRY_MAX_DEVICES);
+    CHECK(device_registry_evicted() == 0);
+    check_reachable(now_ms);
+
+    // Węzeł 0 odzywa się ponownie, więc najdawniej widziany jest teraz węzeł 1
+    CHECK(lookup(0, ++now_ms)->rssi == 0);
+    lookup(DEVICE_REGISTRY_MAX_DEVICES, ++now_ms);
+    CHECK(device_registry_count() == DEVICE_REGISTRY_MAX_DEVICES);
+    CHECK(device_registry_evicted() == 1);
+    CHECK(find(0) != NULL);
+    CHECK(find(1) == NULL);
+    CHECK(find(DEVICE_REGISTRY_MAX_DEVICES) != NULL);
+    check_reachable(now_ms);
+
+    // Węzły, które wciąż nadają, zachowują wpisy mimo ciągłego napływu nowych adresów
+    for (uint32_t n = 0; n < LIVE_NODES; n++) {
+        lookup(100000 + n, ++now_ms)->rssi = -(int8_t)(n + 1);
+    }
+    for (uint32_t i = 0; i < CHURN_ADDRESSES; i++) {
+        lookup(200000 + i, ++now_ms);
+        lookup(100000 + i % LIVE_NODES, ++now_ms);
+        if (i % 1000 == 0) {
+            check_reachable(now_ms);
+        }
+    }
+    for (uint32_t n = 0; n < LIVE_NODES; n++) {
+        const device_entry_t *entry = find(100000 + n);
+        CHECK(entry != NULL && entry->rssi == -(int8_t)(n + 1));
+    }
+    // Adresy z początku napływu zostały wyparte, ostatnie są w rejestrze
+    CHECK(find(200000) == NULL);
+    CHECK(find(200000 + CHURN_ADDRESSES - 1) != NULL);
+    CHECK(device_registry_count() == DEVICE_REGISTRY_MAX_DEVICES);
+    check_reachable(now_ms);
+
+    printf("device_registry: %u nodes, %lu evicted\n", (unsigned)device_registry_count(),
+           (unsigned long)device_registry_evicted());
+
+    if (failures > 0) {
+        printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("device_registry: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,194 @@
+// Test obciążeniowy pasów od Thread do UART w bramie H2. Wątki odpowiadają zadaniom
+// bramy: pętla OpenThread dodaje stany i pomiary do pasów bez czekania, zadanie
+// odczytu UART pobiera bloki z tej samej puli z czekaniem, a zadanie zapisu UART
+// opróżnia najpierw pas stanów, potem pas pomiarów, i zwalnia bloki.
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "ingest_lane.h"
+
+static int failures;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            __atomic_fetch_add(&failures, 1, __ATOMIC_RELAXED); \
+        } \
+    } while (0)
+
+// Rozmiary jak w bramie H2
+#define MSG_POOL_SIZE 24
+#define STATE_LANE_DEPTH 8
+#define TELEMETRY_LANE_DEPTH 10
+#define INGEST_FRAMES 300000
+#define DOWNLINK_FRAMES 20000
+
+typedef struct {
+    uint32_t lane;  // 0 - stany, 1 - pomiary, 2 - polecenia z UART
+    uint32_t index; // kolejny numer w pasie
+    uint32_t check;
+    uint8_t frame[20];
+} msg_t;
+
+static msg_t msg_blocks[MSG_POOL_SIZE];
+static sh_pool_t msg_pool;
+static ingest_lane_t lane_high;
+static ingest_lane_t lane_low;
+static QueueHandle_t downlink_queue;
+static atomic_bool ingest_done;
+static atomic_bool downlink_done;
+
+static uint32_t state_rejected;
+static uint32_t telemetry_rejected;
+static uint32_t consumed[2];
+
+static void fill(msg_t *msg, uint32_t lane, uint32_t index)
+{
+    msg->lane = lane;
+    msg->index = index;
+    msg->check = lane ^ index ^ 0x5A5A5A5Au;
+    memset(msg->frame, (uint8_t)index, sizeof(msg->frame));
+}
+
+static bool intact(const msg_t *msg)
+{
+    for (size_t i = 0; i < sizeof(msg->frame); i++) {
+        if (msg->frame[i] != (uint8_t)msg->index) {
+            return false;
+        }
+    }
+    return msg->check == (msg->lane ^ msg->index ^ 0x5A5A5A5Au);
+}
+
+// Pętla OpenThread: co czwarta ramka to zmiana stanu, reszta to pomiary, w seriach
+static void *ot_loop(void *arg)
+{
+    (void)arg;
+    uint32_t index[2] = { 0, 0 };
+    for (uint32_t i = 0; i < INGEST_FRAMES; i++) {
+        msg_t msg;
+        uint32_t lane = i % 4 == 0 ? 0 : 1;
+        fill(&msg, lane, index[lane]);
+        if (ingest_lane_push(lane == 0 ? &lane_high : &lane_low, &msg)) {
+            index[lane]++;
+        } else if (lane == 0) {
+            state_rejected++; // węzeł powtórzy zmianę stanu - ten sam numer w kolejnej próbie
+        } else {
+            telemetry_rejected++;
+            index[lane]++;
+        }
+        if (i % 64 == 0) {
+            sched_yield();
+        }
+    }
+    atomic_store(&ingest_done, true);
+    return NULL;
+}
+
+// Zadanie odczytu UART: polecenia w blokach z tej samej puli, z czekaniem na wolny blok
+static void *uart_read(void *arg)
+{
+    (void)arg;
+    for (uint32_t i = 0; i < DOWNLINK_FRAMES; i++) {
+        msg_t *block = sh_pool_alloc(&msg_pool, 100);
+        CHECK(block != NULL);
+        if (block == NULL) {
+            continue;
+        }
+        fill(block, 2, i);
+        CHECK(xQueueSend(downlink_queue, &block, portMAX_DELAY) == pdPASS);
+    }
+    atomic_store(&downlink_done, true);
+    return NULL;
+}
+
+// Zadanie wysyłające polecenia do sieci Thread
+static void *uart_to_udp(void *arg)
+{
+    (void)arg;
+    uint32_t expected = 0;
+    while (!atomic_load(&downlink_done) || uxQueueMessagesWaiting(downlink_queue) > 0) {
+        msg_t *block;
+        if (xQueueReceive(downlink_queue, &block, 10) != pdPASS) {
+            continue;
+        }
+        CHECK(intact(block) && block->lane == 2 && block->index == expected);
+        expected++;
+        sh_pool_free(&msg_pool, block);
+    }
+    CHECK(expected == DOWNLINK_FRAMES);
+    return NULL;
+}
+
+// Zadanie zapisu UART: stany przed pomiarami. Wolniejsze od producenta, więc pasy się zapełniają.
+static void *uart_write(void *arg)
+{
+    (void)arg;
+    uint32_t last[2] = { UINT32_MAX, UINT32_MAX };
+    while (true) {
+        msg_t *block;
+        if (xQueueReceive(lane_high.queue, &block, 0) != pdPASS && xQueueReceive(lane_low.queue, &block, 1) != pdPASS) {
+            if (atomic_load(&ingest_done) && uxQueueMessagesWaiting(lane_high.queue) == 0 &&
+                uxQueueMessagesWaiting(lane_low.queue) == 0) {
+                return NULL;
+            }
+            continue;
+        }
+        CHECK(intact(block) && block->lane < 2);
+        // W obrębie pasa kolejność zostaje zachowana, a stany nie giną
+        uint32_t lane = block->lane;
+        CHECK(last[lane] == UINT32_MAX || block->index > last[lane]);
+        if (lane == 0) {
+            CHECK(last[0] == UINT32_MAX ? block->index == 0 : block->index == last[0] + 1);
+        }
+        last[lane] = block->index;
+        consumed[lane]++;
+        sh_pool_free(&msg_pool, block);
+        if ((consumed[0] + consumed[1]) % 8 == 0) {
+            struct timespec pause = { 0, 20000 };
+            nanosleep(&pause, NULL);
+        }
+    }
+}
+
+int main(void)
+{
+    CHECK(sh_pool_init(&msg_pool, msg_blocks, sizeof(msg_t), MSG_POOL_SIZE) == ESP_OK);
+    CHECK(ingest_lane_init(&lane_high, &msg_pool, STATE_LANE_DEPTH, false, &lane_low) == ESP_OK);
+    CHECK(ingest_lane_init(&lane_low, &msg_pool, TELEMETRY_LANE_DEPTH, true, NULL) == ESP_OK);
+    downlink_queue = xQueueCreate(STATE_LANE_DEPTH, sizeof(msg_t *));
+
+    pthread_t threads[4];
+    pthread_create(&threads[0], NULL, uart_write, NULL);
+    pthread_create(&threads[1], NULL, uart_to_udp, NULL);
+    pthread_create(&threads[2], NULL, uart_read, NULL);
+    pthread_create(&threads[3], NULL, ot_loop, NULL);
+    for (int i = 3; i >= 0; i--) {
+        pthread_join(threads[i], NULL);
+    }
+
+    // Ramka, która weszła do pasa, została wysłana albo usunięta dla miejsca lub bloku
+    uint32_t evicted = lane_low.dropped - telemetry_rejected;
+    CHECK(lane_high.dropped == state_rejected);
+    CHECK(lane_high.queued + lane_low.queued == consumed[0] + consumed[1] + evicted);
+    CHECK(lane_high.queued == consumed[0]);
+    CHECK(lane_high.high_watermark <= STATE_LANE_DEPTH && lane_low.high_watermark <= TELEMETRY_LANE_DEPTH);
+    CHECK(sh_pool_available(&msg_pool) == MSG_POOL_SIZE);
+
+    printf("ingest: %u frames; states %lu sent, %lu rejected; telemetry %lu sent, %lu evicted, %lu rejected; "
+           "pool minimum %u free, %lu exhausted\n",
+           INGEST_FRAMES, (unsigned long)consumed[0], (unsigned long)state_rejected,
+           (unsigned long)consumed[1], (unsigned long)evicted, (unsigned long)telemetry_rejected,
+           (unsigned)msg_pool.min_free, (unsigned long)msg_pool.exhausted);
+
+    if (failures > 0) {
+        printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("ingest_lane: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Licznik opóźnień jednego kierunku przekazywania ramek w bramie. Czas mierzony
+// jest od odebrania ramki do jej wysłania dalej, w mikrosekundach (esp_timer).
+// Zapisuje go tylko jedno zadanie, inne mogą go czytać do logów.
+typedef struct {
+    uint32_t count;
+    uint32_t last_us;
+    uint32_t max_us;
+    uint64_t total_us;
+} sh_latency_t;
+
+// Dodaje pomiar od chwili start_us do now_us
+void sh_latency_record(sh_latency_t *latency, int64_t start_us, int64_t now_us);
+
+// Średnie opóźnienie lub 0, gdy nie było jeszcze pomiarów
+uint32_t sh_latency_mean_us(const sh_latency_t *latency);
+
+// Czas od start_us do now_us ograniczony do zakresu uint32_t
+uint32_t sh_elapsed_us(int64_t start_us, int64_t now_us);
+
+// Polecenia ze śladem oczekujące na echo. Brama zapisuje chwilę odebrania polecenia
+// i chwilę wysłania go dalej, a echo z tym samym identyfikatorem zamyka ślad.
+// Najstarszy ślad bez echa jest nadpisywany. Tabela może być używana z wielu zadań.
+#define SH_TRACE_SLOTS 8
+
+typedef struct {
+    uint16_t trace;       // 0 - wolne miejsce
+    int64_t received_us;
+    int64_t sent_us;
+} sh_trace_t;
+
+typedef struct {
+    sh_trace_t slots[SH_TRACE_SLOTS];
+    size_t next;
+    portMUX_TYPE lock;
+} sh_trace_table_t;
+
+void sh_trace_table_init(sh_trace_table_t *table);
+
+// Zapamiętuje polecenie ze śladem trace (różnym od 0)
+void sh_trace_begin(sh_trace_table_t *table, uint16_t trace, int64_t received_us, int64_t sent_us);
+
+// Zdejmuje ślad z tabeli. Zwraca false, gdy go nie ma (nadpisany lub obcy).
+bool sh_trace_end(sh_trace_table_t *table, uint16_t trace, sh_trace_t *out);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,62 @@
+#include "sh_latency.h"
+
+#include <string.h>
+
+uint32_t sh_elapsed_us(int64_t start_us, int64_t now_us)
+{
+    int64_t elapsed = now_us - start_us;
+    if (elapsed < 0) {
+        elapsed = 0;
+    }
+    return elapsed > UINT32_MAX ? UINT32_MAX : (uint32_t)elapsed;
+}
+
+void sh_latency_record(sh_latency_t *latency, int64_t start_us, int64_t now_us)
+{
+    uint32_t us = sh_elapsed_us(start_us, now_us);
+
+    latency->count++;
+    latency->last_us = us;
+    latency->total_us += us;
+    if (us > latency->max_us) {
+        latency->max_us = us;
+    }
+}
+
+uint32_t sh_latency_mean_us(const sh_latency_t *latency)
+{
+    return latency->count ? (uint32_t)(latency->total_us / latency->count) : 0;
+}
+
+void sh_trace_table_init(sh_trace_table_t *table)
+{
+    memset(table, 0, sizeof(*table));
+    portMUX_INITIALIZE(&table->lock);
+}
+
+void sh_trace_begin(sh_trace_table_t *table, uint16_t trace, int64_t received_us, int64_t sent_us)
+{
+    portENTER_CRITICAL(&table->lock);
+    sh_trace_t *slot = &table->slots[table->next];
+    table->next = (table->next + 1) % SH_TRACE_SLOTS;
+    slot->trace = trace;
+    slot->received_us = received_us;
+    slot->sent_us = sent_us;
+    portEXIT_CRITICAL(&table->lock);
+}
+
+bool sh_trace_end(sh_trace_table_t *table, uint16_t trace, sh_trace_t *out)
+{
+    bool found = false;
+    portENTER_CRITICAL(&table->lock);
+    for (size_t i = 0; i < SH_TRACE_SLOTS; i++) {
+        if (trace != 0 && table->slots[i].trace == trace) {
+            *out = table->slots[i];
+            table->slots[i].trace = 0;
+            found = true;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&table->lock);
+    return found;
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Warstwa łącza UART między bramami ESP32-H2 i ESP32-C6. Każda ramka sh_proto
+// jest opakowana w ramkę SLIP (RFC 1055), więc granice wiadomości nie zależą od
+// tego, jak sterownik UART podzieli strumień bajtów.
+//
+//  0xC0                 początek ramki (SLIP END, czyści śmieci po zakłóceniu)
+//  bajt 0               numer sekwencyjny ramki łącza
+//  bajty 1..n           dane (ramka sh_proto)
+//  2 bajty              CRC-16/CCITT-FALSE z numeru i danych, little-endian
+//  0xC0                 koniec ramki
+//
+// Bajty 0xC0 i 0xDB wewnątrz ramki zastępowane są sekwencjami 0xDB 0xDC i 0xDB 0xDD.
+//
+// Potwierdzenia są opcjonalne (go-back-N). Ramka ACK nie ma danych, a jej numer to
+// numer ostatniej ramki odebranej po kolei - potwierdza też wszystkie wcześniejsze.
+// Nadawca trzyma do SH_LINK_WINDOW niepotwierdzonych ramek w sh_link_arq_t i po
+// upływie czasu wysyła je ponownie od najstarszej. Odbiorca z włączonymi
+// potwierdzeniami przekazuje ramki tylko w kolejności numerów, więc powtórzenia
+// nie zmieniają kolejności stanów. Strona bez potwierdzeń pomija ramki ACK.
+
+#define SH_LINK_MAX_PAYLOAD 64
+// Najgorszy przypadek: każdy bajt zamieniony na dwa, plus dwa znaczniki END
+#define SH_LINK_MAX_ENCODED (2 * (1 + SH_LINK_MAX_PAYLOAD + 2) + 2)
+#define SH_LINK_WINDOW 8
+
+typedef struct {
+    uint32_t frames;      // poprawne ramki
+    uint32_t crc_errors;
+    uint32_t overflows;   // ramki dłuższe niż SH_LINK_MAX_PAYLOAD
+    uint32_t lost;        // ramki brakujące według numerów sekwencyjnych
+    uint32_t duplicates;  // powtórzenia ramek już przekazanych (tylko z potwierdzeniami)
+    uint32_t out_of_order; // ramki odrzucone w oczekiwaniu na brakującą (tylko z potwierdzeniami)
+} sh_link_stats_t;
+
+// Potwierdzenia w dekoderze: send_ack - odbiorca ma wysłać ACK z numerem seq,
+// peer_ack - nadeszło ACK drugiej strony
+typedef void (*sh_link_ack_cb_t)(uint8_t seq, void *ctx);
+
+// Dekoder strumienia odbieranego z UART
+typedef struct {
+    uint8_t buf[1 + SH_LINK_MAX_PAYLOAD + 2];
+    size_t len;
+    bool escape;
+    bool overflow;
+    bool synced;          // odebrano już jakąś ramkę - znany oczekiwany numer
+    uint8_t expected_seq;
+    uint8_t skipped;      // kolejne ramki odrzucone jako przedwczesne
+    uint16_t recent_crc[SH_LINK_WINDOW]; // CRC ostatnio przekazanych ramek, indeks seq % SH_LINK_WINDOW
+    sh_link_ack_cb_t send_ack;
+    sh_link_ack_cb_t peer_ack;
+    void *ack_ctx;
+    sh_link_stats_t stats;
+} sh_link_decoder_t;
+
+// Nadawca - kolejne numery sekwencyjne
+typedef struct {
+    uint8_t seq;
+} sh_link_encoder_t;
+
+// Niepotwierdzone ramki nadawcy w kolejności wysłania
+typedef struct {
+    struct {
+        uint8_t seq;
+        uint8_t len;
+        uint8_t retries;
+        uint32_t sent_ms; // ostatnie wysłanie ramki
+        uint8_t frame[SH_LINK_MAX_ENCODED];
+    } slots[SH_LINK_WINDOW];
+    uint8_t head;         // najstarsza ramka
+    uint8_t count;
+    uint8_t max_retries;
+    uint32_t timeout_ms;
+    uint32_t retransmits; // ramki wysłane ponownie
+    uint32_t expired;     // ramki porzucone po max_retries powtórzeniach
+} sh_link_arq_t;
+
+// Wywoływany dla każdej poprawnej ramki. Dane ważne tylko w trakcie wywołania.
+typedef void (*sh_link_frame_cb_t)(const uint8_t *payload, size_t len, void *ctx);
+
+// Zapis zakodowanej ramki na łącze
+typedef void (*sh_link_write_cb_t)(const uint8_t *data, size_t len, void *ctx);
+
+uint16_t sh_link_crc16(const uint8_t *data, size_t len);
+
+// Koduje dane do bufora out. Zwraca długość zakodowanej ramki lub 0, gdy dane
+// są za długie albo bufor za mały.
+size_t sh_link_encode(sh_link_encoder_t *encoder, const uint8_t *payload, size_t len, uint8_t *out, size_t out_len);
+
+void sh_link_decoder_init(sh_link_decoder_t *decoder);
+
+// Przekazuje kolejne bajty ze strumienia. Każda kompletna ramka z poprawnym CRC
+// trafia do cb.
+void sh_link_feed(sh_link_decoder_t *decoder, const uint8_t *data, size_t len, sh_link_frame_cb_t cb, void *ctx);
+
+// Włącza potwierdzenia w dekoderze. Wywołania zwrotne przychodzą z sh_link_feed().
+void sh_link_decoder_set_ack(sh_link_decoder_t *decoder, sh_link_ack_cb_t send_ack, sh_link_ack_cb_t peer_ack, void *ctx);
+
+// Koduje ramkę ACK z numerem seq. Zwraca długość lub 0, gdy bufor jest za mały.
+size_t sh_link_encode_ack(uint8_t seq, uint8_t *out, size_t out_len);
+
+// Okno nadawcy. Funkcje nie mają blokady - przy wielu zadaniach chroni je wywołujący.
+void sh_link_arq_init(sh_link_arq_t *arq, uint32_t timeout_ms, uint8_t max_retries);
+bool sh_link_arq_full(const sh_link_arq_t *arq);
+
+// Zapamiętuje ramkę zakodowaną przez sh_link_encode() z numerem seq. Przy pełnym oknie
+// najstarsza ramka jest porzucana - nadawca powinien wcześniej sprawdzić sh_link_arq_full().
+void sh_link_arq_push(sh_link_arq_t *arq, uint8_t seq, const uint8_t *frame, size_t len, uint32_t now_ms);
+
+// ACK z numerem seq zwalnia tę ramkę i wszystkie starsze
+void sh_link_arq_ack(sh_link_arq_t *arq, uint8_t seq);
+
+// Po upływie czasu bez ACK wysyła ponownie całe okno przez write. Zwraca liczbę ramek.
+size_t sh_link_arq_poll(sh_link_arq_t *arq, uint32_t now_ms, sh_link_write_cb_t write, void *ctx);
+
+// Czas do następnego sprawdzenia okna w ms, UINT32_MAX dla pustego okna
+uint32_t sh_link_arq_wait_ms(const sh_link_arq_t *arq, uint32_t now_ms);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,286 @@
+#include "sh_link.h"
+
+#include <string.h>
+
+#define SLIP_END     0xC0
+#define SLIP_ESC     0xDB
+#define SLIP_ESC_END 0xDC
+#define SLIP_ESC_ESC 0xDD
+
+uint16_t sh_link_crc16(const uint8_t *data, size_t len)
+{
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+// Zapisuje bajt z ewentualną sekwencją ucieczki. Zwraca nową pozycję lub 0 przy braku miejsca.
+static size_t put_escaped(uint8_t *out, size_t pos, size_t out_len, uint8_t byte)
+{
+    if (byte == SLIP_END || byte == SLIP_ESC) {
+        if (pos + 2 > out_len) {
+            return 0;
+        }
+        out[pos++] = SLIP_ESC;
+        out[pos++] = byte == SLIP_END ? SLIP_ESC_END : SLIP_ESC_ESC;
+        return pos;
+    }
+    if (pos + 1 > out_len) {
+        return 0;
+    }
+    out[pos++] = byte;
+    return pos;
+}
+
+size_t sh_link_encode(sh_link_encoder_t *encoder, const uint8_t *payload, size_t len, uint8_t *out, size_t out_len)
+{
+    uint8_t raw[1 + SH_LINK_MAX_PAYLOAD + 2];
+    if (len > SH_LINK_MAX_PAYLOAD || out_len < 2) {
+        return 0;
+    }
+
+    raw[0] = encoder->seq;
+    memcpy(&raw[1], payload, len);
+    uint16_t crc = sh_link_crc16(raw, 1 + len);
+    raw[1 + len] = (uint8_t)(crc & 0xff);
+    raw[2 + len] = (uint8_t)(crc >> 8);
+
+    size_t pos = 0;
+    out[pos++] = SLIP_END;
+    for (size_t i = 0; i < len + 3; i++) {
+        pos = put_escaped(out, pos, out_len, raw[i]);
+        if (pos == 0) {
+            return 0;
+        }
+    }
+    if (pos + 1 > out_len) {
+        return 0;
+    }
+    out[pos++] = SLIP_END;
+
+    encoder->seq++;
+    return pos;
+}
+
+size_t sh_link_encode_ack(uint8_t seq, uint8_t *out, size_t out_len)
+{
+    uint16_t crc = sh_link_crc16(&seq, 1);
+    const uint8_t raw[3] = { seq, (uint8_t)(crc & 0xff), (uint8_t)(crc >> 8) };
+
+    if (out_len < 2) {
+        return 0;
+    }
+    size_t pos = 0;
+    out[pos++] = SLIP_END;
+    for (size_t i = 0; i < sizeof(raw); i++) {
+        pos = put_escaped(out, pos, out_len, raw[i]);
+        if (pos == 0) {
+            return 0;
+        }
+    }
+    if (pos + 1 > out_len) {
+        return 0;
+    }
+    out[pos++] = SLIP_END;
+    return pos;
+}
+
+void sh_link_decoder_init(sh_link_decoder_t *decoder)
+{
+    memset(decoder, 0, sizeof(*decoder));
+}
+
+void sh_link_decoder_set_ack(sh_link_decoder_t *decoder, sh_link_ack_cb_t send_ack, sh_link_ack_cb_t peer_ack, void *ctx)
+{
+    decoder->send_ack = send_ack;
+    decoder->peer_ack = peer_ack;
+    decoder->ack_ctx = ctx;
+}
+
+// Ramka z potwierdzeniami: przekazywana tylko kolejna według numeru. Zwraca false,
+// gdy ramkę trzeba odrzucić - odbiorca powtarza wtedy ACK ostatniej przyjętej ramki.
+static bool accept_in_order(sh_link_decoder_t *decoder, uint8_t seq, uint16_t crc)
+{
+    uint8_t gap = (uint8_t)(seq - decoder->expected_seq);
+    if (!decoder->synced || gap == 0) {
+        return true;
+    }
+    if (gap >= 128) {
+        // Ramka z przeszłości: powtórzenie już przekazanej albo pierwsza po restarcie nadawcy
+        bool recent = (uint8_t)(decoder->expected_seq - seq) <= SH_LINK_WINDOW;
+        if (recent && decoder->recent_crc[seq % SH_LINK_WINDOW] == crc) {
+            decoder->stats.duplicates++;
+            return false;
+        }
+        return true;
+    }
+    // Brakuje wcześniejszej ramki - nadawca powtórzy okno od niej. Gdy powtórzenia nie
+    // nadchodzą (nadawca porzucił ramkę albo nie używa potwierdzeń), odbiorca przeskakuje lukę.
+    if (++decoder->skipped < 2 * SH_LINK_WINDOW) {
+        decoder->stats.out_of_order++;
+        return false;
+    }
+    return true;
+}
+
+// Koniec ramki - sprawdza CRC i numer sekwencyjny
+static void finish_frame(sh_link_decoder_t *decoder, sh_link_frame_cb_t cb, void *ctx)
+{
+    if (decoder->overflow) {
+        decoder->stats.overflows++;
+        return;
+    }
+    if (decoder->len == 0) {
+        return; // pusty odstęp między dwoma znacznikami END
+    }
+    if (decoder->len < 3) {
+        decoder->stats.crc_errors++;
+        return;
+    }
+
+    size_t data_len = decoder->len - 2;
+    uint16_t crc = (uint16_t)(decoder->buf[data_len] | (decoder->buf[data_len + 1] << 8));
+    if (crc != sh_link_crc16(decoder->buf, data_len)) {
+        decoder->stats.crc_errors++;
+        return;
+    }
+
+    uint8_t seq = decoder->buf[0];
+    if (data_len == 1) {
+        // Ramka ACK nie zajmuje numeru nadawcy
+        if (decoder->peer_ack != NULL) {
+            decoder->peer_ack(seq, decoder->ack_ctx);
+        }
+        return;
+    }
+    if (decoder->send_ack != NULL && !accept_in_order(decoder, seq, crc)) {
+        if (decoder->synced) {
+            decoder->send_ack((uint8_t)(decoder->expected_seq - 1), decoder->ack_ctx);
+        }
+        return;
+    }
+
+    // Duży skok numeru oznacza restart drugiej strony, a nie utratę ramek
+    uint8_t gap = (uint8_t)(seq - decoder->expected_seq);
+    if (decoder->synced && gap < 128) {
+        decoder->stats.lost += gap;
+    }
+    decoder->synced = true;
+    decoder->expected_seq = seq + 1;
+    decoder->skipped = 0;
+    decoder->recent_crc[seq % SH_LINK_WINDOW] = crc;
+    decoder->stats.frames++;
+    if (decoder->send_ack != NULL) {
+        decoder->send_ack(seq, decoder->ack_ctx);
+    }
+    cb(&decoder->buf[1], data_len - 1, ctx);
+}
+
+void sh_link_feed(sh_link_decoder_t *decoder, const uint8_t *data, size_t len, sh_link_frame_cb_t cb, void *ctx)
+{
+    for (size_t i = 0; i < len; i++) {
+        uint8_t byte = data[i];
+
+        if (byte == SLIP_END) {
+            finish_frame(decoder, cb, ctx);
+            decoder->len = 0;
+            decoder->escape = false;
+            decoder->overflow = false;
+            continue;
+        }
+        if (byte == SLIP_ESC) {
+            decoder->escape = true;
+            continue;
+        }
+        if (decoder->escape) {
+            byte = byte == SLIP_ESC_END ? SLIP_END : byte == SLIP_ESC_ESC ? SLIP_ESC : byte;
+            decoder->escape = false;
+        }
+        if (decoder->len >= sizeof(decoder->buf)) {
+            decoder->overflow = true;
+            continue;
+        }
+        decoder->buf[decoder->len++] = byte;
+    }
+}
+
+void sh_link_arq_init(sh_link_arq_t *arq, uint32_t timeout_ms, uint8_t max_retries)
+{
+    memset(arq, 0, sizeof(*arq));
+    arq->timeout_ms = timeout_ms;
+    arq->max_retries = max_retries;
+}
+
+bool sh_link_arq_full(const sh_link_arq_t *arq)
+{
+    return arq->count >= SH_LINK_WINDOW;
+}
+
+void sh_link_arq_push(sh_link_arq_t *arq, uint8_t seq, const uint8_t *frame, size_t len, uint32_t now_ms)
+{
+    if (len > SH_LINK_MAX_ENCODED) {
+        return;
+    }
+    if (sh_link_arq_full(arq)) {
+        arq->head = (arq->head + 1) % SH_LINK_WINDOW;
+        arq->count--;
+        arq->expired++;
+    }
+    uint8_t index = (arq->head + arq->count) % SH_LINK_WINDOW;
+    arq->slots[index].seq = seq;
+    arq->slots[index].len = (uint8_t)len;
+    arq->slots[index].retries = 0;
+    arq->slots[index].sent_ms = now_ms;
+    memcpy(arq->slots[index].frame, frame, len);
+    arq->count++;
+}
+
+void sh_link_arq_ack(sh_link_arq_t *arq, uint8_t seq)
+{
+    if (arq->count == 0) {
+        return;
+    }
+    // ACK spoza okna jest spóźnionym powtórzeniem - nic nie zwalnia
+    uint8_t acked = (uint8_t)(seq - arq->slots[arq->head].seq) + 1;
+    if (acked > arq->count) {
+        return;
+    }
+    arq->head = (arq->head + acked) % SH_LINK_WINDOW;
+    arq->count -= acked;
+}
+
+size_t sh_link_arq_poll(sh_link_arq_t *arq, uint32_t now_ms, sh_link_write_cb_t write, void *ctx)
+{
+    // Najstarsza ramka nie doczekała się ACK w limicie powtórzeń - odbiorca przeskoczy lukę
+    while (arq->count > 0 && arq->slots[arq->head].retries >= arq->max_retries &&
+           now_ms - arq->slots[arq->head].sent_ms >= arq->timeout_ms) {
+        arq->head = (arq->head + 1) % SH_LINK_WINDOW;
+        arq->count--;
+        arq->expired++;
+    }
+    if (arq->count == 0 || now_ms - arq->slots[arq->head].sent_ms < arq->timeout_ms) {
+        return 0;
+    }
+    for (uint8_t i = 0; i < arq->count; i++) {
+        uint8_t index = (arq->head + i) % SH_LINK_WINDOW;
+        arq->slots[index].retries++;
+        arq->slots[index].sent_ms = now_ms;
+        write(arq->slots[index].frame, arq->slots[index].len, ctx);
+    }
+    arq->retransmits += arq->count;
+    return arq->count;
+}
+
+uint32_t sh_link_arq_wait_ms(const sh_link_arq_t *arq, uint32_t now_ms)
+{
+    if (arq->count == 0) {
+        return UINT32_MAX;
+    }
+    uint32_t elapsed = now_ms - arq->slots[arq->head].sent_ms;
+    return elapsed >= arq->timeout_ms ? 0 : arq->timeout_ms - elapsed;
+}
@@ -0,0 +1,483 @@
+// Test łącza sh_link: koder i dekoder w pamięci, potwierdzenia go-back-N oraz obie
+// strony łącza na parze pseudoterminali. Pseudoterminal nie ogranicza prędkości, więc
+// nadawca odmierza bajty jak UART (10 bitów na bajt przy danej prędkości). Zakłócenia
+// linii to losowo przekłamane bity w obu kierunkach.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "sh_link.h"
+
+static int failures;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+/////////////////////////////////////////////////
+// Koder i dekoder w pamięci
+
+typedef struct {
+    uint8_t payloads[32][SH_LINK_MAX_PAYLOAD];
+    size_t lens[32];
+    size_t count;
+} received_t;
+
+static void on_frame(const uint8_t *payload, size_t len, void *ctx)
+{
+    received_t *received = ctx;
+    if (received->count < 32) {
+        memcpy(received->payloads[received->count], payload, len);
+        received->lens[received->count] = len;
+    }
+    received->count++;
+}
+
+typedef struct {
+    int acks;
+    uint8_t last;
+} acks_t;
+
+static void on_ack(uint8_t seq, void *ctx)
+{
+    acks_t *acks = ctx;
+    acks->acks++;
+    acks->last = seq;
+}
+
+static void test_codec(void)
+{
+    // Wartość kontrolna CRC-16/CCITT-FALSE
+    CHECK(sh_link_crc16((const uint8_t *)"123456789", 9) == 0x29B1);
+
+    sh_link_encoder_t encoder = { 0 };
+    sh_link_decoder_t decoder;
+    received_t received = { 0 };
+    uint8_t out[SH_LINK_MAX_ENCODED];
+    sh_link_decoder_init(&decoder);
+
+    // Bajty specjalne SLIP w danych i ramka podana po jednym bajcie
+    const uint8_t payload[] = { 0xC0, 0xDB, 0x01, 0xDC, 0xDD, 0xC0 };
+    size_t len = sh_link_encode(&encoder, payload, sizeof(payload), out, sizeof(out));
+    CHECK(len > sizeof(payload) + 4);
+    for (size_t i = 0; i < len; i++) {
+        sh_link_feed(&decoder, &out[i], 1, on_frame, &received);
+    }
+    CHECK(received.count == 1);
+    CHECK(received.lens[0] == sizeof(payload) && memcmp(received.payloads[0], payload, sizeof(payload)) == 0);
+
+    // Przekłamany bajt - ramka odrzucona, kolejna liczy się jako zgubiona
+    len = sh_link_encode(&encoder, payload, sizeof(payload), out, sizeof(out));
+    out[3] ^= 0x01;
+    sh_link_feed(&decoder, out, len, on_frame, &received);
+    CHECK(received.count == 1 && decoder.stats.crc_errors == 1);
+    len = sh_link_encode(&encoder, payload, 2, out, sizeof(out));
+    sh_link_feed(&decoder, out, len, on_frame, &received);
+    CHECK(received.count == 2 && decoder.stats.lost == 1);
+
+    // Dane dłuższe niż bufor dekodera
+    uint8_t junk[2 * SH_LINK_MAX_PAYLOAD];
+    memset(junk, 0x55, sizeof(junk));
+    const uint8_t end = 0xC0;
+    sh_link_feed(&decoder, junk, sizeof(junk), on_frame, &received);
+    sh_link_feed(&decoder, &end, 1, on_frame, &received);
+    CHECK(decoder.stats.overflows == 1);
+    CHECK(sh_link_encode(&encoder, junk, sizeof(junk), out, sizeof(out)) == 0);
+
+    // Dekoder bez potwierdzeń pomija ramki ACK
+    len = sh_link_encode_ack(7, out, sizeof(out));
+    sh_link_feed(&decoder, out, len, on_frame, &received);
+    CHECK(received.count == 2 && decoder.stats.crc_errors == 1);
+}
+
+// Odbiorca z potwierdzeniami: przekazuje ramki po kolei, pomija powtórzenia i
+// przedwczesne ramki, a po ich serii przeskakuje lukę
+static void test_go_back_n(void)
+{
+    sh_link_encoder_t encoder = { .seq = 250 }; // numer przechodzi przez 255 -> 0
+    sh_link_decoder_t decoder;
+    received_t received = { 0 };
+    acks_t sent_acks = { 0 };
+    uint8_t frames[12][SH_LINK_MAX_ENCODED];
+    size_t lens[12];
+    sh_link_decoder_init(&decoder);
+    sh_link_decoder_set_ack(&decoder, on_ack, NULL, &sent_acks);
+
+    for (int i = 0; i < 12; i++) {
+        uint8_t payload[2] = { 0xAA, (uint8_t)i };
+        lens[i] = sh_link_encode(&encoder, payload, sizeof(payload), frames[i], sizeof(frames[i]));
+    }
+
+    sh_link_feed(&decoder, frames[0], lens[0], on_frame, &received);
+    CHECK(received.count == 1 && sent_acks.last == 250);
+    // Ramka 1 zgubiona - 2 i 3 odrzucone, ACK wskazuje ostatnią przyjętą
+    sh_link_feed(&decoder, frames[2], lens[2], on_frame, &received);
+    sh_link_feed(&decoder, frames[3], lens[3], on_frame, &received);
+    CHECK(received.count == 1 && decoder.stats.out_of_order == 2 && sent_acks.last == 250);
+    // Nadawca powtarza okno od ramki 1: 0 to duplikat, reszta przechodzi po kolei
+    for (int i = 0; i < 4; i++) {
+        sh_link_feed(&decoder, frames[i], lens[i], on_frame, &received);
+    }
+    CHECK(received.count == 4 && decoder.stats.duplicates == 1 && decoder.stats.lost == 0);
+    CHECK(received.payloads[1][1] == 1 && received.payloads[3][1] == 3);
+    CHECK(sent_acks.last == 253);
+
+    // Ramka 4 porzucona przez nadawcę - po 2 * SH_LINK_WINDOW przedwczesnych ramkach
+    // odbiorca przyjmuje kolejną i liczy lukę jako zgubioną
+    for (int i = 0; i < 2 * SH_LINK_WINDOW; i++) {
+        sh_link_feed(&decoder, frames[5], lens[5], on_frame, &received);
+    }
+    CHECK(received.count == 5 && decoder.stats.lost == 1 && received.payloads[4][1] == 5);
+
+    // Restart nadawcy: numer z przeszłości z inną treścią to nowa ramka
+    sh_link_encoder_t restarted = { .seq = 252 };
+    uint8_t payload[2] = { 0xBB, 0 };
+    uint8_t out[SH_LINK_MAX_ENCODED];
+    size_t len = sh_link_encode(&restarted, payload, sizeof(payload), out, sizeof(out));
+    sh_link_feed(&decoder, out, len, on_frame, &received);
+    CHECK(received.count == 6 && received.payloads[5][0] == 0xBB);
+}
+
+static uint32_t writes;
+
+static void count_write(const uint8_t *data, size_t len, void *ctx)
+{
+    (void)data;
+    (void)len;
+    (void)ctx;
+    writes++;
+}
+
+static void test_arq_window(void)
+{
+    sh_link_arq_t arq;
+    uint8_t frame[4] = { 0xC0, 1, 2, 0xC0 };
+    sh_link_arq_init(&arq, 10, 2);
+    CHECK(sh_link_arq_wait_ms(&arq, 0) == UINT32_MAX);
+
+    for (int i = 0; i < SH_LINK_WINDOW; i++) {
+        sh_link_arq_push(&arq, (uint8_t)(254 + i), frame, sizeof(frame), 100);
+    }
+    CHECK(sh_link_arq_full(&arq));
+    CHECK(sh_link_arq_poll(&arq, 105, count_write, NULL) == 0);
+    CHECK(sh_link_arq_wait_ms(&arq, 105) == 5);
+
+    // ACK numeru 0 potwierdza 254, 255 i 0, spóźnione ACK niczego nie zwalnia
+    sh_link_arq_ack(&arq, 0);
+    CHECK(arq.count == SH_LINK_WINDOW - 3);
+    sh_link_arq_ack(&arq, 254);
+    CHECK(arq.count == SH_LINK_WINDOW - 3);
+
+    // Po czasie całe okno wysyłane jest ponownie, po max_retries porzucane
+    CHECK(sh_link_arq_poll(&arq, 110, count_write, NULL) == SH_LINK_WINDOW - 3);
+    CHECK(sh_link_arq_poll(&arq, 120, count_write, NULL) == SH_LINK_WINDOW - 3);
+    CHECK(sh_link_arq_poll(&arq, 130, count_write, NULL) == 0);
+    CHECK(arq.count == 0 && arq.expired == SH_LINK_WINDOW - 3);
+    CHECK(writes == 2 * (SH_LINK_WINDOW - 3) && arq.retransmits == writes);
+}
+
+/////////////////////////////////////////////////
+// Obie strony na parze pseudoterminali
+
+#define PTY_PAYLOAD_LEN 11 // ramka pomiaru sh_proto
+#define PTY_ACK_TIMEOUT_MS 20
+#define PTY_MAX_RETRIES 5
+
+typedef struct {
+    int fd;
+    uint32_t baud;
+    double error_rate;    // prawdopodobieństwo przekłamania bitu w bajcie
+    unsigned int seed;
+    struct timespec free; // chwila, w której linia skończy nadawać poprzednie bajty
+} line_t;
+
+typedef struct {
+    line_t tx;            // strona H2: ramki danych
+    line_t ack;           // strona C6: potwierdzenia
+    int h2_fd;
+    int c6_fd;
+    bool arq;
+    uint32_t frames;
+
+    pthread_mutex_t lock;
+    sh_link_arq_t window;
+    sh_link_decoder_t h2_rx;
+    sh_link_decoder_t c6_rx;
+    volatile bool stop;
+
+    uint32_t delivered;
+    uint32_t next_index;  // oczekiwany numer kolejnej wiadomości
+    uint32_t reordered;
+    struct timespec last_delivery;
+} pty_link_t;
+
+static double seconds(const struct timespec *ts)
+{
+    return ts->tv_sec + ts->tv_nsec / 1e9;
+}
+
+static void add_ns(struct timespec *ts, long ns)
+{
+    ts->tv_nsec += ns;
+    while (ts->tv_nsec >= 1000000000L) {
+        ts->tv_nsec -= 1000000000L;
+        ts->tv_sec++;
+    }
+}
+
+static uint32_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+// Zapis na linię z zakłóceniami i czasem nadawania bajtów jak w UART
+static void line_write(line_t *line, const uint8_t *data, size_t len)
+{
+    uint8_t buf[SH_LINK_MAX_ENCODED];
+    memcpy(buf, data, len);
+    for (size_t i = 0; i < len; i++) {
+        if (line->error_rate > 0 && rand_r(&line->seed) < line->error_rate * RAND_MAX) {
+            buf[i] ^= (uint8_t)(1 << (rand_r(&line->seed) % 8));
+        }
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (seconds(&line->free) < seconds(&now)) {
+        line->free = now;
+    }
+    add_ns(&line->free, (long)(len * 10 * 1e9 / line->baud));
+    size_t written = 0;
+    while (written < len) {
+        ssize_t n = write(line->fd, buf + written, len - written);
+        if (n < 0 && errno != EAGAIN && errno != EINTR) {
+            return;
+        }
+        written += n > 0 ? (size_t)n : 0;
+    }
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &line->free, NULL);
+}
+
+static void write_tx(const uint8_t *data, size_t len, void *ctx)
+{
+    pty_link_t *link = ctx;
+    line_write(&link->tx, data, len);
+}
+
+static void c6_send_ack(uint8_t seq, void *ctx)
+{
+    pty_link_t *link = ctx;
+    uint8_t out[8];
+    size_t len = sh_link_encode_ack(seq, out, sizeof(out));
+    line_write(&link->ack, out, len);
+}
+
+static void h2_peer_ack(uint8_t seq, void *ctx)
+{
+    pty_link_t *link = ctx;
+    pthread_mutex_lock(&link->lock);
+    sh_link_arq_ack(&link->window, seq);
+    pthread_mutex_unlock(&link->lock);
+}
+
+static void c6_on_frame(const uint8_t *payload, size_t len, void *ctx)
+{
+    pty_link_t *link = ctx;
+    uint32_t index;
+    if (len != PTY_PAYLOAD_LEN) {
+        return;
+    }
+    memcpy(&index, payload, sizeof(index));
+    if (index != link->next_index) {
+        link->reordered++;
+    }
+    link->next_index = index + 1;
+    link->delivered++;
+    clock_gettime(CLOCK_MONOTONIC, &link->last_delivery);
+}
+
+static void ignore_frame(const uint8_t *payload, size_t len, void *ctx)
+{
+    (void)payload;
+    (void)len;
+    (void)ctx;
+}
+
+// Odczyt jednej strony łącza do zatrzymania testu
+static void read_side(pty_link_t *link, int fd, sh_link_decoder_t *decoder, sh_link_frame_cb_t cb)
+{
+    uint8_t data[256];
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    while (!link->stop) {
+        if (poll(&pfd, 1, 10) <= 0) {
+            continue;
+        }
+        ssize_t len = read(fd, data, sizeof(data));
+        if (len > 0) {
+            sh_link_feed(decoder, data, len, cb, link);
+        }
+    }
+}
+
+static void *c6_reader(void *arg)
+{
+    pty_link_t *link = arg;
+    read_side(link, link->c6_fd, &link->c6_rx, c6_on_frame);
+    return NULL;
+}
+
+static void *h2_reader(void *arg)
+{
+    pty_link_t *link = arg;
+    read_side(link, link->h2_fd, &link->h2_rx, ignore_frame);
+    return NULL;
+}
+
+static void sleep_ms(uint32_t ms)
+{
+    struct timespec ts = { .tv_sec = ms / 1000, .tv_nsec = (long)(ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+// Okno nadawcy: powtórzenia po czasie i czekanie na miejsce w oknie
+static void h2_wait_window(pty_link_t *link, bool drain)
+{
+    while (true) {
+        pthread_mutex_lock(&link->lock);
+        uint32_t now = now_ms();
+        sh_link_arq_poll(&link->window, now, write_tx, link);
+        bool done = drain ? link->window.count == 0 : !sh_link_arq_full(&link->window);
+        pthread_mutex_unlock(&link->lock);
+        if (done) {
+            return;
+        }
+        sleep_ms(1);
+    }
+}
+
+static int open_pty_pair(int *master, int *slave)
+{
+    *master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (*master < 0 || grantpt(*master) != 0 || unlockpt(*master) != 0) {
+        return -1;
+    }
+    *slave = open(ptsname(*master), O_RDWR | O_NOCTTY);
+    if (*slave < 0) {
+        return -1;
+    }
+    struct termios tio;
+    tcgetattr(*slave, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(*slave, TCSANOW, &tio);
+    return 0;
+}
+
+static void run_pty(uint32_t baud, double error_rate, bool arq)
+{
+    static pty_link_t link;
+    memset(&link, 0, sizeof(link));
+    if (open_pty_pair(&link.h2_fd, &link.c6_fd) != 0) {
+        printf("pty: cannot open a pseudoterminal pair, skipped\n");
+        return;
+    }
+    // Około 1 s nadawania przy pełnym obciążeniu łącza
+    link.frames = baud / 200;
+    link.arq = arq;
+    link.tx = (line_t){ .fd = link.h2_fd, .baud = baud, .error_rate = error_rate, .seed = 1 };
+    link.ack = (line_t){ .fd = link.c6_fd, .baud = baud, .error_rate = error_rate, .seed = 2 };
+    pthread_mutex_init(&link.lock, NULL);
+    sh_link_arq_init(&link.window, PTY_ACK_TIMEOUT_MS, PTY_MAX_RETRIES);
+    sh_link_decoder_init(&link.h2_rx);
+    sh_link_decoder_init(&link.c6_rx);
+    if (arq) {
+        sh_link_decoder_set_ack(&link.h2_rx, NULL, h2_peer_ack, &link);
+        sh_link_decoder_set_ack(&link.c6_rx, c6_send_ack, NULL, &link);
+    }
+
+    pthread_t c6_thread, h2_thread;
+    pthread_create(&c6_thread, NULL, c6_reader, &link);
+    pthread_create(&h2_thread, NULL, h2_reader, &link);
+
+    sh_link_encoder_t encoder = { 0 };
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t i = 0; i < link.frames; i++) {
+        uint8_t payload[PTY_PAYLOAD_LEN] = { 0 };
+        uint8_t out[SH_LINK_MAX_ENCODED];
+        memcpy(payload, &i, sizeof(i));
+        if (arq) {
+            h2_wait_window(&link, false);
+            pthread_mutex_lock(&link.lock);
+        }
+        uint8_t seq = encoder.seq;
+        size_t len = sh_link_encode(&encoder, payload, sizeof(payload), out, sizeof(out));
+        if (arq) {
+            sh_link_arq_push(&link.window, seq, out, len, now_ms());
+            pthread_mutex_unlock(&link.lock);
+        }
+        line_write(&link.tx, out, len);
+    }
+    if (arq) {
+        h2_wait_window(&link, true);
+    }
+    sleep_ms(100);
+    link.stop = true;
+    pthread_join(c6_thread, NULL);
+    pthread_join(h2_thread, NULL);
+    close(link.c6_fd);
+    close(link.h2_fd);
+
+    double elapsed = seconds(&link.last_delivery) - seconds(&start);
+    uint32_t lost = link.frames - link.delivered;
+    printf("pty %7lu baud, bit errors %.0e/byte, ACK %-3s: %5lu frames, %6.0f msg/s, lost %4lu (%.2f%%), "
+           "CRC errors %lu, retransmits %lu\n",
+           (unsigned long)baud, error_rate, arq ? "on" : "off", (unsigned long)link.frames,
+           elapsed > 0 ? link.delivered / elapsed : 0.0, (unsigned long)lost, 100.0 * lost / link.frames,
+           (unsigned long)link.c6_rx.stats.crc_errors, (unsigned long)link.window.retransmits);
+
+    // Bez potwierdzeń i zakłóceń nic nie ginie, a z potwierdzeniami ramki docierają po kolei
+    if (error_rate == 0) {
+        CHECK(lost == 0);
+    }
+    if (arq) {
+        CHECK(link.reordered == 0);
+        CHECK(lost == link.window.expired);
+    } else {
+        CHECK(lost == link.c6_rx.stats.lost + (link.next_index < link.frames ? link.frames - link.next_index : 0));
+    }
+    pthread_mutex_destroy(&link.lock);
+}
+
+int main(void)
+{
+    test_codec();
+    test_go_back_n();
+    test_arq_window();
+
+    static const uint32_t bauds[] = { 115200, 460800, 921600 };
+    for (size_t i = 0; i < sizeof(bauds) / sizeof(bauds[0]); i++) {
+        run_pty(bauds[i], 0, false);
+        run_pty(bauds[i], 0, true);
+        run_pty(bauds[i], 1e-3, false);
+        run_pty(bauds[i], 1e-3, true);
+    }
+
+    if (failures > 0) {
+        printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("sh_link: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Pula bloków o stałym rozmiarze. Kolejki między zadaniami przenoszą tylko
+// wskaźniki do bloków, więc wiadomość nie jest kopiowana przy każdym przejściu.
+// Wolne bloki trzymane są w kolejce FreeRTOS, dlatego pobieranie i zwalnianie
+// jest bezpieczne z wielu zadań.
+typedef struct {
+    QueueHandle_t free_blocks;
+    uint8_t *storage;
+    size_t block_size;
+    size_t count;
+    size_t min_free;      // najmniejsza liczba wolnych bloków od startu
+    uint32_t exhausted;   // nieudane pobrania bloku
+} sh_pool_t;
+
+// Dzieli storage (block_size * count bajtów) na bloki
+esp_err_t sh_pool_init(sh_pool_t *pool, void *storage, size_t block_size, size_t count);
+
+// Pobiera wolny blok, czekając najwyżej wait tyknięć. Zwraca NULL, gdy pula jest pusta.
+void *sh_pool_alloc(sh_pool_t *pool, TickType_t wait);
+
+// Zwraca blok do puli
+void sh_pool_free(sh_pool_t *pool, void *block);
+
+size_t sh_pool_available(const sh_pool_t *pool);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,50 @@
+#include "sh_pool.h"
+
+#include <stdbool.h>
+
+esp_err_t sh_pool_init(sh_pool_t *pool, void *storage, size_t block_size, size_t count)
+{
+    pool->free_blocks = xQueueCreate(count, sizeof(void *));
+    if (pool->free_blocks == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    pool->storage = storage;
+    pool->block_size = block_size;
+    pool->count = count;
+    pool->min_free = count;
+    pool->exhausted = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        void *block = pool->storage + i * block_size;
+        xQueueSend(pool->free_blocks, &block, 0);
+    }
+    return ESP_OK;
+}
+
+void *sh_pool_alloc(sh_pool_t *pool, TickType_t wait)
+{
+    void *block;
+    if (xQueueReceive(pool->free_blocks, &block, wait) != pdPASS) {
+        __atomic_fetch_add(&pool->exhausted, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    // Liczniki zmieniają zadania, które pobierają bloki równocześnie
+    size_t available = uxQueueMessagesWaiting(pool->free_blocks);
+    size_t min_free = __atomic_load_n(&pool->min_free, __ATOMIC_RELAXED);
+    while (available < min_free &&
+           !__atomic_compare_exchange_n(&pool->min_free, &min_free, available, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+    return block;
+}
+
+void sh_pool_free(sh_pool_t *pool, void *block)
+{
+    if (block != NULL) {
+        xQueueSend(pool->free_blocks, &block, 0);
+    }
+}
+
+size_t sh_pool_available(const sh_pool_t *pool)
+{
+    return uxQueueMessagesWaiting(pool->free_blocks);
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+// Zamiennik esp_err.h do testów na komputerze
+
+typedef int esp_err_t;
+
+#define ESP_OK          0
+#define ESP_FAIL        (-1)
+#define ESP_ERR_NO_MEM  0x101
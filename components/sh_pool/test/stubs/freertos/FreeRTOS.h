@@ -0,0 +1,17 @@
+#pragma once
+
+// Zamiennik FreeRTOS do testów na komputerze: kolejki na wątkach POSIX,
+// jedno tyknięcie to 1 ms.
+
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef unsigned long UBaseType_t;
+typedef long BaseType_t;
+
+#define pdPASS 1
+#define pdFAIL 0
+#define pdTRUE 1
+#define pdFALSE 0
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
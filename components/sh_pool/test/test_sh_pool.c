@@ -0,0 +1,127 @@
+// Test obciążeniowy puli sh_pool: kilku producentów pobiera bloki i przekazuje je
+// kolejką do kilku konsumentów, którzy je zwalniają. Każdy blok ma znacznik
+// właściciela, więc wydanie zajętego bloku dwóm wątkom zostaje wykryte.
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "sh_pool.h"
+
+static int failures;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            __atomic_fetch_add(&failures, 1, __ATOMIC_RELAXED); \
+        } \
+    } while (0)
+
+#define POOL_BLOCKS 16
+#define PRODUCERS 4
+#define CONSUMERS 2
+#define MESSAGES_PER_PRODUCER 200000
+
+typedef struct {
+    uint32_t owner;    // 0 - blok wolny, inaczej numer wątku, który go trzyma
+    uint32_t producer;
+    uint32_t index;
+    uint32_t check;
+} block_t;
+
+static block_t blocks[POOL_BLOCKS];
+static sh_pool_t pool;
+static QueueHandle_t handoff;
+static uint32_t failed_allocs;
+static uint32_t consumed;
+
+static void *producer(void *arg)
+{
+    uint32_t id = (uint32_t)(uintptr_t)arg;
+    for (uint32_t i = 0; i < MESSAGES_PER_PRODUCER; i++) {
+        // Co któryś producent nie czeka - tak jak callback odbioru w bramie H2
+        block_t *block = sh_pool_alloc(&pool, id % 2 ? 0 : 10);
+        if (block == NULL) {
+            __atomic_fetch_add(&failed_allocs, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+        uint32_t previous = __atomic_exchange_n(&block->owner, id, __ATOMIC_ACQ_REL);
+        CHECK(previous == 0);
+        block->producer = id;
+        block->index = i;
+        block->check = id ^ i ^ 0xA5A5A5A5u;
+        __atomic_store_n(&block->owner, CONSUMERS + PRODUCERS + 1, __ATOMIC_RELEASE); // w kolejce
+        CHECK(xQueueSend(handoff, &block, portMAX_DELAY) == pdPASS);
+    }
+    return NULL;
+}
+
+static void *consumer(void *arg)
+{
+    (void)arg;
+    uint32_t last_index[PRODUCERS + 1];
+    memset(last_index, 0xff, sizeof(last_index));
+    while (true) {
+        block_t *block;
+        if (xQueueReceive(handoff, &block, 100) != pdPASS) {
+            return NULL;
+        }
+        if (block == NULL) {
+            return NULL; // koniec testu
+        }
+        CHECK(block >= blocks && block < blocks + POOL_BLOCKS);
+        CHECK(__atomic_load_n(&block->owner, __ATOMIC_ACQUIRE) == CONSUMERS + PRODUCERS + 1);
+        CHECK(block->check == (block->producer ^ block->index ^ 0xA5A5A5A5u));
+        // Wiadomości jednego producenta przychodzą do konsumenta w kolejności wysłania
+        uint32_t previous = last_index[block->producer];
+        CHECK(previous == UINT32_MAX || block->index > previous);
+        last_index[block->producer] = block->index;
+        __atomic_store_n(&block->owner, 0, __ATOMIC_RELEASE);
+        sh_pool_free(&pool, block);
+        __atomic_fetch_add(&consumed, 1, __ATOMIC_RELAXED);
+    }
+}
+
+int main(void)
+{
+    CHECK(sh_pool_init(&pool, blocks, sizeof(block_t), POOL_BLOCKS) == ESP_OK);
+    CHECK(sh_pool_available(&pool) == POOL_BLOCKS);
+    handoff = xQueueCreate(POOL_BLOCKS, sizeof(block_t *));
+
+    pthread_t producers[PRODUCERS], consumers[CONSUMERS];
+    for (uintptr_t i = 0; i < CONSUMERS; i++) {
+        pthread_create(&consumers[i], NULL, consumer, NULL);
+    }
+    for (uintptr_t i = 0; i < PRODUCERS; i++) {
+        pthread_create(&producers[i], NULL, producer, (void *)(i + 1));
+    }
+    for (int i = 0; i < PRODUCERS; i++) {
+        pthread_join(producers[i], NULL);
+    }
+    block_t *stop = NULL;
+    for (int i = 0; i < CONSUMERS; i++) {
+        xQueueSend(handoff, &stop, portMAX_DELAY);
+    }
+    for (int i = 0; i < CONSUMERS; i++) {
+        pthread_join(consumers[i], NULL);
+    }
+
+    // Każdy blok wrócił do puli, a liczniki zgadzają się z tym, co widziały wątki
+    CHECK(sh_pool_available(&pool) == POOL_BLOCKS);
+    CHECK(consumed + failed_allocs == PRODUCERS * MESSAGES_PER_PRODUCER);
+    CHECK(pool.exhausted == failed_allocs);
+    CHECK(pool.min_free < POOL_BLOCKS);
+    for (int i = 0; i < POOL_BLOCKS; i++) {
+        CHECK(blocks[i].owner == 0);
+    }
+    printf("sh_pool: %d producers, %d consumers, %lu messages, %lu allocations failed, minimum %u free\n",
+           PRODUCERS, CONSUMERS, (unsigned long)consumed, (unsigned long)failed_allocs, (unsigned)pool.min_free);
+
+    vQueueDelete(handoff);
+    if (failures > 0) {
+        printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("sh_pool: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Wspólny, binarny format ramek przesyłanych między węzłem czujników,
+// bramą ESP32-H2 i bramą ESP32-C6. Nagłówek i pola mają stały układ,
+// liczby wielobajtowe zapisywane są w kolejności little-endian.
+//
+//  bajt 0     wersja protokołu (SH_PROTO_VERSION)
+//  bajt 1     typ wiadomości (sh_msg_type_t)
+//  bajt 2     identyfikator grupy
+//  bajt 3     identyfikator urządzenia w grupie
+//  bajty 4-5  numer sekwencyjny
+//  dalej      pola zależne od typu wiadomości
+
+#define SH_PROTO_VERSION 3
+#define SH_HEADER_LEN 6
+#define SH_FRAME_MAX_LEN 32
+
+// Kody błędów zwracane przez koder/dekoder (zawsze ujemne)
+#define SH_ERR_SHORT    (-1) // za mało danych w buforze
+#define SH_ERR_VERSION  (-2) // nieobsługiwana wersja protokołu
+#define SH_ERR_TYPE     (-3) // nieznany typ wiadomości
+#define SH_ERR_RANGE    (-4) // wartość pola poza zakresem
+
+typedef enum {
+    SH_MSG_TELEMETRY = 1, // pomiar temperatury i wilgotności
+    SH_MSG_STATE     = 2, // zmiana stanu elementu wykonawczego
+    SH_MSG_COMMAND   = 3, // polecenie dla elementu wykonawczego
+    SH_MSG_TELEMETRY_STATS = 4, // statystyki pomiarów z okna raportowania
+    SH_MSG_ACK       = 5, // potwierdzenie odbioru ramki o podanym numerze
+    SH_MSG_REPORT    = 6, // połączone statystyki i stany elementów wykonawczych
+    SH_MSG_RULE      = 7, // ustawienie reguły automatyki w węźle
+    SH_MSG_TRACE     = 8, // echo polecenia ze śladem - czasy odcinków drogi polecenia
+} sh_msg_type_t;
+
+// Pola obecne w ramce SH_MSG_REPORT
+#define SH_REPORT_STATS     (1 << 0)
+#define SH_REPORT_ACTUATORS (1 << 1)
+
+typedef enum {
+    SH_ACT_LIGHT = 0,
+    SH_ACT_FAN   = 1,
+    SH_ACT_COUNT
+} sh_actuator_t;
+
+// Reguła automatyki lokalnej. Reguła czujnika włącza element wykonawczy, dopóki
+// warunek jest spełniony. Reguła wejścia przełącza element przy każdym zdarzeniu.
+typedef enum {
+    SH_RULE_NONE   = 0, // wolne miejsce w tabeli
+    SH_RULE_SENSOR = 1,
+    SH_RULE_INPUT  = 2,
+} sh_rule_source_t;
+
+typedef enum {
+    SH_QTY_TEMPERATURE = 0,
+    SH_QTY_HUMIDITY    = 1,
+} sh_quantity_t;
+
+typedef enum {
+    SH_RULE_ABOVE = 0, // aktywna powyżej progu, wyłącza się poniżej progu - histereza
+    SH_RULE_BELOW = 1, // aktywna poniżej progu, wyłącza się powyżej progu + histereza
+} sh_rule_op_t;
+
+typedef struct {
+    uint8_t source;      // sh_rule_source_t
+    uint8_t input;       // indeks czujnika lub wejścia
+    uint8_t quantity;    // sh_quantity_t, tylko reguły czujnika
+    uint8_t op;          // sh_rule_op_t, tylko reguły czujnika
+    int16_t threshold;   // setne części
+    int16_t hysteresis;  // setne części
+    uint16_t hold_s;     // jak długo warunek musi trwać przed włączeniem
+    uint8_t actuator;    // sh_actuator_t
+} sh_rule_t;
+
+// Statystyki jednej wielkości w oknie raportowania (setne części)
+typedef struct {
+    int16_t last;
+    int16_t min;
+    int16_t max;
+    int16_t mean;
+} sh_stats_t;
+
+typedef struct {
+    uint8_t type;
+    uint8_t group;
+    uint8_t device;
+    uint16_t seq;
+    union {
+        struct {
+            uint8_t sensor;      // indeks czujnika w węźle
+            int16_t temperature; // setne części stopnia Celsjusza
+            int16_t humidity;    // setne części procenta
+        } telemetry;
+        struct {
+            uint8_t actuator;    // sh_actuator_t
+            uint8_t value;       // 0 - wyłączony, 1 - włączony
+            uint16_t trace;      // tylko SH_MSG_COMMAND, 0 - polecenie bez śladu
+        } state;                 // używane przez SH_MSG_STATE i SH_MSG_COMMAND
+        struct {
+            uint8_t sensor;      // indeks czujnika w węźle
+            uint8_t samples;     // liczba próbek w oknie
+            sh_stats_t temperature;
+            sh_stats_t humidity;
+        } stats;
+        struct {
+            uint16_t seq;        // numer potwierdzanej ramki
+        } ack;
+        struct {
+            uint8_t fields;      // SH_REPORT_*
+            uint8_t sensor;      // pola statystyk jak w SH_MSG_TELEMETRY_STATS
+            uint8_t samples;
+            sh_stats_t temperature;
+            sh_stats_t humidity;
+            uint8_t actuators;   // bit (1 << sh_actuator_t) - stan elementu jest w ramce
+            uint8_t values;      // bit (1 << sh_actuator_t) - element włączony
+        } report;
+        struct {
+            uint8_t index;       // miejsce w tabeli reguł
+            sh_rule_t rule;
+        } rule;
+        struct {
+            uint16_t trace;      // identyfikator śladu z polecenia
+            uint8_t actuator;    // stan elementu po wykonaniu polecenia
+            uint8_t value;
+            // Czasy w mikrosekundach mierzone zegarem urządzenia, które je wpisuje.
+            // Zegary nie są zsynchronizowane, więc odcinki między urządzeniami
+            // wynikają z różnicy czasu w obie strony i czasów wewnątrz urządzeń.
+            uint32_t node_us;       // węzeł: odebranie polecenia -> zmiana wyjścia -> wysłanie echa
+            uint32_t h2_down_us;    // brama H2: odebranie z UART -> wysłanie przez Thread
+            uint32_t thread_rtt_us; // brama H2: wysłanie polecenia -> odebranie echa
+            uint32_t h2_up_us;      // brama H2: odebranie echa -> zapis do UART
+        } trace;
+    };
+} sh_frame_t;
+
+// Usługa bramy ogłaszana w Thread Network Data. Węzły szukają jej, aby wysyłać
+// ramki na adres anycast bramy (ALOC usługi) zamiast na multicast ff03::1.
+#define SH_GW_SERVICE_ENTERPRISE 32473 // numer PEN przeznaczony do dokumentacji i użytku prywatnego
+#define SH_GW_SERVICE_DATA "shgw"
+#define SH_GW_SERVICE_DATA_LEN 4
+
+// Zasoby CoAP węzła (port OT_DEFAULT_COAP_PORT). Reprezentacje pomiarów i stanów
+// to ramki sh_proto (application/octet-stream), więc niosą grupę i urządzenie.
+// Obserwacja (RFC 7641) wygasa po SH_COAP_OBSERVE_LEASE_S bez odnowienia.
+#define SH_COAP_URI_TEMPERATURE "temperature"
+#define SH_COAP_URI_HUMIDITY    "humidity"
+#define SH_COAP_URI_FAN         "fan"
+#define SH_COAP_URI_LIGHT       "light"
+#define SH_COAP_URI_CONFIG      "config"
+#define SH_COAP_OBSERVE_LEASE_S 600
+
+// Polecenia trafiają na adres multicast swojej grupy ff03::5348:<grupa>, więc
+// odbierają je tylko węzły tej grupy. Grupa SH_GROUP_ALL to adres wspólny
+// dla wszystkich grup.
+#define SH_GROUP_ALL 0xff
+#define SH_IP6_ADDR_LEN 16
+
+// Zapisuje 16-bajtowy adres multicast grupy
+void sh_group_multicast_addr(uint8_t group, uint8_t addr[SH_IP6_ADDR_LEN]);
+
+// Zwraca długość ramki danego typu lub SH_ERR_TYPE
+int sh_frame_len(uint8_t type);
+
+// Koduje ramkę do bufora. Zwraca liczbę zapisanych bajtów lub kod błędu.
+int sh_frame_encode(const sh_frame_t *frame, uint8_t *buf, size_t buf_len);
+
+// Dekoduje pierwszą ramkę z bufora. Zwraca liczbę zużytych bajtów lub kod
+// błędu. SH_ERR_SHORT oznacza, że ramka może być kompletna po doczytaniu danych.
+int sh_frame_decode(const uint8_t *buf, size_t len, sh_frame_t *frame);
+
+// Przeliczenia między wartościami zmiennoprzecinkowymi a setnymi częściami
+int16_t sh_to_centi(float value);
+float sh_from_centi(int16_t value);
+
+// Zapisuje wartość w setnych częściach jako tekst "-12.34" bez użycia printf.
+// Zwraca długość tekstu (bez znaku '\0') lub 0, jeśli bufor jest za mały.
+size_t sh_format_centi(int16_t value, char *buf, size_t buf_len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,311 @@
+#include "sh_proto.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+static void put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)(v & 0xff);
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static uint16_t get_u16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    put_u16(&p[0], (uint16_t)(v & 0xffff));
+    put_u16(&p[2], (uint16_t)(v >> 16));
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return get_u16(&p[0]) | ((uint32_t)get_u16(&p[2]) << 16);
+}
+
+static void put_stats(uint8_t *p, const sh_stats_t *stats)
+{
+    put_u16(&p[0], (uint16_t)stats->last);
+    put_u16(&p[2], (uint16_t)stats->min);
+    put_u16(&p[4], (uint16_t)stats->max);
+    put_u16(&p[6], (uint16_t)stats->mean);
+}
+
+static bool rule_valid(uint8_t source, uint8_t quantity, uint8_t op, uint8_t actuator)
+{
+    return source <= SH_RULE_INPUT && quantity <= SH_QTY_HUMIDITY && op <= SH_RULE_BELOW && actuator < SH_ACT_COUNT;
+}
+
+static void get_stats(const uint8_t *p, sh_stats_t *stats)
+{
+    stats->last = (int16_t)get_u16(&p[0]);
+    stats->min = (int16_t)get_u16(&p[2]);
+    stats->max = (int16_t)get_u16(&p[4]);
+    stats->mean = (int16_t)get_u16(&p[6]);
+}
+
+int sh_frame_len(uint8_t type)
+{
+    switch (type) {
+    case SH_MSG_TELEMETRY:
+        return SH_HEADER_LEN + 5;
+    case SH_MSG_STATE:
+    case SH_MSG_ACK:
+        return SH_HEADER_LEN + 2;
+    case SH_MSG_COMMAND:
+        return SH_HEADER_LEN + 4;
+    case SH_MSG_TELEMETRY_STATS:
+        return SH_HEADER_LEN + 18;
+    case SH_MSG_REPORT:
+        return SH_HEADER_LEN + 21;
+    case SH_MSG_RULE:
+        return SH_HEADER_LEN + 12;
+    case SH_MSG_TRACE:
+        return SH_HEADER_LEN + 20;
+    default:
+        return SH_ERR_TYPE;
+    }
+}
+
+int sh_frame_encode(const sh_frame_t *frame, uint8_t *buf, size_t buf_len)
+{
+    int len = sh_frame_len(frame->type);
+    if (len < 0) {
+        return len;
+    }
+    if (buf_len < (size_t)len) {
+        return SH_ERR_SHORT;
+    }
+
+    buf[0] = SH_PROTO_VERSION;
+    buf[1] = frame->type;
+    buf[2] = frame->group;
+    buf[3] = frame->device;
+    put_u16(&buf[4], frame->seq);
+
+    uint8_t *p = &buf[SH_HEADER_LEN];
+    switch (frame->type) {
+    case SH_MSG_TELEMETRY:
+        p[0] = frame->telemetry.sensor;
+        put_u16(&p[1], (uint16_t)frame->telemetry.temperature);
+        put_u16(&p[3], (uint16_t)frame->telemetry.humidity);
+        break;
+    case SH_MSG_STATE:
+    case SH_MSG_COMMAND:
+        if (frame->state.actuator >= SH_ACT_COUNT || frame->state.value > 1) {
+            return SH_ERR_RANGE;
+        }
+        p[0] = frame->state.actuator;
+        p[1] = frame->state.value;
+        if (frame->type == SH_MSG_COMMAND) {
+            put_u16(&p[2], frame->state.trace);
+        }
+        break;
+    case SH_MSG_TELEMETRY_STATS:
+        p[0] = frame->stats.sensor;
+        p[1] = frame->stats.samples;
+        put_stats(&p[2], &frame->stats.temperature);
+        put_stats(&p[10], &frame->stats.humidity);
+        break;
+    case SH_MSG_ACK:
+        put_u16(&p[0], frame->ack.seq);
+        break;
+    case SH_MSG_REPORT:
+        if (frame->report.actuators >= (1 << SH_ACT_COUNT)) {
+            return SH_ERR_RANGE;
+        }
+        p[0] = frame->report.fields;
+        p[1] = frame->report.sensor;
+        p[2] = frame->report.samples;
+        put_stats(&p[3], &frame->report.temperature);
+        put_stats(&p[11], &frame->report.humidity);
+        p[19] = frame->report.actuators;
+        p[20] = frame->report.values & frame->report.actuators;
+        break;
+    case SH_MSG_RULE: {
+        const sh_rule_t *rule = &frame->rule.rule;
+        if (!rule_valid(rule->source, rule->quantity, rule->op, rule->actuator)) {
+            return SH_ERR_RANGE;
+        }
+        p[0] = frame->rule.index;
+        p[1] = rule->source;
+        p[2] = rule->input;
+        p[3] = rule->quantity;
+        p[4] = rule->op;
+        put_u16(&p[5], (uint16_t)rule->threshold);
+        put_u16(&p[7], (uint16_t)rule->hysteresis);
+        put_u16(&p[9], rule->hold_s);
+        p[11] = rule->actuator;
+        break;
+    }
+    case SH_MSG_TRACE:
+        if (frame->trace.actuator >= SH_ACT_COUNT || frame->trace.value > 1) {
+            return SH_ERR_RANGE;
+        }
+        put_u16(&p[0], frame->trace.trace);
+        p[2] = frame->trace.actuator;
+        p[3] = frame->trace.value;
+        put_u32(&p[4], frame->trace.node_us);
+        put_u32(&p[8], frame->trace.h2_down_us);
+        put_u32(&p[12], frame->trace.thread_rtt_us);
+        put_u32(&p[16], frame->trace.h2_up_us);
+        break;
+    }
+    return len;
+}
+
+int sh_frame_decode(const uint8_t *buf, size_t len, sh_frame_t *frame)
+{
+    if (len < SH_HEADER_LEN) {
+        return SH_ERR_SHORT;
+    }
+    if (buf[0] != SH_PROTO_VERSION) {
+        return SH_ERR_VERSION;
+    }
+    int frame_len = sh_frame_len(buf[1]);
+    if (frame_len < 0) {
+        return frame_len;
+    }
+    if (len < (size_t)frame_len) {
+        return SH_ERR_SHORT;
+    }
+
+    memset(frame, 0, sizeof(*frame));
+    frame->type = buf[1];
+    frame->group = buf[2];
+    frame->device = buf[3];
+    frame->seq = get_u16(&buf[4]);
+
+    const uint8_t *p = &buf[SH_HEADER_LEN];
+    switch (frame->type) {
+    case SH_MSG_TELEMETRY:
+        frame->telemetry.sensor = p[0];
+        frame->telemetry.temperature = (int16_t)get_u16(&p[1]);
+        frame->telemetry.humidity = (int16_t)get_u16(&p[3]);
+        break;
+    case SH_MSG_STATE:
+    case SH_MSG_COMMAND:
+        if (p[0] >= SH_ACT_COUNT || p[1] > 1) {
+            return SH_ERR_RANGE;
+        }
+        frame->state.actuator = p[0];
+        frame->state.value = p[1];
+        if (frame->type == SH_MSG_COMMAND) {
+            frame->state.trace = get_u16(&p[2]);
+        }
+        break;
+    case SH_MSG_TELEMETRY_STATS:
+        frame->stats.sensor = p[0];
+        frame->stats.samples = p[1];
+        get_stats(&p[2], &frame->stats.temperature);
+        get_stats(&p[10], &frame->stats.humidity);
+        break;
+    case SH_MSG_ACK:
+        frame->ack.seq = get_u16(&p[0]);
+        break;
+    case SH_MSG_REPORT:
+        if (p[19] >= (1 << SH_ACT_COUNT)) {
+            return SH_ERR_RANGE;
+        }
+        frame->report.fields = p[0];
+        frame->report.sensor = p[1];
+        frame->report.samples = p[2];
+        get_stats(&p[3], &frame->report.temperature);
+        get_stats(&p[11], &frame->report.humidity);
+        frame->report.actuators = p[19];
+        frame->report.values = p[20] & p[19];
+        break;
+    case SH_MSG_RULE: {
+        sh_rule_t *rule = &frame->rule.rule;
+        if (!rule_valid(p[1], p[3], p[4], p[11])) {
+            return SH_ERR_RANGE;
+        }
+        frame->rule.index = p[0];
+        rule->source = p[1];
+        rule->input = p[2];
+        rule->quantity = p[3];
+        rule->op = p[4];
+        rule->threshold = (int16_t)get_u16(&p[5]);
+        rule->hysteresis = (int16_t)get_u16(&p[7]);
+        rule->hold_s = get_u16(&p[9]);
+        rule->actuator = p[11];
+        break;
+    }
+    case SH_MSG_TRACE:
+        if (p[2] >= SH_ACT_COUNT || p[3] > 1) {
+            return SH_ERR_RANGE;
+        }
+        frame->trace.trace = get_u16(&p[0]);
+        frame->trace.actuator = p[2];
+        frame->trace.value = p[3];
+        frame->trace.node_us = get_u32(&p[4]);
+        frame->trace.h2_down_us = get_u32(&p[8]);
+        frame->trace.thread_rtt_us = get_u32(&p[12]);
+        frame->trace.h2_up_us = get_u32(&p[16]);
+        break;
+    }
+    return frame_len;
+}
+
+void sh_group_multicast_addr(uint8_t group, uint8_t addr[SH_IP6_ADDR_LEN])
+{
+    memset(addr, 0, SH_IP6_ADDR_LEN);
+    addr[0] = 0xff;
+    addr[1] = 0x03; // zasięg realm-local, jak ff03::1
+    addr[12] = 'S';
+    addr[13] = 'H';
+    addr[15] = group;
+}
+
+int16_t sh_to_centi(float value)
+{
+    float scaled = value * 100.0f;
+    if (scaled > INT16_MAX) {
+        return INT16_MAX;
+    }
+    if (scaled < INT16_MIN) {
+        return INT16_MIN;
+    }
+    return (int16_t)(scaled >= 0 ? scaled + 0.5f : scaled - 0.5f);
+}
+
+float sh_from_centi(int16_t value)
+{
+    return value / 100.0f;
+}
+
+size_t sh_format_centi(int16_t value, char *buf, size_t buf_len)
+{
+    char tmp[8];
+    size_t n = 0;
+    int32_t v = value;
+    bool negative = v < 0;
+    if (negative) {
+        v = -v;
+    }
+
+    // Cyfry zapisywane od końca: dwie po przecinku, potem część całkowita
+    tmp[n++] = (char)('0' + v % 10);
+    v /= 10;
+    tmp[n++] = (char)('0' + v % 10);
+    v /= 10;
+    tmp[n++] = '.';
+    do {
+        tmp[n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v > 0);
+    if (negative) {
+        tmp[n++] = '-';
+    }
+
+    if (buf_len < n + 1) {
+        return 0;
+    }
+    for (size_t i = 0; i < n; i++) {
+        buf[i] = tmp[n - 1 - i];
+    }
+    buf[n] = '\0';
+    return n;
+}
@@ -0,0 +1,270 @@
+// Test kodeka ramek sh_proto: koder i dekoder dla każdego typu wiadomości,
+// odrzucanie uszkodzonych ramek oraz porównanie rozmiaru i czasu kodowania
+// z tekstowym formatem "{temperature: %.2f, humidity: %.2f}" sprzed sh_proto.
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "sh_proto.h"
+
+static int failures;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+// Po kodowaniu i dekodowaniu ramka musi być identyczna z wejściową
+static void check_round_trip(const sh_frame_t *in)
+{
+    uint8_t buf[SH_FRAME_MAX_LEN];
+    sh_frame_t out;
+
+    int len = sh_frame_encode(in, buf, sizeof(buf));
+    CHECK(len == sh_frame_len(in->type));
+    CHECK(len <= SH_FRAME_MAX_LEN);
+    CHECK(sh_frame_decode(buf, len, &out) == len);
+    CHECK(memcmp(in, &out, sizeof(out)) == 0);
+}
+
+static void test_round_trip(void)
+{
+    sh_frame_t frame;
+
+    memset(&frame, 0, sizeof(frame));
+    frame.type = SH_MSG_TELEMETRY;
+    frame.group = 1;
+    frame.device = 2;
+    frame.seq = 0xbeef;
+    frame.telemetry.sensor = 1;
+    frame.telemetry.temperature = -1234;
+    frame.telemetry.humidity = 5678;
+    check_round_trip(&frame);
+
+    memset(&frame, 0, sizeof(frame));
+    frame.type = SH_MSG_STATE;
+    frame.seq = 1;
+    frame.state.actuator = SH_ACT_FAN;
+    frame.state.value = 1;
+    check_round_trip(&frame);
+
+    memset(&frame, 0, sizeof(frame));
+    frame.type = SH_MSG_COMMAND;
+    frame.group = SH_GROUP_ALL;
+    frame.state.actuator = SH_ACT_LIGHT;
+    frame.state.value = 1;
+    frame.state.trace = 0x1234;
+    check_round_trip(&frame);
+
+    memset(&frame, 0, sizeof(frame));
+    frame.type = SH_MSG_TELEMETRY_STATS;
+    frame.stats.samples = 30;
+    frame.stats.temperature = (sh_stats_t){ 2150, -500, 3000, 2010 };
+    frame.stats.humidity = (sh_stats_t){ 4500, 4000, 5000, 4490 };
+    check_round_trip(&frame);
+
+    memset(&frame, 0, sizeof(frame));
+    frame.type = SH_MSG_ACK;
+    frame.seq = 7;
+    frame.ack.seq = 0xffff;
+    check_round_trip(&frame);
+
+    memset(&frame, 0, sizeof(frame));
+    frame.type = SH_MSG_REPORT;
+    frame.report.fields = SH_REPORT_STATS | SH_REPORT_ACTUATORS;
+    frame.report.samples = 12;
+    frame.report.temperature = (sh_stats_t){ INT16_MIN, INT16_MIN, INT16_MAX, 0 };
+    frame.report.humidity = (sh_stats_t){ 1, 2, 3, 4 };
+    frame.report.actuators = (1 << SH_ACT_LIGHT) | (1 << SH_ACT_FAN);
+    frame.report.values = 1 << SH_ACT_FAN;
+    check_round_trip(&frame);
+
+    memset(&frame, 0, sizeof(frame));
+    frame.type = SH_MSG_RULE;
+    frame.rule.index = 3;
+    frame.rule.rule = (sh_rule_t){
+        .source = SH_RULE_SENSOR,
+        .quantity = SH_QTY_HUMIDITY,
+        .op = SH_RULE_BELOW,
+        .threshold = -250,
+        .hysteresis = 100,
+        .hold_s = 600,
+        .actuator = SH_ACT_FAN,
+    };
+    check_round_trip(&frame);
+
+    memset(&frame, 0, sizeof(frame));
+    frame.type = SH_MSG_TRACE;
+    frame.trace.trace = 42;
+    frame.trace.actuator = SH_ACT_LIGHT;
+    frame.trace.value = 1;
+    frame.trace.node_us = 1;
+    frame.trace.h2_down_us = 0x12345678;
+    frame.trace.thread_rtt_us = UINT32_MAX;
+    frame.trace.h2_up_us = 99;
+    check_round_trip(&frame);
+
+    // Wartości pól są wymuszane przy kodowaniu: niezgłoszony element nie ma stanu
+    memset(&frame, 0, sizeof(frame));
+    frame.type = SH_MSG_REPORT;
+    frame.report.actuators = 1 << SH_ACT_LIGHT;
+    frame.report.values = (1 << SH_ACT_LIGHT) | (1 << SH_ACT_FAN);
+    uint8_t buf[SH_FRAME_MAX_LEN];
+    sh_frame_t out;
+    int len = sh_frame_encode(&frame, buf, sizeof(buf));
+    CHECK(sh_frame_decode(buf, len, &out) == len);
+    CHECK(out.report.values == (1 << SH_ACT_LIGHT));
+}
+
+static void test_truncated(void)
+{
+    sh_frame_t frame = { .type = SH_MSG_REPORT };
+    sh_frame_t out;
+    uint8_t buf[SH_FRAME_MAX_LEN];
+    int len = sh_frame_encode(&frame, buf, sizeof(buf));
+    CHECK(len > SH_HEADER_LEN);
+
+    // Każda niepełna ramka - także sam nagłówek - czeka na dalsze dane
+    for (int i = 0; i < len; i++) {
+        CHECK(sh_frame_decode(buf, i, &out) == SH_ERR_SHORT);
+    }
+    // Bufor za mały na zakodowaną ramkę
+    CHECK(sh_frame_encode(&frame, buf, len - 1) == SH_ERR_SHORT);
+}
+
+static void test_oversize(void)
+{
+    sh_frame_t first = { .type = SH_MSG_STATE, .seq = 1, .state = { .actuator = SH_ACT_FAN, .value = 1 } };
+    sh_frame_t second = { .type = SH_MSG_ACK, .seq = 2, .ack = { .seq = 1 } };
+    sh_frame_t out;
+    uint8_t buf[2 * SH_FRAME_MAX_LEN];
+
+    // Dekoder zużywa tylko pierwszą ramkę, reszta bufora zostaje dla następnej
+    int len1 = sh_frame_encode(&first, buf, sizeof(buf));
+    int len2 = sh_frame_encode(&second, buf + len1, sizeof(buf) - len1);
+    CHECK(sh_frame_decode(buf, len1 + len2, &out) == len1);
+    CHECK(out.type == SH_MSG_STATE && out.seq == 1);
+    CHECK(sh_frame_decode(buf + len1, len2, &out) == len2);
+    CHECK(out.type == SH_MSG_ACK && out.ack.seq == 1);
+
+    // Pola poza zakresem są odrzucane w obu kierunkach
+    sh_frame_t bad = first;
+    bad.state.actuator = SH_ACT_COUNT;
+    CHECK(sh_frame_encode(&bad, buf, sizeof(buf)) == SH_ERR_RANGE);
+    bad = first;
+    bad.state.value = 2;
+    CHECK(sh_frame_encode(&bad, buf, sizeof(buf)) == SH_ERR_RANGE);
+
+    sh_frame_encode(&first, buf, sizeof(buf));
+    buf[SH_HEADER_LEN] = SH_ACT_COUNT;
+    CHECK(sh_frame_decode(buf, len1, &out) == SH_ERR_RANGE);
+
+    sh_frame_t report = { .type = SH_MSG_REPORT, .report = { .actuators = 1 << SH_ACT_COUNT } };
+    CHECK(sh_frame_encode(&report, buf, sizeof(buf)) == SH_ERR_RANGE);
+
+    sh_frame_t rule = { .type = SH_MSG_RULE, .rule = { .rule = { .source = SH_RULE_INPUT + 1 } } };
+    CHECK(sh_frame_encode(&rule, buf, sizeof(buf)) == SH_ERR_RANGE);
+
+    // Nieznany typ
+    sh_frame_t unknown = { .type = 0 };
+    CHECK(sh_frame_encode(&unknown, buf, sizeof(buf)) == SH_ERR_TYPE);
+    sh_frame_encode(&first, buf, sizeof(buf));
+    buf[1] = SH_MSG_TRACE + 1;
+    CHECK(sh_frame_decode(buf, sizeof(buf), &out) == SH_ERR_TYPE);
+}
+
+static void test_bad_version(void)
+{
+    sh_frame_t frame = { .type = SH_MSG_TELEMETRY };
+    sh_frame_t out;
+    uint8_t buf[SH_FRAME_MAX_LEN];
+    int len = sh_frame_encode(&frame, buf, sizeof(buf));
+    CHECK(buf[0] == SH_PROTO_VERSION);
+
+    buf[0] = SH_PROTO_VERSION - 1;
+    CHECK(sh_frame_decode(buf, len, &out) == SH_ERR_VERSION);
+    buf[0] = SH_PROTO_VERSION + 1;
+    CHECK(sh_frame_decode(buf, len, &out) == SH_ERR_VERSION);
+    // Tekst starego formatu też nie jest ramką
+    const char *text = "{temperature: 21.50, humidity: 45.00}";
+    CHECK(sh_frame_decode((const uint8_t *)text, strlen(text), &out) == SH_ERR_VERSION);
+}
+
+static void test_format_centi(void)
+{
+    char buf[8];
+    CHECK(sh_format_centi(2150, buf, sizeof(buf)) == 5 && strcmp(buf, "21.50") == 0);
+    CHECK(sh_format_centi(-5, buf, sizeof(buf)) == 5 && strcmp(buf, "-0.05") == 0);
+    CHECK(sh_format_centi(INT16_MIN, buf, sizeof(buf)) == 7 && strcmp(buf, "-327.68") == 0);
+    CHECK(sh_format_centi(2150, buf, 5) == 0);
+    CHECK(sh_to_centi(21.505f) == 2151);
+    CHECK(sh_to_centi(-0.004f) == 0);
+    CHECK(sh_to_centi(1000.0f) == INT16_MAX);
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Bajty na wiadomość i czas kodowania z dekodowaniem: ramka binarna kontra tekst
+// wysyłany przez węzeł i parsowany przez sscanf w bramie C6 przed sh_proto.
+// Wynik tylko raportowany - zależy od komputera, na którym działa test.
+static void bench_against_text(void)
+{
+    enum { ROUNDS = 200000 };
+    volatile int16_t sink = 0;
+    uint8_t buf[SH_FRAME_MAX_LEN];
+    char text[128];
+    sh_frame_t frame = { .type = SH_MSG_TELEMETRY, .group = 1, .device = 1 };
+    sh_frame_t out;
+
+    int binary_len = 0;
+    double start = now_ns();
+    for (int i = 0; i < ROUNDS; i++) {
+        frame.seq = (uint16_t)i;
+        frame.telemetry.temperature = (int16_t)(2000 + i % 500);
+        frame.telemetry.humidity = (int16_t)(4000 + i % 1000);
+        binary_len = sh_frame_encode(&frame, buf, sizeof(buf));
+        sh_frame_decode(buf, binary_len, &out);
+        sink += out.telemetry.temperature;
+    }
+    double binary_ns = (now_ns() - start) / ROUNDS;
+
+    size_t text_len = 0;
+    start = now_ns();
+    for (int i = 0; i < ROUNDS; i++) {
+        float temperature = (2000 + i % 500) / 100.0f;
+        float humidity = (4000 + i % 1000) / 100.0f;
+        text_len = (size_t)snprintf(text, sizeof(text), "{temperature: %.2f, humidity: %.2f}", temperature, humidity);
+        CHECK(sscanf(text, "{temperature: %f, humidity: %f}", &temperature, &humidity) == 2);
+        sink += (int16_t)temperature;
+    }
+    double text_ns = (now_ns() - start) / ROUNDS;
+    (void)sink;
+
+    CHECK((size_t)binary_len < text_len);
+    printf("telemetry: binary %d B, %.0f ns encode+decode; text %zu B, %.0f ns snprintf+sscanf\n",
+           binary_len, binary_ns, text_len, text_ns);
+}
+
+int main(void)
+{
+    test_round_trip();
+    test_truncated();
+    test_oversize();
+    test_bad_version();
+    test_format_centi();
+    bench_against_text();
+
+    if (failures > 0) {
+        printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("sh_proto: all checks passed\n");
+    return 0;
+}
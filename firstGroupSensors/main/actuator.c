@@ -0,0 +1,97 @@
+#include "actuator.h"
+
+#include "freertos/task.h"
+#include "esp_log.h"
+
+#define TAG "actuator"
+#define ACTUATOR_MAX 16
+
+static EventGroupHandle_t event_group;
+static const actuator_desc_t *actuators;
+static size_t actuator_count;
+static actuator_change_cb_t change_cb;
+static actuator_flags_cb_t flags_cb;
+static bool states[ACTUATOR_MAX];
+
+// Zadanie silnika: śpi do zmiany flag, po czym przelicza wszystkie wyjścia
+static void actuator_task(void *pvParameter)
+{
+    while (1) {
+        EventBits_t flags = xEventGroupWaitBits(event_group, ACTUATOR_FLAG_UPDATE, pdTRUE, pdFALSE, portMAX_DELAY);
+        if (!(flags & ACTUATOR_FLAG_UPDATE)) {
+            continue;
+        }
+        flags = xEventGroupGetBits(event_group);
+
+        for (size_t i = 0; i < actuator_count; i++) {
+            const actuator_desc_t *actuator = &actuators[i];
+            bool on = (flags & (actuator->switch_flag | actuator->override_flags)) != 0;
+            if (on == states[i]) {
+                continue;
+            }
+            gpio_set_level(actuator->gpio, on);
+            states[i] = on;
+            ESP_LOGI(TAG, "%s -> %s", actuator->name, on ? "on" : "off");
+            if (change_cb) {
+                change_cb(actuator, on);
+            }
+        }
+        if (flags_cb) {
+            flags_cb(flags & ~ACTUATOR_FLAG_UPDATE);
+        }
+    }
+}
+
+esp_err_t actuator_engine_start(const actuator_desc_t *table, size_t count, actuator_change_cb_t cb)
+{
+    if (count > ACTUATOR_MAX) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    actuators = table;
+    actuator_count = count;
+    change_cb = cb;
+
+    event_group = xEventGroupCreate();
+    if (event_group == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        gpio_set_direction(table[i].gpio, GPIO_MODE_OUTPUT);
+        gpio_set_level(table[i].gpio, 0);
+        states[i] = false;
+    }
+
+    if (xTaskCreate(actuator_task, "actuator_task", 3072, NULL, 6, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void actuator_flags_set(EventBits_t flags)
+{
+    xEventGroupSetBits(event_group, flags | ACTUATOR_FLAG_UPDATE);
+}
+
+void actuator_flags_clear(EventBits_t flags)
+{
+    xEventGroupClearBits(event_group, flags);
+    xEventGroupSetBits(event_group, ACTUATOR_FLAG_UPDATE);
+}
+
+void actuator_flags_toggle(EventBits_t flags)
+{
+    EventBits_t current = xEventGroupGetBits(event_group);
+    actuator_flags_clear(current & flags);
+    actuator_flags_set(~current & flags);
+}
+
+void actuator_set_flags_cb(actuator_flags_cb_t cb)
+{
+    flags_cb = cb;
+}
+
+EventBits_t actuator_flags_get(void)
+{
+    return xEventGroupGetBits(event_group) & ~ACTUATOR_FLAG_UPDATE;
+}
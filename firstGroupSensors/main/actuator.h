@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "driver/gpio.h"
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "sh_proto.h"
+
+// Bit zarezerwowany przez silnik - pozostałe bity grupy zdarzeń należą do aplikacji
+#define ACTUATOR_FLAG_UPDATE (1 << 23)
+
+// Opis elementu wykonawczego. Wyjście jest włączone, gdy ustawiona jest flaga
+// switch_flag albo dowolna z flag override_flags (np. wysoka wilgotność).
+typedef struct {
+    const char *name;
+    sh_actuator_t id;
+    gpio_num_t gpio;
+    EventBits_t switch_flag;
+    EventBits_t override_flags;
+} actuator_desc_t;
+
+// Wywoływany dokładnie raz przy każdej zmianie stanu wyjścia
+typedef void (*actuator_change_cb_t)(const actuator_desc_t *actuator, bool on);
+
+// Wywoływany z zadania silnika po każdej zmianie flag, z bieżącymi flagami aplikacji
+typedef void (*actuator_flags_cb_t)(EventBits_t flags);
+
+// Konfiguruje wyjścia z tabeli i uruchamia zadanie silnika.
+// Tabela musi istnieć przez cały czas działania programu.
+esp_err_t actuator_engine_start(const actuator_desc_t *table, size_t count, actuator_change_cb_t cb);
+
+// Operacje na flagach - każda budzi silnik, który od razu przelicza wyjścia
+void actuator_flags_set(EventBits_t flags);
+void actuator_flags_clear(EventBits_t flags);
+void actuator_flags_toggle(EventBits_t flags);
+EventBits_t actuator_flags_get(void);
+
+// Obserwator zmian flag (np. zapis stanu przełączników), opcjonalny
+void actuator_set_flags_cb(actuator_flags_cb_t cb);
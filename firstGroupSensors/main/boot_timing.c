@@ -0,0 +1,60 @@
+#include "boot_timing.h"
+
+#include <stdint.h>
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+
+#define TAG "boot_timing"
+
+static const char *const mark_names[BOOT_MARK_COUNT] = {
+    [BOOT_MARK_GPIO_RESTORED] = "GPIO restore",
+    [BOOT_MARK_ATTACHED] = "Thread attach",
+    [BOOT_MARK_FIRST_REPORT] = "first report",
+};
+
+static uint32_t marks_ms[BOOT_MARK_COUNT];
+static uint32_t marked;   // bit (1 << boot_mark_t) - etap już zgłoszony
+static uint32_t recorded; // liczba etapów z zapisanym czasem
+static bool warm_start;
+
+// Reset bez utraty zasilania - pamięć RTC i stan zewnętrznych układów zostają
+static bool reset_is_warm(esp_reset_reason_t reason)
+{
+    switch (reason) {
+    case ESP_RST_SW:
+    case ESP_RST_PANIC:
+    case ESP_RST_INT_WDT:
+    case ESP_RST_TASK_WDT:
+    case ESP_RST_WDT:
+    case ESP_RST_DEEPSLEEP:
+        return true;
+    default:
+        return false;
+    }
+}
+
+void boot_timing_start(bool restored)
+{
+    esp_reset_reason_t reason = esp_reset_reason();
+    warm_start = reset_is_warm(reason);
+    ESP_LOGI(TAG, "%s start, reset reason %d, switch state %s", warm_start ? "Warm" : "Cold", reason,
+             restored ? "restored from NVS" : "not stored");
+}
+
+void boot_timing_mark(boot_mark_t mark)
+{
+    uint32_t bit = 1U << mark;
+    // Etapy zgłaszane są z różnych zadań, zapisuje tylko pierwsze wywołanie
+    if (__atomic_fetch_or(&marked, bit, __ATOMIC_RELAXED) & bit) {
+        return;
+    }
+    marks_ms[mark] = (uint32_t)(esp_timer_get_time() / 1000);
+    ESP_LOGI(TAG, "%s after %lu ms", mark_names[mark], (unsigned long)marks_ms[mark]);
+
+    if (__atomic_add_fetch(&recorded, 1, __ATOMIC_ACQ_REL) == BOOT_MARK_COUNT) {
+        ESP_LOGI(TAG, "%s start: GPIO %lu ms, attach %lu ms, first report %lu ms", warm_start ? "Warm" : "Cold",
+                 (unsigned long)marks_ms[BOOT_MARK_GPIO_RESTORED], (unsigned long)marks_ms[BOOT_MARK_ATTACHED],
+                 (unsigned long)marks_ms[BOOT_MARK_FIRST_REPORT]);
+    }
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdbool.h>
+
+// Pomiar czasu uruchomienia węzła. Każdy etap zapisywany jest raz, liczony od
+// startu aplikacji (esp_timer). Po ostatnim etapie wypisywane jest podsumowanie,
+// osobno dla startu ciepłego i zimnego. Rodzaj startu wynika z przyczyny resetu:
+// restart programowy, watchdog lub wybudzenie z uśpienia to start ciepły,
+// włączenie zasilania, spadek napięcia i pozostałe przyczyny - zimny.
+
+typedef enum {
+    BOOT_MARK_GPIO_RESTORED, // wyjścia ustawione w stan sprzed restartu
+    BOOT_MARK_ATTACHED,      // węzeł dołączył do sieci Thread
+    BOOT_MARK_FIRST_REPORT,  // pierwszy raport pomiarów przekazany do wysłania
+    BOOT_MARK_COUNT
+} boot_mark_t;
+
+// restored - stan wyjść został odtworzony z NVS (podawany w dzienniku)
+void boot_timing_start(bool restored);
+
+// Zapisuje czas etapu, kolejne wywołania dla tego samego etapu są ignorowane
+void boot_timing_mark(boot_mark_t mark);
@@ -0,0 +1,87 @@
+#include "button.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/timers.h"
+#include "esp_log.h"
+#include "debounce.h"
+#include "input_hal.h"
+
+#define TAG "button"
+
+typedef struct {
+    gpio_num_t pin;
+    TimerHandle_t timer;
+    debounce_t debounce;
+    button_press_cb_t cb;
+    void *ctx;
+} button_t;
+
+static button_t buttons[BUTTON_MAX];
+static int button_count = 0;
+
+static void report_press(button_t *button)
+{
+    ESP_LOGD(TAG, "Button on GPIO%d pressed, latency %lld us", button->pin,
+             (long long)(input_hal_now_us() - button->debounce.edge_us));
+    button->cb(button - buttons, button->ctx);
+}
+
+// Wywoływane w zadaniu timerów po naciśnięciu wykrytym w przerwaniu
+static void press_deferred(void *arg, uint32_t unused)
+{
+    report_press(arg);
+}
+
+static void IRAM_ATTR button_edge_isr(void *arg)
+{
+    button_t *button = arg;
+    BaseType_t higher_priority_woken = pdFALSE;
+
+    bool pressed;
+    if (!debounce_edge(&button->debounce, input_hal_get_level(button->pin), input_hal_now_us(), &pressed)) {
+        return;
+    }
+    if (pressed) {
+        xTimerPendFunctionCallFromISR(press_deferred, button, 0, &higher_priority_woken);
+    }
+    xTimerStartFromISR(button->timer, &higher_priority_woken);
+    portYIELD_FROM_ISR(higher_priority_woken);
+}
+
+// Koniec okna - ponowny odczyt poziomu na wypadek zbocza zgubionego w trakcie drgań
+static void debounce_timer_cb(TimerHandle_t timer)
+{
+    button_t *button = pvTimerGetTimerID(timer);
+    if (debounce_window_end(&button->debounce, input_hal_get_level(button->pin))) {
+        report_press(button);
+    }
+}
+
+esp_err_t button_add(gpio_num_t pin, button_press_cb_t cb, void *ctx, int *out_button)
+{
+    if (button_count >= BUTTON_MAX) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    button_t *button = &buttons[button_count];
+    button->pin = pin;
+    button->cb = cb;
+    button->ctx = ctx;
+    button->timer = xTimerCreate("debounce", pdMS_TO_TICKS(CONFIG_BUTTON_DEBOUNCE_MS), pdFALSE, button, debounce_timer_cb);
+    if (button->timer == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    debounce_init(&button->debounce, input_hal_get_level(pin));
+
+    esp_err_t err = input_hal_config_input(pin, button_edge_isr, button);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to configure GPIO%d: %s", pin, esp_err_to_name(err));
+        return err;
+    }
+
+    if (out_button) {
+        *out_button = button_count;
+    }
+    button_count++;
+    return ESP_OK;
+}
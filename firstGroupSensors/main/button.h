@@ -0,0 +1,14 @@
+#pragma once
+
+#include "driver/gpio.h"
+#include "esp_err.h"
+
+#define BUTTON_MAX 4
+
+// Wywoływany z kontekstu zadania timerów FreeRTOS po wykryciu naciśnięcia.
+// Przycisk zgłaszany jest przy pierwszym zboczu narastającym, a kolejne zbocza
+// w oknie CONFIG_BUTTON_DEBOUNCE_MS są ignorowane.
+typedef void (*button_press_cb_t)(int button, void *ctx);
+
+// Rejestruje przycisk na danym pinie. Zwraca jego indeks przez out_button.
+esp_err_t button_add(gpio_num_t pin, button_press_cb_t cb, void *ctx, int *out_button);
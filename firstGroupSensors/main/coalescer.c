@@ -0,0 +1,117 @@
+#include "coalescer.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/timers.h"
+#include "esp_log.h"
+
+#define TAG "coalescer"
+
+static SemaphoreHandle_t lock;
+static TimerHandle_t window_timer;
+static coalescer_flush_cb_t flush_cb;
+static bool no_window; // okno 0 ms - każda aktualizacja wysyłana od razu
+static sh_frame_t pending;
+static uint32_t merged; // aktualizacje dołączone do już oczekującej ramki
+
+// Zabiera oczekującą ramkę. Wymaga blokady; zwraca false, gdy nic nie czeka.
+static bool take_pending(sh_frame_t *frame)
+{
+    if (pending.report.fields == 0) {
+        return false;
+    }
+    *frame = pending;
+    pending.report.fields = 0;
+    pending.report.actuators = 0;
+    pending.report.values = 0;
+    xTimerStop(window_timer, 0);
+    return true;
+}
+
+// Pierwsza aktualizacja w oknie uruchamia odliczanie
+static void mark_pending(uint8_t field)
+{
+    if (pending.report.fields == 0) {
+        xTimerReset(window_timer, 0);
+    } else {
+        merged++;
+    }
+    pending.report.fields |= field;
+}
+
+static void window_timer_cb(TimerHandle_t timer)
+{
+    coalescer_flush();
+}
+
+esp_err_t coalescer_init(uint32_t window_ms, coalescer_flush_cb_t cb)
+{
+    lock = xSemaphoreCreateMutex();
+    // Timer musi mieć niezerowy okres, nawet gdy okno jest wyłączone
+    no_window = pdMS_TO_TICKS(window_ms) == 0;
+    window_timer = xTimerCreate("coalescer", no_window ? 1 : pdMS_TO_TICKS(window_ms),
+                                pdFALSE, NULL, window_timer_cb);
+    if (lock == NULL || window_timer == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    flush_cb = cb;
+    pending.type = SH_MSG_REPORT;
+    return ESP_OK;
+}
+
+void coalescer_add_stats(uint8_t sensor, uint8_t samples, const sh_stats_t *temperature, const sh_stats_t *humidity)
+{
+    sh_frame_t previous;
+    bool send_previous = false;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if ((pending.report.fields & SH_REPORT_STATS) && pending.report.sensor != sensor) {
+        send_previous = take_pending(&previous);
+    }
+    mark_pending(SH_REPORT_STATS);
+    pending.report.sensor = sensor;
+    pending.report.samples = samples;
+    pending.report.temperature = *temperature;
+    pending.report.humidity = *humidity;
+    xSemaphoreGive(lock);
+
+    if (send_previous) {
+        flush_cb(&previous);
+    }
+    if (no_window) {
+        coalescer_flush();
+    }
+}
+
+void coalescer_add_state(sh_actuator_t actuator, bool value, bool immediate)
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+    mark_pending(SH_REPORT_ACTUATORS);
+    pending.report.actuators |= 1 << actuator;
+    if (value) {
+        pending.report.values |= 1 << actuator;
+    } else {
+        pending.report.values &= ~(1 << actuator);
+    }
+    xSemaphoreGive(lock);
+
+    if (immediate || no_window) {
+        coalescer_flush();
+    }
+}
+
+void coalescer_flush(void)
+{
+    sh_frame_t frame;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    bool ready = take_pending(&frame);
+    uint32_t merged_count = merged;
+    xSemaphoreGive(lock);
+
+    if (ready) {
+        ESP_LOGD(TAG, "Flushing report, fields 0x%x, %lu updates merged so far",
+                 frame.report.fields, (unsigned long)merged_count);
+        flush_cb(&frame);
+    }
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "sh_proto.h"
+
+// Łączenie aktualizacji w jedną ramkę SH_MSG_REPORT. Pierwsza aktualizacja otwiera
+// okno o długości window_ms. Kolejne aktualizacje z tego okna trafiają do tej samej
+// ramki. Aktualizacja z flagą immediate wysyła ramkę od razu, razem z
+// oczekującymi polami.
+
+// Wywoływany z gotową ramką (bez nagłówka grupy i numeru sekwencyjnego)
+typedef void (*coalescer_flush_cb_t)(sh_frame_t *frame);
+
+esp_err_t coalescer_init(uint32_t window_ms, coalescer_flush_cb_t cb);
+
+// Statystyki okna raportowania czujnika. Statystyki innego czujnika niż
+// oczekujące najpierw wysyłają oczekującą ramkę.
+void coalescer_add_stats(uint8_t sensor, uint8_t samples, const sh_stats_t *temperature, const sh_stats_t *humidity);
+
+// Stan elementu wykonawczego. Nowszy stan tego samego elementu zastępuje poprzedni.
+void coalescer_add_state(sh_actuator_t actuator, bool value, bool immediate);
+
+// Wysyła oczekującą ramkę, jeśli istnieje
+void coalescer_flush(void);
@@ -0,0 +1,352 @@
+#include "coap_server.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_openthread.h"
+#include "esp_openthread_lock.h"
+#include "openthread/coap.h"
+#include "sh_proto.h"
+#include "state_store.h"
+
+// Bez tej opcji OpenThread nie kończy transakcji powiadomienia CON po pustym ACK
+// i zgłasza jego brak. Opcję ustawia CMakeLists.txt projektu.
+#if !OPENTHREAD_CONFIG_COAP_OBSERVE_API_ENABLE
+#error "CoAP Observe requires OPENTHREAD_CONFIG_COAP_OBSERVE_API_ENABLE"
+#endif
+
+#define TAG "coap_server"
+#define PAYLOAD_MAX_LEN 64
+#define OBSERVE_SEQ_MASK 0xFFFFFF // opcja Observe ma 3 bajty
+
+#if CONFIG_COAP_CON_TEMPERATURE
+#define TEMPERATURE_NOTIFY OT_COAP_TYPE_CONFIRMABLE
+#else
+#define TEMPERATURE_NOTIFY OT_COAP_TYPE_NON_CONFIRMABLE
+#endif
+#if CONFIG_COAP_CON_HUMIDITY
+#define HUMIDITY_NOTIFY OT_COAP_TYPE_CONFIRMABLE
+#else
+#define HUMIDITY_NOTIFY OT_COAP_TYPE_NON_CONFIRMABLE
+#endif
+#if CONFIG_COAP_CON_FAN
+#define FAN_NOTIFY OT_COAP_TYPE_CONFIRMABLE
+#else
+#define FAN_NOTIFY OT_COAP_TYPE_NON_CONFIRMABLE
+#endif
+#if CONFIG_COAP_CON_LIGHT
+#define LIGHT_NOTIFY OT_COAP_TYPE_CONFIRMABLE
+#else
+#define LIGHT_NOTIFY OT_COAP_TYPE_NON_CONFIRMABLE
+#endif
+
+typedef enum {
+    RES_TEMPERATURE,
+    RES_HUMIDITY,
+    RES_FAN,
+    RES_LIGHT,
+    RES_CONFIG,
+    RES_COUNT
+} resource_id_t;
+
+// Klient obserwujący zasób, rozpoznawany po adresie, porcie i tokenie
+typedef struct {
+    bool used;
+    otSockAddr peer;
+    uint8_t token[OT_COAP_MAX_TOKEN_LENGTH];
+    uint8_t token_len;
+    uint8_t generation; // zmienia się przy każdej nowej obserwacji w tym miejscu
+    TickType_t expires;
+} observer_t;
+
+typedef struct {
+    const char *uri;
+    bool observable;
+    otCoapType notify_type;
+    otCoapResource resource;
+    observer_t observers[COAP_MAX_OBSERVERS];
+    uint32_t observe_seq;
+} resource_t;
+
+static resource_t resources[RES_COUNT] = {
+    [RES_TEMPERATURE] = { SH_COAP_URI_TEMPERATURE, true, TEMPERATURE_NOTIFY },
+    [RES_HUMIDITY]    = { SH_COAP_URI_HUMIDITY, true, HUMIDITY_NOTIFY },
+    [RES_FAN]         = { SH_COAP_URI_FAN, true, FAN_NOTIFY },
+    [RES_LIGHT]       = { SH_COAP_URI_LIGHT, true, LIGHT_NOTIFY },
+    [RES_CONFIG]      = { SH_COAP_URI_CONFIG, false, OT_COAP_TYPE_NON_CONFIRMABLE },
+};
+
+static coap_server_config_t node_config;
+static node_state_t notified; // stan z ostatnich powiadomień, chroniony blokadą OpenThread
+static bool started;
+
+// Zapisuje reprezentację zasobu. Zwraca jej długość lub wartość ujemną przy błędzie.
+static int build_payload(resource_id_t id, const node_state_t *state, uint8_t *buf, size_t buf_len)
+{
+    sh_frame_t frame = {
+        .group = node_config.group,
+        .device = node_config.device,
+        .seq = (uint16_t)resources[id].observe_seq,
+    };
+
+    switch (id) {
+    case RES_TEMPERATURE:
+    case RES_HUMIDITY:
+        frame.type = SH_MSG_TELEMETRY;
+        frame.telemetry.sensor = 0;
+        frame.telemetry.temperature = state->temperature;
+        frame.telemetry.humidity = state->humidity;
+        break;
+    case RES_FAN:
+    case RES_LIGHT:
+        frame.type = SH_MSG_STATE;
+        frame.state.actuator = id == RES_FAN ? SH_ACT_FAN : SH_ACT_LIGHT;
+        frame.state.value = state->actuators[frame.state.actuator];
+        break;
+    default:
+        return snprintf((char *)buf, buf_len, "group=%u device=%u sensors=%u period_ms=%lu",
+                        node_config.group, node_config.device, node_config.sensors,
+                        (unsigned long)node_config.sample_period_ms);
+    }
+    return sh_frame_encode(&frame, buf, buf_len);
+}
+
+// Dopisuje opcje i treść odpowiedzi lub powiadomienia
+static otError append_representation(otMessage *message, resource_id_t id, const node_state_t *state, bool observe)
+{
+    uint8_t payload[PAYLOAD_MAX_LEN];
+    int len = build_payload(id, state, payload, sizeof(payload));
+    if (len < 0) {
+        return OT_ERROR_FAILED;
+    }
+
+    // Opcje muszą być dopisywane w kolejności numerów: Observe (6), Content-Format (12)
+    otError error = OT_ERROR_NONE;
+    if (observe) {
+        error = otCoapMessageAppendObserveOption(message, resources[id].observe_seq & OBSERVE_SEQ_MASK);
+    }
+    if (error == OT_ERROR_NONE) {
+        error = otCoapMessageAppendContentFormatOption(message, id == RES_CONFIG ?
+                                                      OT_COAP_OPTION_CONTENT_FORMAT_TEXT_PLAIN :
+                                                      OT_COAP_OPTION_CONTENT_FORMAT_OCTET_STREAM);
+    }
+    if (error == OT_ERROR_NONE) {
+        error = otCoapMessageSetPayloadMarker(message);
+    }
+    if (error == OT_ERROR_NONE) {
+        error = otMessageAppend(message, payload, len);
+    }
+    return error;
+}
+
+static bool same_peer(const observer_t *observer, const otMessageInfo *info)
+{
+    return observer->used && observer->peer.mPort == info->mPeerPort &&
+           memcmp(&observer->peer.mAddress, &info->mPeerAddr, sizeof(otIp6Address)) == 0;
+}
+
+// Rejestruje lub odnawia obserwację. Zwraca false, gdy brak miejsca.
+static bool add_observer(resource_t *res, const otMessage *request, const otMessageInfo *info)
+{
+    observer_t *slot = NULL;
+    for (int i = 0; i < COAP_MAX_OBSERVERS; i++) {
+        if (same_peer(&res->observers[i], info)) {
+            slot = &res->observers[i];
+            break;
+        }
+        if (!res->observers[i].used && slot == NULL) {
+            slot = &res->observers[i];
+        }
+    }
+    if (slot == NULL) {
+        ESP_LOGW(TAG, "No room for another observer of %s", res->uri);
+        return false;
+    }
+
+    if (!slot->used) {
+        slot->generation++;
+    }
+    slot->used = true;
+    slot->peer.mAddress = info->mPeerAddr;
+    slot->peer.mPort = info->mPeerPort;
+    slot->token_len = otCoapMessageGetTokenLength(request);
+    memcpy(slot->token, otCoapMessageGetToken(request), slot->token_len);
+    slot->expires = xTaskGetTickCount() + pdMS_TO_TICKS(SH_COAP_OBSERVE_LEASE_S * 1000);
+    return true;
+}
+
+static void remove_observer(resource_t *res, const otMessageInfo *info)
+{
+    for (int i = 0; i < COAP_MAX_OBSERVERS; i++) {
+        if (same_peer(&res->observers[i], info)) {
+            res->observers[i].used = false;
+        }
+    }
+}
+
+// Obsługa GET zasobu. Wywoływana w pętli OpenThread z założoną blokadą.
+static void handle_request(void *context, otMessage *request, const otMessageInfo *info)
+{
+    resource_id_t id = (resource_id_t)(intptr_t)context;
+    resource_t *res = &resources[id];
+    otInstance *instance = esp_openthread_get_instance();
+    otCoapCode code = OT_COAP_CODE_CONTENT;
+    bool observing = false;
+
+    if (otCoapMessageGetCode(request) != OT_COAP_CODE_GET) {
+        code = OT_COAP_CODE_METHOD_NOT_ALLOWED;
+    } else if (res->observable) {
+        otCoapOptionIterator iterator;
+        uint64_t observe;
+        if (otCoapOptionIteratorInit(&iterator, request) == OT_ERROR_NONE &&
+            otCoapOptionIteratorGetFirstOptionMatching(&iterator, OT_COAP_OPTION_OBSERVE) != NULL &&
+            otCoapOptionIteratorGetOptionUintValue(&iterator, &observe) == OT_ERROR_NONE) {
+            if (observe == 0) {
+                observing = add_observer(res, request, info);
+            } else {
+                remove_observer(res, info);
+            }
+        }
+    }
+
+    otMessage *response = otCoapNewMessage(instance, NULL);
+    if (response == NULL) {
+        ESP_LOGW(TAG, "No buffer for %s response", res->uri);
+        return;
+    }
+    // Na CON odpowiedź dołączona do ACK, na NON (także multicast) odpowiedź NON
+    otCoapType type = otCoapMessageGetType(request) == OT_COAP_TYPE_CONFIRMABLE ?
+                      OT_COAP_TYPE_ACKNOWLEDGMENT : OT_COAP_TYPE_NON_CONFIRMABLE;
+    otError error = otCoapMessageInitResponse(response, request, type, code);
+    if (error == OT_ERROR_NONE && code == OT_COAP_CODE_CONTENT) {
+        node_state_t state;
+        state_store_read(&state);
+        error = append_representation(response, id, &state, observing);
+    }
+    if (error == OT_ERROR_NONE) {
+        error = otCoapSendResponse(instance, response, info);
+    }
+    if (error != OT_ERROR_NONE) {
+        ESP_LOGW(TAG, "Failed to respond on %s, error: %d", res->uri, error);
+        otMessageFree(response);
+    }
+}
+
+// Kontekst potwierdzenia powiadomienia: zasób, miejsce obserwatora i jego generacja
+#define NOTIFY_CONTEXT(id, slot, generation) ((void *)(intptr_t)(((id) << 16) | ((slot) << 8) | (generation)))
+
+// Wynik powiadomienia CON. RST albo brak ACK po wszystkich retransmisjach kończy
+// obserwację (RFC 7641, 4.5). Wywoływana w pętli OpenThread.
+static void on_notify_result(void *context, otMessage *message, const otMessageInfo *info, otError result)
+{
+    intptr_t value = (intptr_t)context;
+    resource_t *res = &resources[value >> 16];
+    observer_t *observer = &res->observers[(value >> 8) & 0xFF];
+
+    if (result == OT_ERROR_NONE || !observer->used || observer->generation != (uint8_t)value) {
+        return;
+    }
+    observer->used = false;
+    ESP_LOGI(TAG, "Observer of %s removed, notification error: %d", res->uri, result);
+}
+
+// Wysyła powiadomienie do wszystkich obserwatorów zasobu. Wymaga blokady stosu.
+// Obserwator, który nie odpowiada na powiadomienia NON, znika po wygaśnięciu obserwacji.
+static void notify_resource(otInstance *instance, resource_id_t id, const node_state_t *state)
+{
+    resource_t *res = &resources[id];
+    TickType_t now = xTaskGetTickCount();
+    res->observe_seq++;
+
+    for (int i = 0; i < COAP_MAX_OBSERVERS; i++) {
+        observer_t *observer = &res->observers[i];
+        if (!observer->used) {
+            continue;
+        }
+        if ((int32_t)(now - observer->expires) >= 0) {
+            observer->used = false;
+            ESP_LOGI(TAG, "Observation of %s expired", res->uri);
+            continue;
+        }
+
+        otMessage *message = otCoapNewMessage(instance, NULL);
+        if (message == NULL) {
+            ESP_LOGW(TAG, "No buffer for %s notification", res->uri);
+            return;
+        }
+        otCoapMessageInit(message, res->notify_type, OT_COAP_CODE_CONTENT);
+        otError error = otCoapMessageSetToken(message, observer->token, observer->token_len);
+        if (error == OT_ERROR_NONE) {
+            error = append_representation(message, id, state, true);
+        }
+        if (error == OT_ERROR_NONE) {
+            otMessageInfo info;
+            memset(&info, 0, sizeof(info));
+            info.mPeerAddr = observer->peer.mAddress;
+            info.mPeerPort = observer->peer.mPort;
+            bool confirmable = res->notify_type == OT_COAP_TYPE_CONFIRMABLE;
+            error = otCoapSendRequest(instance, message, &info, confirmable ? on_notify_result : NULL,
+                                      NOTIFY_CONTEXT(id, i, observer->generation));
+        }
+        if (error != OT_ERROR_NONE) {
+            ESP_LOGW(TAG, "Failed to notify %s, error: %d", res->uri, error);
+            otMessageFree(message);
+        }
+    }
+}
+
+esp_err_t coap_server_start(const coap_server_config_t *config)
+{
+    node_config = *config;
+    state_store_read(&notified);
+
+    esp_openthread_lock_acquire(portMAX_DELAY);
+    otInstance *instance = esp_openthread_get_instance();
+    otError error = otCoapStart(instance, OT_DEFAULT_COAP_PORT);
+    if (error == OT_ERROR_NONE) {
+        for (int id = 0; id < RES_COUNT; id++) {
+            resources[id].resource.mUriPath = resources[id].uri;
+            resources[id].resource.mHandler = handle_request;
+            resources[id].resource.mContext = (void *)(intptr_t)id;
+            otCoapAddResource(instance, &resources[id].resource);
+        }
+        started = true;
+    }
+    esp_openthread_lock_release();
+
+    if (error != OT_ERROR_NONE) {
+        ESP_LOGE(TAG, "Failed to start CoAP, error: %d", error);
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "CoAP server started on port %d", OT_DEFAULT_COAP_PORT);
+    return ESP_OK;
+}
+
+void coap_server_notify_changes(void)
+{
+    if (!started) {
+        return;
+    }
+    node_state_t state;
+    state_store_read(&state);
+
+    esp_openthread_lock_acquire(portMAX_DELAY);
+    otInstance *instance = esp_openthread_get_instance();
+    if (state.temperature != notified.temperature) {
+        notify_resource(instance, RES_TEMPERATURE, &state);
+    }
+    if (state.humidity != notified.humidity) {
+        notify_resource(instance, RES_HUMIDITY, &state);
+    }
+    if (state.actuators[SH_ACT_FAN] != notified.actuators[SH_ACT_FAN]) {
+        notify_resource(instance, RES_FAN, &state);
+    }
+    if (state.actuators[SH_ACT_LIGHT] != notified.actuators[SH_ACT_LIGHT]) {
+        notify_resource(instance, RES_LIGHT, &state);
+    }
+    notified = state;
+    esp_openthread_lock_release();
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+// Serwer CoAP węzła z obserwacją zasobów (RFC 7641). Zasoby opisuje sh_proto.h:
+//
+//  temperature, humidity  SH_MSG_TELEMETRY czujnika 0, powiadomienie przy zmianie danej wielkości
+//  fan, light             SH_MSG_STATE elementu wykonawczego
+//  config                 tekst z konfiguracją węzła, bez obserwacji
+//
+// Powiadomienia wysyłane są jako CON lub NON zależnie od konfiguracji zasobu. Obserwacja
+// kończy się po SH_COAP_OBSERVE_LEASE_S bez odnowienia albo gdy obserwator odrzuci
+// powiadomienie CON lub go nie potwierdzi. Wymaga OPENTHREAD_CONFIG_COAP_OBSERVE_API_ENABLE.
+
+#define COAP_MAX_OBSERVERS 2 // obserwatorów na zasób
+
+typedef struct {
+    uint8_t group;
+    uint8_t device;
+    uint8_t sensors;
+    uint32_t sample_period_ms;
+} coap_server_config_t;
+
+// Uruchamia serwer. Wywoływać po starcie stosu OpenThread.
+esp_err_t coap_server_start(const coap_server_config_t *config);
+
+// Porównuje bieżący stan węzła z ostatnio zgłoszonym i powiadamia obserwatorów
+// zmienionych zasobów. Przed coap_server_start() nic nie robi.
+void coap_server_notify_changes(void);
@@ -0,0 +1,33 @@
+#include "debounce.h"
+
+void debounce_init(debounce_t *debounce, bool level)
+{
+    debounce->locked = false;
+    debounce->stable_level = level;
+    debounce->edge_us = 0;
+}
+
+bool debounce_update(debounce_t *debounce, bool level)
+{
+    bool pressed = level && !debounce->stable_level;
+    debounce->stable_level = level;
+    return pressed;
+}
+
+bool debounce_edge(debounce_t *debounce, bool level, int64_t now_us, bool *pressed)
+{
+    if (debounce->locked) {
+        return false;
+    }
+    debounce->locked = true;
+    debounce->edge_us = now_us;
+    *pressed = debounce_update(debounce, level);
+    return true;
+}
+
+bool debounce_window_end(debounce_t *debounce, bool level)
+{
+    bool pressed = debounce_update(debounce, level);
+    debounce->locked = false;
+    return pressed;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Odbijanie styków przycisku, niezależne od sprzętu. Pierwsze zbocze po okresie
+// spokoju jest przyjmowane od razu i otwiera okno, kolejne są ignorowane do jego
+// końca. Na końcu okna poziom jest odczytywany ponownie, więc krótkie naciśnięcia
+// nie giną, a drgania styków nie dają wielu zdarzeń. Odmierzanie okna należy do
+// wywołującego (w węźle timer FreeRTOS).
+
+typedef struct {
+    volatile bool locked; // trwa okno odbijania styków
+    bool stable_level;    // ostatni ustabilizowany poziom
+    int64_t edge_us;      // czas zbocza, które otworzyło okno
+} debounce_t;
+
+void debounce_init(debounce_t *debounce, bool level);
+
+// Przyjmuje nowy poziom wejścia. Zwraca true, gdy oznacza on naciśnięcie
+// (przejście ze stanu niskiego na wysoki).
+bool debounce_update(debounce_t *debounce, bool level);
+
+// Zbocze na wejściu (z przerwania). Zwraca false, gdy trwa okno i zbocze jest pomijane.
+// Inaczej otwiera okno - wywołujący uruchamia jego odmierzanie - i przez *pressed
+// zgłasza, czy poziom z chwili zbocza jest naciśnięciem.
+bool debounce_edge(debounce_t *debounce, bool level, int64_t now_us, bool *pressed);
+
+// Koniec okna z ponownie odczytanym poziomem. Zwraca true przy naciśnięciu,
+// którego zbocze zgubiło się w trakcie drgań.
+bool debounce_window_end(debounce_t *debounce, bool level);
@@ -0,0 +1,130 @@
+#include "dht_capture.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_rom_sys.h"
+#include "dht_decode.h"
+
+#define TAG "dht_capture"
+
+// Cała odpowiedź trwa ok. 5 ms, z zapasem na opóźnienie wybudzenia
+#define DHT_RESPONSE_TIMEOUT_MS 10
+
+static struct {
+    gpio_num_t pin;
+    TaskHandle_t waiter;
+    volatile size_t count;
+    dht_edge_t edges[DHT_DECODE_MAX_EDGES];
+} capture;
+
+static dht_capture_stats_t stats;
+
+static void IRAM_ATTR dht_edge_isr(void *arg)
+{
+    size_t count = capture.count;
+    if (count >= DHT_DECODE_MAX_EDGES) {
+        return;
+    }
+    capture.edges[count].time_us = (uint32_t)esp_timer_get_time();
+    capture.edges[count].level = gpio_get_level(capture.pin);
+    capture.count = count + 1;
+
+    // Ostatnie zbocze opadające po 40. bicie kończy odpowiedź
+    if (count + 1 == DHT_DECODE_RESPONSE_EDGES) {
+        BaseType_t higher_priority_woken = pdFALSE;
+        vTaskNotifyGiveFromISR(capture.waiter, &higher_priority_woken);
+        portYIELD_FROM_ISR(higher_priority_woken);
+    }
+}
+
+static esp_err_t record_result(dht_decode_result_t result)
+{
+    stats.reads++;
+    switch (result) {
+    case DHT_DECODE_OK:
+        stats.ok++;
+        return ESP_OK;
+    case DHT_DECODE_SHORT:
+        stats.timeouts++;
+        break;
+    case DHT_DECODE_TIMING:
+        stats.timing_errors++;
+        break;
+    case DHT_DECODE_CHECKSUM:
+        stats.checksum_errors++;
+        break;
+    }
+    ESP_LOGW(TAG, "Read on GPIO%d failed (%d), %" PRIu32 " of %" PRIu32 " reads ok",
+             capture.pin, result, stats.ok, stats.reads);
+
+    if (result == DHT_DECODE_SHORT) {
+        return ESP_ERR_TIMEOUT;
+    }
+    return result == DHT_DECODE_CHECKSUM ? ESP_ERR_INVALID_CRC : ESP_ERR_INVALID_RESPONSE;
+}
+
+esp_err_t dht_capture_read(dht_sensor_type_t sensor_type, gpio_num_t pin, int16_t *humidity, int16_t *temperature)
+{
+    if (!humidity && !temperature) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t err = gpio_install_isr_service(0);
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+        return err;
+    }
+
+    capture.pin = pin;
+    capture.waiter = xTaskGetCurrentTaskHandle();
+    capture.count = 0;
+    ulTaskNotifyTake(pdTRUE, 0);
+
+    // Faza A: linia w stanie niskim. Zamiast aktywnego czekania z wyłączonymi
+    // przerwaniami zadanie usypia (co najmniej 20 ms, dłużej nie szkodzi).
+    gpio_set_direction(pin, GPIO_MODE_INPUT_OUTPUT_OD);
+    gpio_set_level(pin, 0);
+    if (sensor_type == DHT_TYPE_SI7021) {
+        esp_rom_delay_us(500);
+    } else {
+        vTaskDelay(pdMS_TO_TICKS(20) + 1);
+    }
+
+    gpio_set_intr_type(pin, GPIO_INTR_ANYEDGE);
+    err = gpio_isr_handler_add(pin, dht_edge_isr, NULL);
+    if (err != ESP_OK) {
+        gpio_set_level(pin, 1);
+        return err;
+    }
+    gpio_set_level(pin, 1);
+
+    // Odpowiedź zbierana w przerwaniu, zadanie czeka na komplet zboczy lub limit czasu
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(DHT_RESPONSE_TIMEOUT_MS) + 1);
+    gpio_isr_handler_remove(pin);
+    gpio_set_intr_type(pin, GPIO_INTR_DISABLE);
+
+    return record_result(dht_decode(capture.edges, capture.count, sensor_type, humidity, temperature));
+}
+
+esp_err_t dht_capture_read_float(dht_sensor_type_t sensor_type, gpio_num_t pin, float *humidity, float *temperature)
+{
+    int16_t i_humidity, i_temperature;
+    esp_err_t err = dht_capture_read(sensor_type, pin, humidity ? &i_humidity : NULL,
+                                     temperature ? &i_temperature : NULL);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (humidity) {
+        *humidity = i_humidity / 10.0f;
+    }
+    if (temperature) {
+        *temperature = i_temperature / 10.0f;
+    }
+    return ESP_OK;
+}
+
+void dht_capture_get_stats(dht_capture_stats_t *out)
+{
+    *out = stats;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdint.h>
+#include "driver/gpio.h"
+#include "esp_err.h"
+#include "dht.h"
+
+// Odczyt czujnika DHT bez sekcji krytycznej: impuls startowy to opóźnienie
+// zadania, a odpowiedź rejestrowana jest jako znaczniki czasu zboczy w przerwaniu
+// GPIO i dekodowana przez dht_decode().
+
+typedef struct {
+    uint32_t reads;
+    uint32_t ok;
+    uint32_t timeouts;           // czujnik nie odpowiedział w całości
+    uint32_t timing_errors;
+    uint32_t checksum_errors;
+} dht_capture_stats_t;
+
+// Ten sam kontrakt co dht_read_data(): wartości w dziesiątych częściach.
+// Zwraca ESP_ERR_TIMEOUT, ESP_ERR_INVALID_RESPONSE lub ESP_ERR_INVALID_CRC przy błędzie.
+esp_err_t dht_capture_read(dht_sensor_type_t sensor_type, gpio_num_t pin, int16_t *humidity, int16_t *temperature);
+
+// Wersja zmiennoprzecinkowa, odpowiednik dht_read_float_data()
+esp_err_t dht_capture_read_float(dht_sensor_type_t sensor_type, gpio_num_t pin, float *humidity, float *temperature);
+
+void dht_capture_get_stats(dht_capture_stats_t *stats);
@@ -0,0 +1,66 @@
+#include "dht_decode.h"
+
+// Czas stanu wysokiego bitu: ok. 26-28 us dla "0" i ok. 70 us dla "1"
+#define DHT_BIT_HIGH_MIN_US 8
+#define DHT_BIT_HIGH_MAX_US 100
+#define DHT_BIT_ONE_THRESHOLD_US 48
+// Stan niski przed każdym bitem trwa ok. 50 us
+#define DHT_BIT_LOW_MIN_US 20
+#define DHT_BIT_LOW_MAX_US 100
+
+static int16_t convert_data(dht_sensor_type_t sensor_type, uint8_t msb, uint8_t lsb)
+{
+    if (sensor_type == DHT_TYPE_DHT11) {
+        return msb * 10;
+    }
+    int16_t data = ((msb & 0x7f) << 8) | lsb;
+    return (msb & 0x80) ? -data : data;
+}
+
+dht_decode_result_t dht_decode(const dht_edge_t *edges, size_t count, dht_sensor_type_t sensor_type,
+                               int16_t *humidity, int16_t *temperature)
+{
+    // Indeksy zboczy narastających, po których nastąpiło zbocze opadające
+    size_t rising[DHT_DECODE_MAX_EDGES / 2];
+    size_t pulses = 0;
+
+    for (size_t i = 0; i + 1 < count && pulses < DHT_DECODE_MAX_EDGES / 2; i++) {
+        if (edges[i].level == 1 && edges[i + 1].level == 0) {
+            rising[pulses++] = i;
+        }
+    }
+    if (pulses < DHT_DECODE_BITS) {
+        return DHT_DECODE_SHORT;
+    }
+
+    uint8_t data[DHT_DECODE_BITS / 8] = {0};
+    size_t first = pulses - DHT_DECODE_BITS;
+    for (size_t bit = 0; bit < DHT_DECODE_BITS; bit++) {
+        size_t i = rising[first + bit];
+        uint32_t high_us = edges[i + 1].time_us - edges[i].time_us;
+        if (high_us < DHT_BIT_HIGH_MIN_US || high_us > DHT_BIT_HIGH_MAX_US) {
+            return DHT_DECODE_TIMING;
+        }
+        if (i > 0 && edges[i - 1].level == 0) {
+            uint32_t low_us = edges[i].time_us - edges[i - 1].time_us;
+            if (low_us < DHT_BIT_LOW_MIN_US || low_us > DHT_BIT_LOW_MAX_US) {
+                return DHT_DECODE_TIMING;
+            }
+        }
+        if (high_us > DHT_BIT_ONE_THRESHOLD_US) {
+            data[bit / 8] |= 1 << (7 - bit % 8);
+        }
+    }
+
+    if (data[4] != ((data[0] + data[1] + data[2] + data[3]) & 0xff)) {
+        return DHT_DECODE_CHECKSUM;
+    }
+
+    if (humidity) {
+        *humidity = convert_data(sensor_type, data[0], data[1]);
+    }
+    if (temperature) {
+        *temperature = convert_data(sensor_type, data[2], data[3]);
+    }
+    return DHT_DECODE_OK;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "dht.h"
+
+// Dekodowanie odpowiedzi czujnika DHT z zarejestrowanych zboczy sygnału.
+// Funkcja nie zależy od sprzętu, więc można ją sprawdzać na nagranych przebiegach.
+
+#define DHT_DECODE_BITS 40
+// Odpowiedź: zwolnienie linii, preambuła 80/80 us (3 zbocza) i 40 bitów po dwa zbocza
+#define DHT_DECODE_RESPONSE_EDGES (1 + 3 + 2 * DHT_DECODE_BITS)
+#define DHT_DECODE_MAX_EDGES 96
+
+typedef struct {
+    uint32_t time_us; // znacznik czasu zbocza
+    uint8_t level;    // poziom linii po zboczu
+} dht_edge_t;
+
+typedef enum {
+    DHT_DECODE_OK = 0,
+    DHT_DECODE_SHORT,     // za mało impulsów - czujnik nie odpowiedział w całości
+    DHT_DECODE_TIMING,    // impuls poza tolerancją protokołu
+    DHT_DECODE_CHECKSUM,  // niezgodna suma kontrolna
+} dht_decode_result_t;
+
+// Zamienia ciąg zboczy na wilgotność i temperaturę w dziesiątych częściach
+// (jak dht_read_data()). Wykorzystywane są ostatnie 40 impulsy wysokie, więc
+// zgubione zbocza preambuły nie przeszkadzają w odczycie.
+dht_decode_result_t dht_decode(const dht_edge_t *edges, size_t count, dht_sensor_type_t sensor_type,
+                               int16_t *humidity, int16_t *temperature);
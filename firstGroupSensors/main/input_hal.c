@@ -0,0 +1,39 @@
+#include "input_hal.h"
+
+#include "esp_timer.h"
+
+static bool isr_service_installed = false;
+
+esp_err_t input_hal_config_input(gpio_num_t pin, input_hal_edge_cb_t cb, void *arg)
+{
+    const gpio_config_t io_config = {
+        .pin_bit_mask = 1ULL << pin,
+        .mode = GPIO_MODE_INPUT,
+        .pull_up_en = GPIO_PULLUP_DISABLE,
+        .pull_down_en = GPIO_PULLDOWN_ENABLE,
+        .intr_type = GPIO_INTR_ANYEDGE,
+    };
+    esp_err_t err = gpio_config(&io_config);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    if (!isr_service_installed) {
+        err = gpio_install_isr_service(0);
+        if (err != ESP_OK) {
+            return err;
+        }
+        isr_service_installed = true;
+    }
+    return gpio_isr_handler_add(pin, cb, arg);
+}
+
+int input_hal_get_level(gpio_num_t pin)
+{
+    return gpio_get_level(pin);
+}
+
+int64_t input_hal_now_us(void)
+{
+    return esp_timer_get_time();
+}
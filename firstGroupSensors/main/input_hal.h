@@ -0,0 +1,17 @@
+#pragma once
+
+#include "driver/gpio.h"
+#include "esp_err.h"
+
+// Cienka warstwa nad sterownikiem GPIO używana przez obsługę przycisków.
+// Callback zbocza wywoływany jest z przerwania.
+typedef void (*input_hal_edge_cb_t)(void *arg);
+
+// Konfiguruje pin jako wejście z pull-down i przerwaniem na obu zboczach
+esp_err_t input_hal_config_input(gpio_num_t pin, input_hal_edge_cb_t cb, void *arg);
+
+// Zwraca bieżący poziom wejścia
+int input_hal_get_level(gpio_num_t pin);
+
+// Znacznik czasu w mikrosekundach, bezpieczny w przerwaniu
+int64_t input_hal_now_us(void);
@@ -1,9 +1,11 @@
+#include <stdatomic.h>
 #include <stdio.h>
 #include "driver/gpio.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "dht.h"
 #include "esp_openthread.h"
+#include "esp_openthread_lock.h"
 #include "openthread/udp.h"
 #include "openthread/message.h"
 #include "esp_openthread_netif_glue.h"
@@ -12,12 +14,28 @@
 #include "esp_netif.h"
 #include "nvs_flash.h"
 #include "openthread/thread.h"
+#include "openthread/ip6.h"
 #include "openthread/link.h"
 #include "openthread/platform/radio.h"
 #include "esp_vfs_eventfd.h"
 #include "openthread/logging.h"
 #include "esp_event.h"
 #include "esp_task.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "sh_proto.h"
+#include "button.h"
+#include "actuator.h"
+#include "sensor_window.h"
+#include "sensor_manager.h"
+#include "uplink.h"
+#include "coalescer.h"
+#include "state_store.h"
+#include "rules.h"
+#include "persist.h"
+#include "boot_timing.h"
+#include "coap_server.h"
+#include "sh_latency.h"
 
 #define TAG "firstGroupSensors"
 // outputs
@@ -26,274 +44,323 @@
 
 // inputs
 #define FAN_SWITCH GPIO_NUM_10 // GPIO10 do przycisku 
-#define DHT11_GPIO GPIO_NUM_11 // GPIO11 do DHT11 
 #define LIGHT_SWITCH GPIO_NUM_12 // GPIO11 do Światła 
 
-// próg wilgoci po którym załacza się wentylator
-#define HUMIDITY_THRESHOLD 45
+// Indeksy przycisków w kolejności rejestracji (button_add)
+#define INPUT_FAN_SWITCH 0
+#define INPUT_LIGHT_SWITCH 1
+
+// próg wilgoci (setne części procenta) po którym załacza się wentylator - reguła domyślna
+#define HUMIDITY_THRESHOLD 4500
 
 // Flagi w EventGroup
 // #define LED_EVENT_BIT (1 << 0)
-#define FLAG_HUMIDITY_HIGH (1 << 0)
+#define FLAG_FAN_RULE     (1 << 0) // aktywna reguła automatyki włącza wentylator
 #define FLAG_FAN_SWITCH   (1 << 1)
 #define FLAG_LIGHT_SWITCH (1 << 2)
+#define FLAG_LIGHT_RULE   (1 << 3)
+
+// Flagi zachowywane w NVS - decyzje użytkownika, a nie wynik reguł
+#define PERSISTED_FLAGS (FLAG_FAN_SWITCH | FLAG_LIGHT_SWITCH)
 
-// deklaracja grupy flag
-static EventGroupHandle_t event_group;
+// Tabela elementów wykonawczych - kolejne przekaźniki dodaje się tutaj
+static const actuator_desc_t actuators[] = {
+    {
+        .name = "fan",
+        .id = SH_ACT_FAN,
+        .gpio = FAN_LED_GPIO_OUTPUT,
+        .switch_flag = FLAG_FAN_SWITCH,
+        .override_flags = FLAG_FAN_RULE,
+    },
+    {
+        .name = "light",
+        .id = SH_ACT_LIGHT,
+        .gpio = LIGHT_GPIO_OUTPUT,
+        .switch_flag = FLAG_LIGHT_SWITCH,
+        .override_flags = FLAG_LIGHT_RULE,
+    },
+};
+
+// Flagi, na które działają reguły automatyki, w kolejności sh_actuator_t
+static const rules_actuator_flags_t rule_flags[SH_ACT_COUNT] = {
+    [SH_ACT_LIGHT] = { .switch_flag = FLAG_LIGHT_SWITCH, .rule_flag = FLAG_LIGHT_RULE },
+    [SH_ACT_FAN] = { .switch_flag = FLAG_FAN_SWITCH, .rule_flag = FLAG_FAN_RULE },
+};
+
+// Reguły używane, dopóki w NVS nie ma zapisanej tabeli
+static const sh_rule_t default_rules[] = {
+    {
+        .source = SH_RULE_SENSOR,
+        .input = 0,
+        .quantity = SH_QTY_HUMIDITY,
+        .op = SH_RULE_ABOVE,
+        .threshold = HUMIDITY_THRESHOLD,
+        .hysteresis = CONFIG_RULES_HUMIDITY_HYSTERESIS,
+        .actuator = SH_ACT_FAN,
+    },
+    { .source = SH_RULE_INPUT, .input = INPUT_FAN_SWITCH, .actuator = SH_ACT_FAN },
+    { .source = SH_RULE_INPUT, .input = INPUT_LIGHT_SWITCH, .actuator = SH_ACT_LIGHT },
+};
+
+#if CONFIG_SENSOR1_DHT22
+#define SENSOR1_TYPE DHT_TYPE_AM2301
+#else
+#define SENSOR1_TYPE DHT_TYPE_DHT11
+#endif
+#if CONFIG_SENSOR2_DHT22
+#define SENSOR2_TYPE DHT_TYPE_AM2301
+#else
+#define SENSOR2_TYPE DHT_TYPE_DHT11
+#endif
+#if CONFIG_SENSOR3_DHT22
+#define SENSOR3_TYPE DHT_TYPE_AM2301
+#else
+#define SENSOR3_TYPE DHT_TYPE_DHT11
+#endif
+#if CONFIG_SENSOR4_DHT22
+#define SENSOR4_TYPE DHT_TYPE_AM2301
+#else
+#define SENSOR4_TYPE DHT_TYPE_DHT11
+#endif
 
-// deklaracje do openthread
-static otUdpSocket sUdpSocket;
+// Czujniki temperatury i wilgotności z konfiguracji (menuconfig)
+static const sensor_config_t sensors[] = {
+    { .gpio = CONFIG_SENSOR1_GPIO, .type = SENSOR1_TYPE },
+#if CONFIG_SENSOR_COUNT >= 2
+    { .gpio = CONFIG_SENSOR2_GPIO, .type = SENSOR2_TYPE },
+#endif
+#if CONFIG_SENSOR_COUNT >= 3
+    { .gpio = CONFIG_SENSOR3_GPIO, .type = SENSOR3_TYPE },
+#endif
+#if CONFIG_SENSOR_COUNT >= 4
+    { .gpio = CONFIG_SENSOR4_GPIO, .type = SENSOR4_TYPE },
+#endif
+};
+#define SENSOR_COUNT (sizeof(sensors) / sizeof(sensors[0]))
 
 
-#define THREAD_BROADCAST_ADDRESS "ff03::1"
 #define THREAD_UDP_PORT 12345
 
-typedef struct {
-    float temperature;
-    float humidity;
-    bool fan_state;
-    bool light_state;
-
-} sensor_data;
-
-static sensor_data current_data = {0};
-
-// Funkcja do wysyłania danych UDP
-void udp_send_data(const char *message) {
-    otError error;
-    otMessageInfo messageInfo;
-    otIp6Address  destinationAddr;
-    otInstance *sInstance = esp_openthread_get_instance();
-    if (!sInstance) {
-        ESP_LOGE(TAG, "OpenThread instance not initialized.");
+// Identyfikacja węzła w ramkach sh_proto
+#define GROUP_ID 1
+#define DEVICE_ID 1
+
+// Ramki wysyłają zadania przycisków, pomiarów, łączenia i OpenThread, więc licznik
+// jest atomowy. Po restarcie zaczyna od losowej wartości - licznik od zera trafiłby
+// w okno numerów bramy H2 sprzed restartu i pierwsze ramki byłyby odrzucone jako duplikaty.
+static atomic_uint_fast32_t tx_seq;
+
+// Uzupełnia nagłówek ramki, koduje ją i wysyła
+static void send_frame(sh_frame_t *frame) {
+    uint8_t buf[SH_FRAME_MAX_LEN];
+    frame->group = GROUP_ID;
+    frame->device = DEVICE_ID;
+    frame->seq = (uint16_t)atomic_fetch_add(&tx_seq, 1);
+
+    int len = sh_frame_encode(frame, buf, sizeof(buf));
+    if (len < 0) {
+        ESP_LOGE(TAG, "Failed to encode frame, error: %d", len);
         return;
     }
+    // Zmiany stanów muszą dotrzeć do bramy, pomiary zastępuje kolejny raport
+    bool reliable = frame->type == SH_MSG_STATE ||
+                    (frame->type == SH_MSG_REPORT && (frame->report.fields & SH_REPORT_ACTUATORS));
+    bool sent = uplink_send(buf, len, frame->seq, reliable);
+    if (sent && frame->type == SH_MSG_REPORT && (frame->report.fields & SH_REPORT_STATS)) {
+        boot_timing_mark(BOOT_MARK_FIRST_REPORT);
+    }
+}
 
-    // Sprawdzanie, czy urządzenie jest podłączone do sieci Thread
-    otDeviceRole role = otThreadGetDeviceRole(sInstance);
-    if (role == OT_DEVICE_ROLE_DISABLED || role == OT_DEVICE_ROLE_DETACHED) {
-        ESP_LOGW(TAG, "Device is not in a valid state for sending messages (Role: %d).", role);
-        return;
+// Przekazuje statystyki z okna raportowania do ramki zbiorczej i zapamiętuje
+// wysłane wartości. Zwraca false, gdy okno jest puste.
+static bool send_report(uint8_t sensor, const sensor_window_t *window, sensor_sample_t *reported) {
+    sh_stats_t temperature, humidity;
+    if (!sensor_window_stats(window, &temperature, &humidity)) {
+        return false;
     }
+    coalescer_add_stats(sensor, window->count, &temperature, &humidity);
 
-    memset(&messageInfo, 0, sizeof(messageInfo));
-    otIp6AddressFromString("ff03::1", &destinationAddr);
-    messageInfo.mPeerAddr = destinationAddr;
-    messageInfo.mPeerPort = THREAD_UDP_PORT;
+    reported->temperature = temperature.last;
+    reported->humidity = humidity.last;
+    return true;
+}
 
-    otMessage *msg = otUdpNewMessage(sInstance, NULL);
-    if (msg == NULL) {
-        ESP_LOGE(TAG, "Failed to create message");
-        return;
-    }
+// Zmiana stanu jest widoczna dla użytkownika, więc wysyłana jest od razu
+// razem z oczekującymi pomiarami
+static void send_state(sh_actuator_t actuator, bool value) {
+    coalescer_add_state(actuator, value, true);
+}
 
-    // Tworzenie wiadomości
-    error = otMessageAppend(msg, message, strlen(message));
-    if (error != OT_ERROR_NONE) {
-        ESP_LOGE(TAG, "Failed to append message, error: %d", error);
-        otMessageFree(msg);
-        return;
-    }
+// Polecenia ze śladem czekające na zmianę wyjścia, po jednym na element wykonawczy.
+// Zapisuje je pętla OpenThread, zdejmuje zadanie silnika elementów wykonawczych.
+typedef struct {
+    uint16_t trace; // 0 - brak
+    int64_t received_us;
+} pending_trace_t;
+
+static pending_trace_t pending_traces[SH_ACT_COUNT];
+static portMUX_TYPE trace_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Echo polecenia ze śladem z czasem jego obsługi w węźle. Ramka nie jest
+// potwierdzana - stan i tak dociera do bramy zwykłą ramką stanu.
+static void send_trace(uint8_t actuator, bool value, uint16_t trace, int64_t received_us) {
+    sh_frame_t frame = { .type = SH_MSG_TRACE };
+    frame.trace.trace = trace;
+    frame.trace.actuator = actuator;
+    frame.trace.value = value;
+    frame.trace.node_us = sh_elapsed_us(received_us, esp_timer_get_time());
+    send_frame(&frame);
+}
 
-    // Wysyłanie wiadomości
-    error = otUdpSend(sInstance, &sUdpSocket, msg, &messageInfo);
-    if (error != OT_ERROR_NONE) {
-        ESP_LOGE(TAG, "Failed to send message, error: %d", error);
-    } else {
-        ESP_LOGI(TAG, "Message sent via Thread: %s", message);
+// Polecenie, które nie zmieni wyjścia, dostaje echo od razu. Pozostałe czekają
+// na on_actuator_change(). Wywoływać przed zmianą flag silnika.
+static void begin_trace(uint8_t actuator, bool value, uint16_t trace, int64_t received_us) {
+    node_state_t state;
+    state_store_read(&state);
+    if (state.actuators[actuator] == value) {
+        send_trace(actuator, value, trace, received_us);
+        return;
     }
+    portENTER_CRITICAL(&trace_lock);
+    pending_traces[actuator].trace = trace;
+    pending_traces[actuator].received_us = received_us;
+    portEXIT_CRITICAL(&trace_lock);
 }
 
 // Callback do odbioru danych
 static void udp_receive_callback(void *aContext, otMessage *aMessage, const otMessageInfo *aMessageInfo)
 {
-    char buffer[128]; // Bufor na odebrane dane
-    int length = otMessageRead(aMessage, otMessageGetOffset(aMessage), buffer, sizeof(buffer) - 1);
-    if (length > 0) {
-        buffer[length] = '\0'; // Dodaj zakończenie ciągu znaków
-        ESP_LOGI(TAG, "Received message via Thread: %s", buffer);
-
-        EventBits_t flags = xEventGroupGetBits(event_group);
-        // Szukanie "light_state"
-        if (strstr(buffer, "light_state")) {
-            if (strstr(buffer, "light_state: on")) {
-                current_data.light_state = 1; // Ustawienie na 1, jeśli "on"
-                    xEventGroupSetBits(event_group, FLAG_LIGHT_SWITCH);
-            } else if (strstr(buffer, "light_state: off")) {
-                xEventGroupClearBits(event_group, FLAG_LIGHT_SWITCH);  // Wyłącz flagę
-                current_data.light_state = 0; // Ustawienie na 0, jeśli "off"
-            }
-
-        // Szukanie "fan_state"
-        } else if (strstr(buffer, "fan_state")) {
-            if (strstr(buffer, "fan_state: on")) {
-                current_data.fan_state = 1; // Ustawienie na 1, jeśli "on"
-                if(!(flags & FLAG_HUMIDITY_HIGH)){
-                    xEventGroupSetBits(event_group, FLAG_FAN_SWITCH);
-                }
-            } else if (strstr(buffer, "fan_state: off")) {
-                xEventGroupClearBits(event_group, FLAG_FAN_SWITCH);
-                current_data.fan_state = 0; // Ustawienie na 0, jeśli "off"
-            }
-        }
-    } else {
-        ESP_LOGW(TAG, "Failed to read UDP message.");
+    uint8_t buffer[SH_FRAME_MAX_LEN]; // Bufor na odebrane dane
+    int64_t received_us = esp_timer_get_time();
+    sh_frame_t frame;
+    int length = otMessageRead(aMessage, otMessageGetOffset(aMessage), buffer, sizeof(buffer));
+    int err = sh_frame_decode(buffer, length, &frame);
+    if (err < 0) {
+        ESP_LOGW(TAG, "Failed to decode UDP message, error: %d", err);
+        return;
     }
-}
-
-
-
-// Task do odczytu danych z DHT11
-void dht11_task(void *pvParameter){
-    int usun = 0;
-    static bool last_humidity_high_flag = false; // Zapamiętaj poprzedni stan flagi FLAG_HUMIDITY_HIGH
-    static bool current_humidity_high_flag = false;
-    while(1){
-        usun++; 
-        float temperature = 0, humidity = 0;
-        
-
-        if (dht_read_float_data(DHT_TYPE_DHT11, DHT11_GPIO, &humidity, &temperature) == ESP_OK) {
-            current_data.temperature = temperature;
-            current_data.humidity = humidity;
-
-            if (humidity > HUMIDITY_THRESHOLD) {
-                xEventGroupSetBits(event_group, FLAG_HUMIDITY_HIGH);
-                current_humidity_high_flag = true;
-
-                // Wysyłanie wiadomości przy zmianie FLAG_HUMIDITY_HIGH z 0 na 1
-                if (!last_humidity_high_flag & current_humidity_high_flag) {
-                    char message[128];
-                    snprintf(message, sizeof(message),
-                        "{temperature: %.2f, humidity: %.2f}",
-                        current_data.temperature, current_data.humidity);
-                    udp_send_data(message);
-                }
-                last_humidity_high_flag = current_humidity_high_flag;
-            } else {
-                xEventGroupClearBits(event_group, FLAG_HUMIDITY_HIGH);
-                current_humidity_high_flag = false;
-            }
-        }
-        if(usun == 10){
-            EventBits_t flags = xEventGroupGetBits(event_group);
-            usun = 0;
-        }
-        last_humidity_high_flag = current_humidity_high_flag;
-        vTaskDelay(pdMS_TO_TICKS(1000)); 
+    if (frame.type == SH_MSG_ACK && frame.group == GROUP_ID && frame.device == DEVICE_ID) {
+        uplink_handle_ack(frame.ack.seq);
+        return;
+    }
+    if (frame.group != GROUP_ID && frame.group != SH_GROUP_ALL) {
+        return;
+    }
+    if (frame.type == SH_MSG_RULE) {
+        ESP_LOGI(TAG, "Received rule %d via Thread", frame.rule.index);
+        rules_set(frame.rule.index, &frame.rule.rule);
+        return;
+    }
+    if (frame.type != SH_MSG_COMMAND) {
+        return;
+    }
+    ESP_LOGI(TAG, "Received command via Thread: actuator %d, value %d, trace %u", frame.state.actuator,
+             frame.state.value, frame.state.trace);
+    if (frame.state.trace != 0) {
+        begin_trace(frame.state.actuator, frame.state.value, frame.state.trace, received_us);
     }
-}
-
-// Task do obsługi przycisku
-void fan_switch_task(void *pvParameter) {
-    gpio_set_direction(FAN_SWITCH, GPIO_MODE_INPUT);
-    gpio_set_pull_mode(FAN_SWITCH, GPIO_PULLDOWN_ONLY);
-
-    static bool last_button_state = false; // Ostatni stan przycisku
-    bool current_button_state;             // Aktualny stan przycisku
-
-    while (1) {
-        current_button_state = gpio_get_level(FAN_SWITCH);  // Odczytaj stan przycisku
-
-        // Sprawdzenie, czy przycisk został naciśnięty (przechodzi ze stanu LOW na HIGH)
-        if (current_button_state && !last_button_state) {
-
-            EventBits_t flags = xEventGroupGetBits(event_group);
-            if (flags & FLAG_FAN_SWITCH) {
-                xEventGroupClearBits(event_group, FLAG_FAN_SWITCH);  // Wyłącz flagę
-
-            } else {
-                xEventGroupSetBits(event_group, FLAG_FAN_SWITCH);  // Włącz flagę
-            }
-        }
-
-        last_button_state = current_button_state;  // Zapamiętanie stanu przycisku
-        vTaskDelay(pdMS_TO_TICKS(30));  // Debouncing (opóźnienie 50ms)
-        }
-}
-
-// Task do sterowania diodą LED
-void fan_task(void *pvParameter) {
-    gpio_set_direction(FAN_LED_GPIO_OUTPUT, GPIO_MODE_OUTPUT);
-    static bool last_fan_state = false;
-
-    while (1) {
-        EventBits_t flags = xEventGroupGetBits(event_group);
-
-        // Tworzenie wiadomości
-        char message[128];
-
 
-        if (flags & FLAG_FAN_SWITCH || flags & FLAG_HUMIDITY_HIGH) {
-            current_data.fan_state = true;
-            gpio_set_level(FAN_LED_GPIO_OUTPUT, 1); 
+    EventBits_t flags = actuator_flags_get();
+    if (frame.state.actuator == SH_ACT_LIGHT) {
+        if (frame.state.value) {
+            actuator_flags_set(FLAG_LIGHT_SWITCH);
         } else {
-            current_data.fan_state = false;
-            gpio_set_level(FAN_LED_GPIO_OUTPUT, 0);
+            actuator_flags_clear(FLAG_LIGHT_SWITCH);  // Wyłącz flagę
         }
-        if(current_data.fan_state != last_fan_state){
-            snprintf(message, sizeof(message),
-                    "{fan_state: %d}", current_data.fan_state);
-            udp_send_data(message);
-            last_fan_state = current_data.fan_state;
+    } else if (frame.state.actuator == SH_ACT_FAN) {
+        if (frame.state.value) {
+            if(!(flags & FLAG_FAN_RULE)){
+                actuator_flags_set(FLAG_FAN_SWITCH);
+            }
+        } else {
+            actuator_flags_clear(FLAG_FAN_SWITCH);
         }
-
-        vTaskDelay(pdMS_TO_TICKS(100)); // Małe opóźnienie
     }
 }
 
-// Task do obsługi wejścia LIGHT_SWITCH
-void light_switch_task(void *pvParameter) {
-    gpio_set_direction(LIGHT_SWITCH, GPIO_MODE_INPUT);
-    gpio_set_pull_mode(LIGHT_SWITCH, GPIO_PULLDOWN_ONLY);
 
-    static bool last_light_input_state = false;
-    bool current_light_input_state;
 
-    while (1) {
-        current_light_input_state = gpio_get_level(LIGHT_SWITCH);
+// Stan raportowania jednego czujnika
+typedef struct {
+    sensor_window_t window;
+    sensor_sample_t reported;
+    bool report_pending;
+    TickType_t last_report;
+} sensor_report_t;
+
+static sensor_report_t reports[SENSOR_MAX];
+static uint32_t report_requests; // bit (1 << czujnik) - raport przy najbliższej próbce
+
+// Próbka z menedżera czujników. Trafia do okna raportowania danego czujnika, a raport
+// wysyłany jest przy zmianie większej niż strefa nieczułości lub po maksymalnym czasie ciszy.
+// Próbka trafia też do reguł automatyki.
+static void on_sensor_sample(uint8_t index, float temperature, float humidity) {
+    const sensor_sample_t deadband = {
+        .temperature = CONFIG_REPORT_TEMPERATURE_DEADBAND,
+        .humidity = CONFIG_REPORT_HUMIDITY_DEADBAND,
+    };
+    sensor_report_t *report = &reports[index];
+
+    sensor_sample_t sample = {
+        .temperature = sh_to_centi(temperature),
+        .humidity = sh_to_centi(humidity),
+    };
+    sensor_window_push(&report->window, sample);
+    if (sensor_window_exceeds_deadband(&report->reported, &sample, &deadband)) {
+        report->report_pending = true;
+    }
+    if (__atomic_fetch_and(&report_requests, ~(1UL << index), __ATOMIC_RELAXED) & (1UL << index)) {
+        report->report_pending = true;
+    }
 
-        if (current_light_input_state && !last_light_input_state) {
-            current_data.light_state = current_light_input_state;
+    if (index == 0) {
+        state_store_set_climate(sample.temperature, sample.humidity);
+        coap_server_notify_changes();
+    }
 
-            EventBits_t flags = xEventGroupGetBits(event_group);
+    // Raport przy zmianie decyzji reguł, aby było widać, co ją spowodowało
+    bool rules_changed = rules_on_sample(index, sample.temperature, sample.humidity);
+    if (rules_changed) {
+        report->report_pending = true;
+    }
 
-            if (flags & FLAG_LIGHT_SWITCH) {
-                xEventGroupClearBits(event_group, FLAG_LIGHT_SWITCH);
-            } else {
-                xEventGroupSetBits(event_group, FLAG_LIGHT_SWITCH);
-            }
-        }
+    if (xTaskGetTickCount() - report->last_report >= pdMS_TO_TICKS(CONFIG_REPORT_HEARTBEAT_S * 1000)) {
+        report->report_pending = true;
+    }
+    if (report->report_pending && send_report(index, &report->window, &report->reported)) {
+        sensor_window_reset(&report->window);
+        report->last_report = xTaskGetTickCount();
+        report->report_pending = false;
+    }
 
-        last_light_input_state = current_light_input_state;
-        vTaskDelay(pdMS_TO_TICKS(30)); // Debouncing
+    // Flagi ustawiane po raporcie, aby zmiana stanu elementu trafiła do tej samej ramki
+    if (rules_changed) {
+        rules_apply();
     }
 }
 
-// Task do sterowania diodą LED (LIGHT_GPIO_OUTPUT)
-void light_task(void *pvParameter) {
-    gpio_set_direction(LIGHT_GPIO_OUTPUT, GPIO_MODE_OUTPUT);
-    static bool last_light_state = false;
-    while (1) {
-        EventBits_t flags = xEventGroupGetBits(event_group);
-        char message[128];
-
-        if (flags & FLAG_LIGHT_SWITCH) {
-            current_data.light_state = true;
-            gpio_set_level(LIGHT_GPIO_OUTPUT, 1);
-        } else {
-            current_data.light_state = false;
-            gpio_set_level(LIGHT_GPIO_OUTPUT, 0);
-        }
+// Obsługa naciśnięcia przycisku - działanie określają reguły wejść
+static void on_button_press(int button, void *ctx) {
+    rules_on_input(button);
+}
 
-        if(current_data.light_state != last_light_state){
-            snprintf(message, sizeof(message),
-                    "{light_state: %d}", current_data.light_state);
-            udp_send_data(message);
-            last_light_state = current_data.light_state;
-        }
+// Zmiana flag silnika - stan przełączników trafia do NVS z opóźnieniem
+static void on_actuator_flags(EventBits_t flags) {
+    persist_store_switches(flags & PERSISTED_FLAGS);
+}
 
-        vTaskDelay(pdMS_TO_TICKS(100)); // Małe opóźnienie
+// Zmiana stanu wyjścia zgłoszona przez silnik elementów wykonawczych
+static void on_actuator_change(const actuator_desc_t *actuator, bool on) {
+    state_store_set_actuator(actuator->id, on);
+    send_state(actuator->id, on);
+    coap_server_notify_changes();
+
+    portENTER_CRITICAL(&trace_lock);
+    pending_trace_t pending = pending_traces[actuator->id];
+    pending_traces[actuator->id].trace = 0;
+    portEXIT_CRITICAL(&trace_lock);
+    if (pending.trace != 0) {
+        send_trace(actuator->id, on, pending.trace, pending.received_us);
     }
 }
 
@@ -306,6 +373,27 @@ static void configure_ot_network(otInstance *instance) {
     ESP_LOGI(TAG, "Thread network configured as End Device.");
 }
 
+// Po dołączeniu do sieci brama dostaje od razu bieżące pomiary i stany wyjść.
+// Ramki wysłane przed dołączeniem (np. stan odtworzony po restarcie) przepadły.
+static void on_thread_state_changed(otChangedFlags flags, void *context) {
+    static bool attached = false;
+    if (!(flags & OT_CHANGED_THREAD_ROLE)) {
+        return;
+    }
+    otDeviceRole role = otThreadGetDeviceRole(esp_openthread_get_instance());
+    bool now_attached = role == OT_DEVICE_ROLE_CHILD || role == OT_DEVICE_ROLE_ROUTER || role == OT_DEVICE_ROLE_LEADER;
+    if (now_attached && !attached) {
+        node_state_t state;
+        boot_timing_mark(BOOT_MARK_ATTACHED);
+        __atomic_store_n(&report_requests, UINT32_MAX, __ATOMIC_RELAXED);
+        state_store_read(&state);
+        for (int actuator = 0; actuator < SH_ACT_COUNT; actuator++) {
+            coalescer_add_state(actuator, state.actuators[actuator], false);
+        }
+    }
+    attached = now_attached;
+}
+
 // Funkcja inicjalizująca OpenThread i sieć
 static esp_netif_t *init_ot_netif(const esp_openthread_platform_config_t *config) {
     esp_netif_config_t cfg = ESP_NETIF_DEFAULT_OPENTHREAD();
@@ -332,6 +420,7 @@ static void ot_task_worker(void *pvParameter)
 #if CONFIG_OPENTHREAD_LOG_LEVEL_DYNAMIC
     (void)otLoggingSetLevel(CONFIG_LOG_DEFAULT_LEVEL);
 #endif
+    otSetStateChangedCallback(esp_openthread_get_instance(), on_thread_state_changed, NULL);
 
     esp_netif_t *openthread_netif;
     openthread_netif = init_ot_netif(&config);
@@ -353,6 +442,7 @@ static void ot_task_worker(void *pvParameter)
 // Task do wypisywania statusu urządzenia co 5 sekund
 static void device_status_task(void *arg)
 {
+    uint32_t logged_version = UINT32_MAX;
     while (1)
     {
         otInstance *instance = esp_openthread_get_instance();
@@ -379,7 +469,23 @@ static void device_status_task(void *arg)
                 break;
             }
 
+            uplink_stats_t stats;
+            uplink_get_stats(&stats);
             ESP_LOGI(TAG, "Device role: %s", role_str);
+            ESP_LOGI(TAG, "Uplink: %lu unicast, %lu multicast, %lu errors, %lu retransmits, %lu acked, %lu expired",
+                     (unsigned long)stats.unicast, (unsigned long)stats.multicast, (unsigned long)stats.send_errors,
+                     (unsigned long)stats.retransmits, (unsigned long)stats.acked, (unsigned long)stats.expired);
+
+            // Stan wypisywany tylko, gdy zmienił się od poprzedniego wpisu
+            if (state_store_version() != logged_version) {
+                node_state_t state;
+                char temperature[10], humidity[10];
+                logged_version = state_store_read(&state);
+                sh_format_centi(state.temperature, temperature, sizeof(temperature));
+                sh_format_centi(state.humidity, humidity, sizeof(humidity));
+                ESP_LOGI(TAG, "State: temperature %s, humidity %s, fan %s, light %s", temperature, humidity,
+                         state.actuators[SH_ACT_FAN] ? "on" : "off", state.actuators[SH_ACT_LIGHT] ? "on" : "off");
+            }
         }
         else
         {
@@ -393,61 +499,37 @@ static void device_status_task(void *arg)
 ////////////////////////////
 // Wysylanie danych po UDP
 
-// Funkcja do inicjalizacji gniazda UDP
-void initUdp(void) {
-    otSockAddr dest_addr;
-    otError error;
-    otInstance *sInstance;
-
-    sInstance = esp_openthread_get_instance();
-    if (sInstance == NULL) {
-        ESP_LOGE(TAG, "OpenThread instance not initialized.");
-        return;
-    }
-
-    // Ustawienia gniazda
-    memset(&sUdpSocket, 0, sizeof(sUdpSocket));
-    memset(&dest_addr, 0, sizeof(dest_addr));
-    dest_addr.mPort = THREAD_UDP_PORT;  // Przykładowy port odbiorcy
-    // otIp6AddressFromString("fd00::1", &dest_addr.mAddress); // Adres urządzenia odbierającego
-    otIp6AddressFromString("::", &dest_addr.mAddress);
-
-
-    // Tworzenie gniazda UDP
-    error = otUdpOpen(sInstance, &sUdpSocket, udp_receive_callback, NULL);
-    if (error != OT_ERROR_NONE) {
-        ESP_LOGE(TAG, "Failed to open UDP socket, error: %d", error);
-        return;
-    }
-
-    // Przypisanie portu
-    error = otUdpBind(sInstance, &sUdpSocket, &dest_addr, OT_NETIF_THREAD);
-    if (error != OT_ERROR_NONE) {
-        ESP_LOGE(TAG, "Failed to bind UDP socket, error: %d", error);
-        return;
+// Dołącza do adresów multicast własnej grupy i wszystkich grup, na które brama
+// wysyła polecenia. Polecenia dla innych grup nie docierają do aplikacji.
+static void subscribe_group_multicast(void) {
+    const uint8_t groups[] = { GROUP_ID, SH_GROUP_ALL };
+    otInstance *instance = esp_openthread_get_instance();
+
+    esp_openthread_lock_acquire(portMAX_DELAY);
+    for (size_t i = 0; i < sizeof(groups); i++) {
+        otIp6Address address;
+        sh_group_multicast_addr(groups[i], address.mFields.m8);
+        otError error = otIp6SubscribeMulticastAddress(instance, &address);
+        if (error != OT_ERROR_NONE && error != OT_ERROR_ALREADY) {
+            ESP_LOGE(TAG, "Failed to subscribe group %d multicast, error: %d", groups[i], error);
+        }
     }
-
-    ESP_LOGI(TAG, "UDP socket initialized.");
+    esp_openthread_lock_release();
 }
 
-
-
-// Task do wysyłania danych po UDP
+// Task do inicjalizacji gniazda UDP. Raporty wysyła menedżer czujników.
 void udp_send_task(void *pvParameter) {
-    initUdp(); // Inicjalizacja gniazda UDP
-
-    while (1) {
-        otInstance *sInstance = esp_openthread_get_instance();
-        // Tworzenie wiadomości
-        char message[128];
-        snprintf(message, sizeof(message),
-                 "{temperature: %.2f, humidity: %.2f}",
-                 current_data.temperature, current_data.humidity);
-
-        // Wysyłanie wiadomości
-        udp_send_data(message);
-        vTaskDelay(pdMS_TO_TICKS(120000)); // Wysyłanie co 120 sekundy
-    }
+    uplink_init(THREAD_UDP_PORT, udp_receive_callback); // Inicjalizacja gniazda UDP
+    subscribe_group_multicast();
+
+    coap_server_config_t coap_config = {
+        .group = GROUP_ID,
+        .device = DEVICE_ID,
+        .sensors = SENSOR_COUNT,
+        .sample_period_ms = CONFIG_SENSOR_SAMPLE_PERIOD_MS,
+    };
+    coap_server_start(&coap_config); // Zasoby CoAP z obserwacją stanu
+    vTaskDelete(NULL);
 }
 
 
@@ -458,6 +540,26 @@ void app_main(void)
     };
 
     ESP_ERROR_CHECK(nvs_flash_init());
+    atomic_store(&tx_seq, esp_random());
+
+    // Stan wyjść sprzed restartu odtwarzany jest przed startem sieci Thread,
+    // więc krótki zanik zasilania nie wyłącza światła ani wentylatora
+    uint32_t switches = 0;
+    bool restored = persist_load_switches(&switches);
+    boot_timing_start(restored);
+    ESP_ERROR_CHECK(persist_init(CONFIG_PERSIST_COMMIT_DELAY_MS));
+
+    // Pomiary i zmiany stanów z krótkiego okna wysyłane są w jednej ramce
+    ESP_ERROR_CHECK(coalescer_init(CONFIG_COALESCE_WINDOW_MS, send_frame));
+
+    // Elementy wykonawcze obsługiwane przez jedno zadanie sterowane zdarzeniami
+    ESP_ERROR_CHECK(actuator_engine_start(actuators, sizeof(actuators) / sizeof(actuators[0]), on_actuator_change));
+    actuator_set_flags_cb(on_actuator_flags);
+    if (switches & PERSISTED_FLAGS) {
+        actuator_flags_set(switches & PERSISTED_FLAGS); // zadanie silnika ma wyższy priorytet i ustawia wyjścia od razu
+    }
+    boot_timing_mark(BOOT_MARK_GPIO_RESTORED);
+
     ESP_ERROR_CHECK(esp_event_loop_create_default());
     ESP_ERROR_CHECK(esp_netif_init());
     ESP_ERROR_CHECK(esp_vfs_eventfd_register(&eventfd_config));
@@ -467,16 +569,21 @@ void app_main(void)
 
     // Tworzenie taska do monitorowania stanu urządzenia
     xTaskCreate(device_status_task, "print_status_task", 2048, NULL, 5, NULL);
-    
 
-    event_group = xEventGroupCreate();
+    // Przyciski obsługiwane przerwaniami zamiast odpytywania
+    ESP_ERROR_CHECK(rules_init(rule_flags, default_rules, sizeof(default_rules) / sizeof(default_rules[0])));
+    ESP_ERROR_CHECK(button_add(FAN_SWITCH, on_button_press, NULL, NULL));  // INPUT_FAN_SWITCH
+    ESP_ERROR_CHECK(button_add(LIGHT_SWITCH, on_button_press, NULL, NULL)); // INPUT_LIGHT_SWITCH
     
+    // Czujniki odczytywane po kolei przez jedno zadanie, każdy z własnym oknem raportowania
+    for (size_t i = 0; i < SENSOR_COUNT; i++) {
+        sensor_window_init(&reports[i].window, CONFIG_REPORT_WINDOW_SAMPLES);
+        reports[i].report_pending = true; // Pierwszy pomiar wysyłany jest od razu
+        reports[i].last_report = xTaskGetTickCount();
+    }
+    ESP_ERROR_CHECK(sensor_manager_start(sensors, SENSOR_COUNT, CONFIG_SENSOR_SAMPLE_PERIOD_MS, on_sensor_sample));
+
     // Tworzenie tasków
-    xTaskCreate(&dht11_task, "DHT11 Task", 2048, NULL, 5, NULL);
-    xTaskCreate(&fan_switch_task, "Button Task", 2048, NULL, 5, NULL);
-    xTaskCreate(&fan_task, "LED Task", 2048, NULL, 5, NULL);
-    xTaskCreate(&light_switch_task, "Light Input Task", 2048, NULL, 5, NULL);
-    xTaskCreate(&light_task, "Light Output Task", 2048, NULL, 5, NULL);
 
     xTaskCreate(udp_send_task, "udp_send_task", 8192, NULL, 5, NULL);
 
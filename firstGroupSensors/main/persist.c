@@ -0,0 +1,70 @@
+#include "persist.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/timers.h"
+#include "esp_log.h"
+#include "nvs.h"
+
+#define TAG "persist"
+#define PERSIST_NVS_NAMESPACE "node"
+#define PERSIST_NVS_KEY "switches"
+
+static TimerHandle_t commit_timer;
+static uint32_t stored;  // wartość w NVS
+static uint32_t pending; // wartość do zapisania
+static uint32_t writes;
+
+static void commit_timer_cb(TimerHandle_t timer)
+{
+    uint32_t flags = __atomic_load_n(&pending, __ATOMIC_RELAXED);
+    if (flags == stored) {
+        return;
+    }
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(PERSIST_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err == ESP_OK) {
+        err = nvs_set_u32(handle, PERSIST_NVS_KEY, flags);
+        if (err == ESP_OK) {
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to store switch state: %s", esp_err_to_name(err));
+        return;
+    }
+    stored = flags;
+    writes++;
+    ESP_LOGI(TAG, "Switch state 0x%lx stored (%lu writes since boot)", (unsigned long)flags, (unsigned long)writes);
+}
+
+esp_err_t persist_init(uint32_t commit_delay_ms)
+{
+    commit_timer = xTimerCreate("persist", pdMS_TO_TICKS(commit_delay_ms), pdFALSE, NULL, commit_timer_cb);
+    return commit_timer ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+bool persist_load_switches(uint32_t *flags)
+{
+    nvs_handle_t handle;
+    if (nvs_open(PERSIST_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return false;
+    }
+    esp_err_t err = nvs_get_u32(handle, PERSIST_NVS_KEY, flags);
+    nvs_close(handle);
+    if (err != ESP_OK) {
+        return false;
+    }
+    stored = pending = *flags;
+    return true;
+}
+
+void persist_store_switches(uint32_t flags)
+{
+    if (__atomic_exchange_n(&pending, flags, __ATOMIC_RELAXED) == flags) {
+        return;
+    }
+    // Każda zmiana przesuwa zapis - zapisywany jest dopiero stan ustalony
+    xTimerReset(commit_timer, 0);
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+// Stan przełączników (flagi FLAG_*_SWITCH) zachowywany w NVS między restartami.
+// Zapis do flash odkładany jest o commit_delay_ms, więc seria szybkich zmian
+// kończy się jednym zapisem, a powrót do zapisanej wartości nie zapisuje nic.
+
+esp_err_t persist_init(uint32_t commit_delay_ms);
+
+// Odczytuje zapisane flagi. Zwraca false, gdy w NVS nie ma stanu (pierwszy start).
+bool persist_load_switches(uint32_t *flags);
+
+// Zgłasza bieżące flagi, zapis nastąpi po czasie opóźnienia
+void persist_store_switches(uint32_t flags);
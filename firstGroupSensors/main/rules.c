@@ -0,0 +1,229 @@
+#include "rules.h"
+
+#include <string.h>
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/timers.h"
+#include "esp_log.h"
+#include "nvs.h"
+#include "actuator.h"
+
+#define TAG "rules"
+#define RULES_NVS_NAMESPACE "rules"
+#define RULES_NVS_KEY "table"
+#define RULES_SAVE_DELAY_MS 1000 // seria ramek SH_MSG_RULE kończy się jednym zapisem
+
+// Stan reguły czujnika między próbkami
+typedef struct {
+    bool active;
+    bool holding;      // warunek spełniony, trwa odliczanie hold_s
+    TickType_t since;
+} rule_state_t;
+
+static SemaphoreHandle_t lock;
+static sh_rule_t table[RULES_MAX];
+static rule_state_t states[RULES_MAX];
+static rules_actuator_flags_t actuator_flags[SH_ACT_COUNT];
+static uint8_t demand;  // bit (1 << sh_actuator_t) - aktywna reguła włącza element
+static uint8_t applied; // żądanie przekazane do silnika elementów wykonawczych
+static TimerHandle_t save_timer;
+static bool dirty;      // tabela w RAM różni się od zapisanej w NVS
+
+static esp_err_t rules_load(void)
+{
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(RULES_NVS_NAMESPACE, NVS_READONLY, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    size_t size = sizeof(table);
+    err = nvs_get_blob(handle, RULES_NVS_KEY, table, &size);
+    nvs_close(handle);
+    if (err == ESP_OK && size != sizeof(table)) {
+        err = ESP_ERR_INVALID_SIZE; // tabela z innej wersji oprogramowania
+    }
+    return err;
+}
+
+static esp_err_t rules_save(const sh_rule_t *rules)
+{
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(RULES_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = nvs_set_blob(handle, RULES_NVS_KEY, rules, sizeof(table));
+    if (err == ESP_OK) {
+        err = nvs_commit(handle);
+    }
+    nvs_close(handle);
+    return err;
+}
+
+// Zapis w zadaniu timerów, poza pętlą OpenThread. Zapisywana jest kopia tabeli,
+// więc blokada nie jest trzymana w czasie operacji na flash.
+static void save_timer_cb(TimerHandle_t timer)
+{
+    sh_rule_t snapshot[RULES_MAX];
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (!dirty) {
+        xSemaphoreGive(lock);
+        return;
+    }
+    memcpy(snapshot, table, sizeof(snapshot));
+    dirty = false;
+    xSemaphoreGive(lock);
+
+    esp_err_t err = rules_save(snapshot);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to store rules: %s", esp_err_to_name(err));
+        xSemaphoreTake(lock, portMAX_DELAY);
+        dirty = true; // kolejna zmiana reguły ponowi zapis
+        xSemaphoreGive(lock);
+        return;
+    }
+    ESP_LOGI(TAG, "Rules stored");
+}
+
+// Wartość, której dotyczy reguła czujnika
+static int16_t rule_value(const sh_rule_t *rule, int16_t temperature, int16_t humidity)
+{
+    return rule->quantity == SH_QTY_TEMPERATURE ? temperature : humidity;
+}
+
+// Warunek z histerezą: aktywna reguła wyłącza się dopiero po przekroczeniu
+// progu przesuniętego o histerezę
+static bool rule_condition(const sh_rule_t *rule, bool active, int16_t value)
+{
+    int32_t threshold = rule->threshold;
+    if (rule->op == SH_RULE_ABOVE) {
+        return value > (active ? threshold - rule->hysteresis : threshold);
+    }
+    return value < (active ? threshold + rule->hysteresis : threshold);
+}
+
+static void update_demand(void)
+{
+    demand = 0;
+    for (int i = 0; i < RULES_MAX; i++) {
+        if (table[i].source == SH_RULE_SENSOR && states[i].active) {
+            demand |= 1 << table[i].actuator;
+        }
+    }
+}
+
+esp_err_t rules_init(const rules_actuator_flags_t flags[SH_ACT_COUNT], const sh_rule_t *defaults, int count)
+{
+    lock = xSemaphoreCreateMutex();
+    save_timer = xTimerCreate("rules", pdMS_TO_TICKS(RULES_SAVE_DELAY_MS), pdFALSE, NULL, save_timer_cb);
+    if (lock == NULL || save_timer == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(actuator_flags, flags, sizeof(actuator_flags));
+
+    esp_err_t err = rules_load();
+    if (err != ESP_OK) {
+        ESP_LOGI(TAG, "No stored rules (%s), using defaults", esp_err_to_name(err));
+        memset(table, 0, sizeof(table));
+        memcpy(table, defaults, sizeof(sh_rule_t) * (count < RULES_MAX ? count : RULES_MAX));
+    }
+    for (int i = 0; i < RULES_MAX; i++) {
+        if (table[i].source != SH_RULE_NONE) {
+            ESP_LOGI(TAG, "Rule %d: source %d/%d, quantity %d, op %d, threshold %d, hysteresis %d, hold %ds -> actuator %d",
+                     i, table[i].source, table[i].input, table[i].quantity, table[i].op,
+                     table[i].threshold, table[i].hysteresis, table[i].hold_s, table[i].actuator);
+        }
+    }
+    return ESP_OK;
+}
+
+bool rules_on_sample(uint8_t sensor, int16_t temperature, int16_t humidity)
+{
+    TickType_t now = xTaskGetTickCount();
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (int i = 0; i < RULES_MAX; i++) {
+        const sh_rule_t *rule = &table[i];
+        rule_state_t *state = &states[i];
+        if (rule->source != SH_RULE_SENSOR || rule->input != sensor) {
+            continue;
+        }
+
+        bool condition = rule_condition(rule, state->active, rule_value(rule, temperature, humidity));
+        if (state->active || !condition) {
+            state->active = condition;
+            state->holding = false;
+            continue;
+        }
+        // Warunek musi trwać hold_s, zanim reguła się włączy
+        if (!state->holding) {
+            state->holding = true;
+            state->since = now;
+        }
+        if (now - state->since >= pdMS_TO_TICKS(rule->hold_s * 1000)) {
+            state->active = true;
+            state->holding = false;
+        }
+    }
+    update_demand();
+    bool changed = demand != applied;
+    xSemaphoreGive(lock);
+    return changed;
+}
+
+void rules_apply(void)
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+    uint8_t changed = demand ^ applied;
+    applied = demand;
+    xSemaphoreGive(lock);
+
+    for (int actuator = 0; actuator < SH_ACT_COUNT; actuator++) {
+        if (!(changed & (1 << actuator))) {
+            continue;
+        }
+        if (applied & (1 << actuator)) {
+            actuator_flags_set(actuator_flags[actuator].rule_flag);
+        } else {
+            actuator_flags_clear(actuator_flags[actuator].rule_flag);
+        }
+    }
+}
+
+void rules_on_input(uint8_t input)
+{
+    EventBits_t toggle = 0;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (int i = 0; i < RULES_MAX; i++) {
+        if (table[i].source == SH_RULE_INPUT && table[i].input == input) {
+            toggle |= actuator_flags[table[i].actuator].switch_flag;
+        }
+    }
+    xSemaphoreGive(lock);
+
+    if (toggle) {
+        actuator_flags_toggle(toggle);
+    }
+}
+
+esp_err_t rules_set(uint8_t index, const sh_rule_t *rule)
+{
+    if (index >= RULES_MAX || rule->actuator >= SH_ACT_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    table[index] = *rule;
+    memset(&states[index], 0, sizeof(states[index]));
+    update_demand();
+    dirty = true;
+    xSemaphoreGive(lock);
+
+    // Usunięta lub zmieniona reguła mogła zwolnić element wykonawczy
+    rules_apply();
+    // Każda zmiana przesuwa zapis do NVS
+    xTimerReset(save_timer, 0);
+    return ESP_OK;
+}
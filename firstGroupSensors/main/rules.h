@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "sh_proto.h"
+
+// Lokalna automatyka węzła: tabela reguł sh_rule_t przechowywana w NVS i
+// zmieniana ramką SH_MSG_RULE. Reguły czujników liczone są przy każdej próbce,
+// reguły wejść przy każdym naciśnięciu przycisku.
+
+#define RULES_MAX 8
+
+// Flagi silnika elementów wykonawczych, na które działają reguły
+typedef struct {
+    EventBits_t switch_flag; // przełączana przez reguły wejść
+    EventBits_t rule_flag;   // ustawiona, gdy aktywna jest reguła czujnika
+} rules_actuator_flags_t;
+
+// Wczytuje tabelę z NVS. Gdy jej nie ma, używa domyślnej tabeli defaults.
+esp_err_t rules_init(const rules_actuator_flags_t flags[SH_ACT_COUNT], const sh_rule_t *defaults, int count);
+
+// Nowa próbka czujnika (setne części). Zwraca true, gdy zmieniło się żądanie
+// włączenia któregoś elementu - zmianę przekazuje do silnika rules_apply().
+bool rules_on_sample(uint8_t sensor, int16_t temperature, int16_t humidity);
+void rules_apply(void);
+
+// Naciśnięcie przycisku o danym indeksie
+void rules_on_input(uint8_t input);
+
+// Zapisuje regułę w tabeli. Reguła SH_RULE_NONE zwalnia miejsce. Tabela trafia do NVS
+// sekundę po ostatniej zmianie, w zadaniu timerów - funkcję można wywołać z pętli OpenThread.
+esp_err_t rules_set(uint8_t index, const sh_rule_t *rule);
@@ -0,0 +1,106 @@
+#include "sensor_manager.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "dht_capture.h"
+
+#define TAG "sensor_manager"
+#define BACKOFF_MAX_SHIFT 4
+
+typedef struct {
+    const sensor_config_t *config;
+    TickType_t next_due;
+    uint32_t failures; // kolejne nieudane odczyty
+} sensor_slot_t;
+
+static sensor_slot_t slots[SENSOR_MAX];
+static size_t sensor_count;
+static TickType_t period;
+static sensor_sample_cb_t sample_cb;
+
+// Minimalny odstęp między odczytami jednego czujnika wg dokumentacji
+static TickType_t min_interval(dht_sensor_type_t type)
+{
+    return pdMS_TO_TICKS(type == DHT_TYPE_DHT11 ? 1000 : 2000);
+}
+
+static esp_err_t read_sensor(const sensor_config_t *config, float *humidity, float *temperature)
+{
+#if CONFIG_DHT_DRIVER_EDGE_CAPTURE
+    return dht_capture_read_float(config->type, config->gpio, humidity, temperature);
+#else
+    return dht_read_float_data(config->type, config->gpio, humidity, temperature);
+#endif
+}
+
+static sensor_slot_t *earliest_slot(void)
+{
+    sensor_slot_t *earliest = &slots[0];
+    TickType_t now = xTaskGetTickCount();
+    for (size_t i = 1; i < sensor_count; i++) {
+        // Różnica ze znakiem - zaległy odczyt ma wartość ujemną i wypada pierwszy, a
+        // przepełnienie licznika tyknięć nie zmienia kolejności
+        if ((int32_t)(slots[i].next_due - now) < (int32_t)(earliest->next_due - now)) {
+            earliest = &slots[i];
+        }
+    }
+    return earliest;
+}
+
+static void sensor_manager_task(void *pvParameter)
+{
+    while (1) {
+        sensor_slot_t *slot = earliest_slot();
+        TickType_t now = xTaskGetTickCount();
+        if ((int32_t)(slot->next_due - now) > 0) {
+            vTaskDelay(slot->next_due - now);
+        }
+
+        const sensor_config_t *config = slot->config;
+        uint8_t index = slot - slots;
+        float temperature = 0, humidity = 0;
+        TickType_t started = xTaskGetTickCount();
+
+        if (read_sensor(config, &humidity, &temperature) == ESP_OK) {
+            slot->failures = 0;
+            sample_cb(index, temperature, humidity);
+        } else if (slot->failures < BACKOFF_MAX_SHIFT) {
+            slot->failures++;
+        }
+
+        // Po błędach kolejne próby są coraz rzadsze, ale nigdy częstsze niż pozwala czujnik
+        TickType_t interval = period << slot->failures;
+        if (interval < min_interval(config->type)) {
+            interval = min_interval(config->type);
+        }
+        slot->next_due = started + interval;
+    }
+}
+
+esp_err_t sensor_manager_start(const sensor_config_t *sensors, size_t count, uint32_t period_ms, sensor_sample_cb_t cb)
+{
+    if (count == 0 || count > SENSOR_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    sensor_count = count;
+    period = pdMS_TO_TICKS(period_ms);
+    sample_cb = cb;
+
+    // Przesunięcie startu każdego czujnika o równą część okresu
+    TickType_t now = xTaskGetTickCount();
+    for (size_t i = 0; i < count; i++) {
+        slots[i].config = &sensors[i];
+        slots[i].next_due = now + period * i / count;
+        slots[i].failures = 0;
+        gpio_set_direction(sensors[i].gpio, GPIO_MODE_INPUT_OUTPUT_OD);
+        gpio_set_level(sensors[i].gpio, 1);
+        ESP_LOGI(TAG, "Sensor %d: %s on GPIO%d", (int)i,
+                 sensors[i].type == DHT_TYPE_DHT11 ? "DHT11" : "DHT22", sensors[i].gpio);
+    }
+
+    if (xTaskCreate(sensor_manager_task, "sensor_manager", 3072, NULL, 5, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "driver/gpio.h"
+#include "esp_err.h"
+#include "dht.h"
+
+#define SENSOR_MAX 4
+
+typedef struct {
+    gpio_num_t gpio;
+    dht_sensor_type_t type;
+} sensor_config_t;
+
+// Wynik odczytu czujnika o danym indeksie, wywoływany z zadania menedżera
+typedef void (*sensor_sample_cb_t)(uint8_t index, float temperature, float humidity);
+
+// Uruchamia zadanie, które odczytuje czujniki po kolei co period_ms każdy.
+// Odczyty są rozłożone równomiernie w okresie, nigdy się nie nakładają
+// i zachowują minimalny odstęp wymagany przez dany typ czujnika.
+// Tabela musi istnieć przez cały czas działania programu.
+esp_err_t sensor_manager_start(const sensor_config_t *sensors, size_t count, uint32_t period_ms, sensor_sample_cb_t cb);
@@ -0,0 +1,76 @@
+#include "sensor_window.h"
+
+#include <stdlib.h>
+
+void sensor_window_init(sensor_window_t *window, size_t capacity)
+{
+    if (capacity == 0 || capacity > SENSOR_WINDOW_MAX) {
+        capacity = SENSOR_WINDOW_MAX;
+    }
+    window->capacity = capacity;
+    sensor_window_reset(window);
+}
+
+void sensor_window_reset(sensor_window_t *window)
+{
+    window->head = 0;
+    window->count = 0;
+}
+
+void sensor_window_push(sensor_window_t *window, sensor_sample_t sample)
+{
+    window->samples[window->head] = sample;
+    window->head = (window->head + 1) % window->capacity;
+    if (window->count < window->capacity) {
+        window->count++;
+    }
+}
+
+static void stats_begin(sh_stats_t *stats, int16_t value)
+{
+    stats->min = value;
+    stats->max = value;
+}
+
+static void stats_add(sh_stats_t *stats, int16_t value)
+{
+    if (value < stats->min) {
+        stats->min = value;
+    }
+    if (value > stats->max) {
+        stats->max = value;
+    }
+}
+
+bool sensor_window_stats(const sensor_window_t *window, sh_stats_t *temperature, sh_stats_t *humidity)
+{
+    if (window->count == 0) {
+        return false;
+    }
+
+    size_t last = (window->head + window->capacity - 1) % window->capacity;
+    int32_t temperature_sum = 0, humidity_sum = 0;
+    stats_begin(temperature, window->samples[last].temperature);
+    stats_begin(humidity, window->samples[last].humidity);
+
+    for (size_t i = 0; i < window->count; i++) {
+        const sensor_sample_t *sample = &window->samples[(last + window->capacity - i) % window->capacity];
+        stats_add(temperature, sample->temperature);
+        stats_add(humidity, sample->humidity);
+        temperature_sum += sample->temperature;
+        humidity_sum += sample->humidity;
+    }
+
+    temperature->last = window->samples[last].temperature;
+    humidity->last = window->samples[last].humidity;
+    temperature->mean = (int16_t)(temperature_sum / (int32_t)window->count);
+    humidity->mean = (int16_t)(humidity_sum / (int32_t)window->count);
+    return true;
+}
+
+bool sensor_window_exceeds_deadband(const sensor_sample_t *reported, const sensor_sample_t *current,
+                                    const sensor_sample_t *deadband)
+{
+    return abs(current->temperature - reported->temperature) > deadband->temperature ||
+           abs(current->humidity - reported->humidity) > deadband->humidity;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sh_proto.h"
+
+// Bufor cykliczny próbek z okna raportowania. Gdy bufor jest pełny,
+// najstarsza próbka jest nadpisywana.
+#define SENSOR_WINDOW_MAX 256
+
+typedef struct {
+    int16_t temperature; // setne części stopnia Celsjusza
+    int16_t humidity;    // setne części procenta
+} sensor_sample_t;
+
+typedef struct {
+    sensor_sample_t samples[SENSOR_WINDOW_MAX];
+    size_t capacity;
+    size_t head;  // indeks następnego zapisu
+    size_t count;
+} sensor_window_t;
+
+void sensor_window_init(sensor_window_t *window, size_t capacity);
+void sensor_window_reset(sensor_window_t *window);
+void sensor_window_push(sensor_window_t *window, sensor_sample_t sample);
+
+// Liczy last/min/max/mean dla obu wielkości. Zwraca false dla pustego okna.
+bool sensor_window_stats(const sensor_window_t *window, sh_stats_t *temperature, sh_stats_t *humidity);
+
+// Sprawdza, czy którakolwiek wielkość oddaliła się od ostatnio wysłanej
+// o więcej niż jej strefa nieczułości
+bool sensor_window_exceeds_deadband(const sensor_sample_t *reported, const sensor_sample_t *current,
+                                    const sensor_sample_t *deadband);
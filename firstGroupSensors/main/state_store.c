@@ -0,0 +1,59 @@
+#include "state_store.h"
+
+#include "freertos/FreeRTOS.h"
+
+// Licznik nieparzysty - trwa zapis. Każdy zapis zwiększa go o 2.
+static uint32_t sequence;
+static node_state_t state;
+static portMUX_TYPE writer_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void write_begin(void)
+{
+    portENTER_CRITICAL(&writer_lock);
+    __atomic_store_n(&sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void write_end(void)
+{
+    __atomic_store_n(&sequence, sequence + 1, __ATOMIC_RELEASE);
+    portEXIT_CRITICAL(&writer_lock);
+}
+
+void state_store_set_climate(int16_t temperature, int16_t humidity)
+{
+    write_begin();
+    state.temperature = temperature;
+    state.humidity = humidity;
+    write_end();
+}
+
+void state_store_set_actuator(sh_actuator_t actuator, bool on)
+{
+    if (actuator >= SH_ACT_COUNT) {
+        return;
+    }
+    write_begin();
+    state.actuators[actuator] = on;
+    write_end();
+}
+
+uint32_t state_store_read(node_state_t *out)
+{
+    uint32_t begin, end;
+    do {
+        begin = __atomic_load_n(&sequence, __ATOMIC_ACQUIRE);
+        if (begin & 1) {
+            continue; // zapis w toku
+        }
+        *out = *(volatile node_state_t *)&state;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        end = __atomic_load_n(&sequence, __ATOMIC_RELAXED);
+    } while ((begin & 1) || begin != end);
+    return begin / 2;
+}
+
+uint32_t state_store_version(void)
+{
+    return __atomic_load_n(&sequence, __ATOMIC_ACQUIRE) / 2;
+}
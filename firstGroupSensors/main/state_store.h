@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sh_proto.h"
+
+// Wspólny stan węzła (pomiar czujnika 0 i stany wyjść) chroniony seqlockiem.
+// Zapisy są krótkie i wzajemnie wykluczane sekcją krytyczną. Odczyt nie blokuje:
+// kopiuje stan i powtarza próbę, jeśli w tym czasie trwał zapis, więc zawsze
+// zwraca spójną migawkę (temperatura i wilgotność z tego samego pomiaru).
+
+typedef struct {
+    int16_t temperature; // setne części stopnia Celsjusza
+    int16_t humidity;    // setne części procenta
+    bool actuators[SH_ACT_COUNT];
+} node_state_t;
+
+void state_store_set_climate(int16_t temperature, int16_t humidity);
+void state_store_set_actuator(sh_actuator_t actuator, bool on);
+
+// Kopiuje spójną migawkę stanu. Zwraca jej wersję.
+uint32_t state_store_read(node_state_t *state);
+
+// Wersja rośnie przy każdej zmianie. Nadawca może pominąć wysyłkę, gdy wersja
+// jest taka sama jak przy poprzedniej.
+uint32_t state_store_version(void);
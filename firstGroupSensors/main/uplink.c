@@ -0,0 +1,246 @@
+#include "uplink.h"
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/timers.h"
+#include "esp_log.h"
+#include "esp_openthread.h"
+#include "esp_openthread_lock.h"
+#include "openthread/message.h"
+#include "openthread/netdata.h"
+#include "openthread/thread.h"
+#include "sh_proto.h"
+
+#define TAG "uplink"
+#define UPLINK_MULTICAST_ADDRESS "ff03::1"
+#define UPLINK_TICK_MS 100
+
+// Ramka czekająca na potwierdzenie
+typedef struct {
+    bool used;
+    uint16_t seq;
+    uint8_t len;
+    uint8_t retries;
+    TickType_t deadline;
+    uint8_t frame[SH_FRAME_MAX_LEN];
+} pending_frame_t;
+
+static otUdpSocket udp_socket;
+static uint16_t peer_port;
+static pending_frame_t window[UPLINK_WINDOW];
+static TimerHandle_t retransmit_timer;
+static uplink_stats_t stats;
+static bool gateway_known;
+static bool ready; // gniazdo otwarte, stos OpenThread działa
+
+// Szuka usługi bramy w Network Data i zwraca jej adres anycast
+static bool find_gateway(otInstance *instance, otIp6Address *address)
+{
+    otNetworkDataIterator iterator = OT_NETWORK_DATA_ITERATOR_INIT;
+    otServiceConfig config;
+
+    while (otNetDataGetNextService(instance, &iterator, &config) == OT_ERROR_NONE) {
+        if (config.mEnterpriseNumber == SH_GW_SERVICE_ENTERPRISE &&
+            config.mServiceDataLength == SH_GW_SERVICE_DATA_LEN &&
+            memcmp(config.mServiceData, SH_GW_SERVICE_DATA, SH_GW_SERVICE_DATA_LEN) == 0) {
+            return otThreadGetServiceAloc(instance, config.mServiceId, address) == OT_ERROR_NONE;
+        }
+    }
+    return false;
+}
+
+// Wysyła ramkę do bramy lub na multicast. Wymaga blokady stosu OpenThread.
+static bool send_locked(const uint8_t *frame, size_t len)
+{
+    otInstance *instance = esp_openthread_get_instance();
+    otMessageInfo message_info;
+
+    otDeviceRole role = otThreadGetDeviceRole(instance);
+    if (role == OT_DEVICE_ROLE_DISABLED || role == OT_DEVICE_ROLE_DETACHED) {
+        ESP_LOGW(TAG, "Device is not in a valid state for sending messages (Role: %d).", role);
+        stats.send_errors++;
+        return false;
+    }
+
+    memset(&message_info, 0, sizeof(message_info));
+    message_info.mPeerPort = peer_port;
+    bool unicast = find_gateway(instance, &message_info.mPeerAddr);
+    if (!unicast) {
+        otIp6AddressFromString(UPLINK_MULTICAST_ADDRESS, &message_info.mPeerAddr);
+    }
+    if (unicast != gateway_known) {
+        gateway_known = unicast;
+        ESP_LOGI(TAG, "Gateway %s", unicast ? "found, sending unicast" : "unknown, falling back to multicast");
+    }
+
+    otMessage *message = otUdpNewMessage(instance, NULL);
+    if (message == NULL) {
+        ESP_LOGE(TAG, "Failed to create message");
+        stats.send_errors++;
+        return false;
+    }
+    otError error = otMessageAppend(message, frame, len);
+    if (error != OT_ERROR_NONE) {
+        ESP_LOGE(TAG, "Failed to append message, error: %d", error);
+        otMessageFree(message);
+        stats.send_errors++;
+        return false;
+    }
+
+    // otUdpSend przejmuje wiadomość również w przypadku błędu
+    error = otUdpSend(instance, &udp_socket, message, &message_info);
+    if (error != OT_ERROR_NONE) {
+        ESP_LOGE(TAG, "Failed to send message, error: %d", error);
+        stats.send_errors++;
+        return false;
+    }
+    if (unicast) {
+        stats.unicast++;
+    } else {
+        stats.multicast++;
+    }
+    return true;
+}
+
+// Kolejna próba później - czas oczekiwania podwaja się po każdej próbie
+static TickType_t ack_timeout(uint8_t retries)
+{
+    return pdMS_TO_TICKS(CONFIG_UPLINK_ACK_TIMEOUT_MS) << retries;
+}
+
+static bool window_empty(void)
+{
+    for (int i = 0; i < UPLINK_WINDOW; i++) {
+        if (window[i].used) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void retransmit_timer_cb(TimerHandle_t timer)
+{
+    esp_openthread_lock_acquire(portMAX_DELAY);
+    TickType_t now = xTaskGetTickCount();
+    for (int i = 0; i < UPLINK_WINDOW; i++) {
+        pending_frame_t *pending = &window[i];
+        if (!pending->used || (int32_t)(now - pending->deadline) < 0) {
+            continue;
+        }
+        if (pending->retries >= CONFIG_UPLINK_MAX_RETRIES) {
+            ESP_LOGW(TAG, "Frame %d not acknowledged, giving up", pending->seq);
+            pending->used = false;
+            stats.expired++;
+            continue;
+        }
+        pending->retries++;
+        pending->deadline = now + ack_timeout(pending->retries);
+        stats.retransmits++;
+        send_locked(pending->frame, pending->len);
+    }
+    if (window_empty()) {
+        xTimerStop(retransmit_timer, 0);
+    }
+    esp_openthread_lock_release();
+}
+
+// Wolne miejsce w oknie. Gdy okno jest pełne, najstarsza ramka jest porzucana.
+static pending_frame_t *window_slot(void)
+{
+    pending_frame_t *oldest = &window[0];
+    for (int i = 0; i < UPLINK_WINDOW; i++) {
+        if (!window[i].used) {
+            return &window[i];
+        }
+        if ((int16_t)(window[i].seq - oldest->seq) < 0) {
+            oldest = &window[i];
+        }
+    }
+    ESP_LOGW(TAG, "Retransmit window full, dropping frame %d", oldest->seq);
+    stats.expired++;
+    return oldest;
+}
+
+esp_err_t uplink_init(uint16_t port, otUdpReceive receive_cb)
+{
+    otInstance *instance = esp_openthread_get_instance();
+    if (instance == NULL) {
+        ESP_LOGE(TAG, "OpenThread instance not initialized.");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    retransmit_timer = xTimerCreate("uplink", pdMS_TO_TICKS(UPLINK_TICK_MS), pdTRUE, NULL, retransmit_timer_cb);
+    if (retransmit_timer == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    otSockAddr sock_addr;
+    memset(&udp_socket, 0, sizeof(udp_socket));
+    memset(&sock_addr, 0, sizeof(sock_addr));
+    sock_addr.mPort = port;
+    peer_port = port;
+
+    esp_openthread_lock_acquire(portMAX_DELAY);
+    otError error = otUdpOpen(instance, &udp_socket, receive_cb, NULL);
+    if (error == OT_ERROR_NONE) {
+        error = otUdpBind(instance, &udp_socket, &sock_addr, OT_NETIF_THREAD);
+    }
+    esp_openthread_lock_release();
+
+    if (error != OT_ERROR_NONE) {
+        ESP_LOGE(TAG, "Failed to open UDP socket, error: %d", error);
+        return ESP_FAIL;
+    }
+    ready = true;
+    ESP_LOGI(TAG, "UDP socket initialized.");
+    return ESP_OK;
+}
+
+bool uplink_send(const uint8_t *frame, size_t len, uint16_t seq, bool reliable)
+{
+    // Przed startem stosu (np. przy odtwarzaniu stanu po restarcie) nie ma jeszcze blokady
+    if (!ready) {
+        stats.send_errors++;
+        return false;
+    }
+
+    esp_openthread_lock_acquire(portMAX_DELAY);
+    bool sent = send_locked(frame, len);
+    if (reliable) {
+        pending_frame_t *pending = window_slot();
+        pending->used = true;
+        pending->seq = seq;
+        pending->len = len;
+        pending->retries = 0;
+        pending->deadline = xTaskGetTickCount() + ack_timeout(0);
+        memcpy(pending->frame, frame, len);
+        xTimerStart(retransmit_timer, 0);
+    }
+    esp_openthread_lock_release();
+    return sent;
+}
+
+void uplink_handle_ack(uint16_t seq)
+{
+    esp_openthread_lock_acquire(portMAX_DELAY);
+    for (int i = 0; i < UPLINK_WINDOW; i++) {
+        if (window[i].used && window[i].seq == seq) {
+            window[i].used = false;
+            stats.acked++;
+            break;
+        }
+    }
+    esp_openthread_lock_release();
+}
+
+void uplink_get_stats(uplink_stats_t *out)
+{
+    if (!ready) {
+        *out = stats;
+        return;
+    }
+    esp_openthread_lock_acquire(portMAX_DELAY);
+    *out = stats;
+    esp_openthread_lock_release();
+}
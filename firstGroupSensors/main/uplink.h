@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "openthread/udp.h"
+
+// Wysyłanie ramek do bramy. Adres bramy to ALOC usługi SH_GW_SERVICE_* z Thread
+// Network Data, więc ramki idą unicastem tylko do niej. Dopóki brama nie jest
+// znana, ramki wysyłane są na multicast ff03::1.
+
+#define UPLINK_WINDOW 4 // maks. liczba niepotwierdzonych ramek
+
+typedef struct {
+    uint32_t unicast;     // ramki wysłane na adres bramy
+    uint32_t multicast;   // ramki wysłane na ff03::1 (brama nieznana)
+    uint32_t send_errors;
+    uint32_t retransmits;
+    uint32_t acked;
+    uint32_t expired;     // ramki bez potwierdzenia po wszystkich próbach
+} uplink_stats_t;
+
+// Otwiera gniazdo UDP na porcie port. Odebrane wiadomości trafiają do receive_cb.
+esp_err_t uplink_init(uint16_t port, otUdpReceive receive_cb);
+
+// Wysyła ramkę. Ramka z reliable = true jest powtarzana do czasu odebrania
+// SH_MSG_ACK z jej numerem sekwencyjnym. Zwraca false, gdy ramki nie udało się
+// przekazać do stosu (np. przed uplink_init() lub bez połączenia z siecią).
+bool uplink_send(const uint8_t *frame, size_t len, uint16_t seq, bool reliable);
+
+// Potwierdzenie z bramy, wywoływane z callbacku odbioru
+void uplink_handle_ack(uint16_t seq);
+
+void uplink_get_stats(uplink_stats_t *stats);
@@ -0,0 +1,9 @@
+#pragma once
+
+// Zamiennik nagłówka sterownika DHT do testów na komputerze - tylko typ czujnika
+
+typedef enum {
+    DHT_TYPE_DHT11 = 0,
+    DHT_TYPE_AM2301,
+    DHT_TYPE_SI7021
+} dht_sensor_type_t;
@@ -0,0 +1,6 @@
+#pragma once
+
+// Numer pinu jak w sterowniku GPIO - tylko dla testów na komputerze
+#include <stdint.h>
+
+typedef int gpio_num_t;
@@ -0,0 +1,54 @@
+// Implementacja input_hal na komputerze: przebiegi wejść i zegar symulacji
+#include "input_hal_host.h"
+
+typedef struct {
+    const input_hal_host_edge_t *edges;
+    size_t count;
+    input_hal_edge_cb_t cb;
+    void *arg;
+} host_pin_t;
+
+static host_pin_t pins[INPUT_HAL_HOST_PINS];
+static int64_t now;
+
+void input_hal_host_waveform(gpio_num_t pin, const input_hal_host_edge_t *edges, size_t count)
+{
+    pins[pin].edges = edges;
+    pins[pin].count = count;
+}
+
+void input_hal_host_set_time(int64_t now_us)
+{
+    now = now_us;
+}
+
+void input_hal_host_interrupt(gpio_num_t pin)
+{
+    if (pins[pin].cb != NULL) {
+        pins[pin].cb(pins[pin].arg);
+    }
+}
+
+esp_err_t input_hal_config_input(gpio_num_t pin, input_hal_edge_cb_t cb, void *arg)
+{
+    if (pin < 0 || pin >= INPUT_HAL_HOST_PINS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pins[pin].cb = cb;
+    pins[pin].arg = arg;
+    return ESP_OK;
+}
+
+int input_hal_get_level(gpio_num_t pin)
+{
+    int level = 0;
+    for (size_t i = 0; i < pins[pin].count && pins[pin].edges[i].time_us <= now; i++) {
+        level = pins[pin].edges[i].level;
+    }
+    return level;
+}
+
+int64_t input_hal_now_us(void)
+{
+    return now;
+}
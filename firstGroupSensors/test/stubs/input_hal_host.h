@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "input_hal.h"
+
+// Symulowane wejścia input_hal. Poziom pinu wynika z zapisanego przebiegu i zegara
+// ustawianego przez test, a test sam wywołuje callback zbocza w chwili "przerwania".
+
+#define INPUT_HAL_HOST_PINS 4
+
+typedef struct {
+    int64_t time_us; // od tej chwili wejście ma poziom level
+    int level;
+} input_hal_host_edge_t;
+
+// Przebieg pinu, zbocza w kolejności czasu. Przed pierwszym zboczem poziom jest niski.
+void input_hal_host_waveform(gpio_num_t pin, const input_hal_host_edge_t *edges, size_t count);
+void input_hal_host_set_time(int64_t now_us);
+// Wywołuje callback zbocza zarejestrowany dla pinu, jak przerwanie GPIO
+void input_hal_host_interrupt(gpio_num_t pin);
@@ -0,0 +1,212 @@
+// Test odbijania styków na symulowanych przebiegach wejścia. Przycisk jest złożony
+// jak w button.c: przerwanie zbocza wywołuje debounce_edge() i otwiera okno, a koniec
+// okna (w węźle timer FreeRTOS) wywołuje debounce_window_end(). Odczyt poziomu
+// i zegar pochodzą z input_hal na komputerze, przerwanie przychodzi z opóźnieniem.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "debounce.h"
+#include "input_hal_host.h"
+
+static int failures;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+#define WINDOW_US 30000 // domyślne CONFIG_BUTTON_DEBOUNCE_MS
+#define ISR_LATENCY_US 5
+#define BUTTON_PIN 0
+#define MAX_EDGES 4096
+#define MAX_PRESSES 256
+
+typedef struct {
+    debounce_t debounce;
+    int64_t window_end_us; // -1 - okno nie trwa
+    int presses;
+    int64_t press_us[MAX_PRESSES];
+} sim_button_t;
+
+static sim_button_t button;
+static input_hal_host_edge_t edges[MAX_EDGES];
+static size_t edge_count;
+static int64_t press_start_us[MAX_PRESSES];
+static int press_count;
+
+static void report_press(void)
+{
+    if (button.presses < MAX_PRESSES) {
+        button.press_us[button.presses] = input_hal_now_us();
+    }
+    button.presses++;
+}
+
+static void edge_isr(void *arg)
+{
+    (void)arg;
+    bool pressed;
+    if (!debounce_edge(&button.debounce, input_hal_get_level(BUTTON_PIN), input_hal_now_us(), &pressed)) {
+        return;
+    }
+    if (pressed) {
+        report_press();
+    }
+    button.window_end_us = input_hal_now_us() + WINDOW_US;
+}
+
+static void reset(void)
+{
+    edge_count = 0;
+    press_count = 0;
+    button.presses = 0;
+    button.window_end_us = -1;
+    input_hal_host_set_time(0);
+    debounce_init(&button.debounce, false);
+}
+
+static void add_edge(int64_t time_us, int level)
+{
+    edges[edge_count].time_us = time_us;
+    edges[edge_count].level = level;
+    edge_count++;
+}
+
+// Przejście do poziomu level z drganiami: bounces dodatkowych par zboczy co 20-800 us.
+// Zwraca chwilę ustalenia poziomu.
+static int64_t add_transition(int64_t time_us, int level, int bounces)
+{
+    add_edge(time_us, level);
+    for (int i = 0; i < bounces; i++) {
+        time_us += 20 + rand() % 780;
+        add_edge(time_us, !level);
+        time_us += 20 + rand() % 780;
+        add_edge(time_us, level);
+    }
+    return time_us;
+}
+
+static void press(int64_t time_us, int64_t hold_us, int bounces)
+{
+    press_start_us[press_count++] = time_us;
+    int64_t settled = add_transition(time_us, 1, bounces);
+    add_transition(settled + hold_us, 0, bounces);
+}
+
+// Przerwanie na każdym zboczu po ISR_LATENCY_US, koniec okna w swojej chwili
+static void run(void)
+{
+    input_hal_host_waveform(BUTTON_PIN, edges, edge_count);
+    size_t next = 0;
+    while (next < edge_count || button.window_end_us >= 0) {
+        int64_t edge_at = next < edge_count ? edges[next].time_us + ISR_LATENCY_US : INT64_MAX;
+        if (button.window_end_us >= 0 && button.window_end_us <= edge_at) {
+            input_hal_host_set_time(button.window_end_us);
+            button.window_end_us = -1;
+            if (debounce_window_end(&button.debounce, input_hal_get_level(BUTTON_PIN))) {
+                report_press();
+            }
+        } else {
+            input_hal_host_set_time(edge_at);
+            next++;
+            input_hal_host_interrupt(BUTTON_PIN);
+        }
+    }
+}
+
+static int64_t latency(int index)
+{
+    return button.press_us[index] - press_start_us[index];
+}
+
+// Drgające naciśnięcia i zwolnienia: jedno zdarzenie na naciśnięcie, zgłoszone na pierwszym zboczu
+static void test_bouncing_presses(void)
+{
+    reset();
+    for (int i = 0; i < 100; i++) {
+        press(1000 + i * 250000, 80000 + rand() % 70000, rand() % 6);
+    }
+    run();
+    CHECK(button.presses == press_count);
+
+    int64_t sum = 0, max = 0;
+    for (int i = 0; i < press_count && i < button.presses; i++) {
+        CHECK(latency(i) == ISR_LATENCY_US);
+        sum += latency(i);
+        max = latency(i) > max ? latency(i) : max;
+    }
+    printf("bouncing presses: %d of %d reported, latency mean %lld us, max %lld us (%zu edges)\n",
+           button.presses, press_count, (long long)(sum / press_count), (long long)max, edge_count);
+}
+
+// Krótkie naciśnięcie, zwolnione przed końcem okna
+static void test_short_press(void)
+{
+    reset();
+    press(1000, 10000, 3);
+    press(100000, 5000, 0);
+    run();
+    CHECK(button.presses == 2);
+    CHECK(!button.debounce.stable_level);
+}
+
+// Przerwanie przyszło po drganiu i odczytało poziom niski - naciśnięcie zgłasza koniec okna
+static void test_first_edge_reads_low(void)
+{
+    reset();
+    press_start_us[press_count++] = 1000;
+    add_edge(1000, 1);
+    add_edge(1002, 0);
+    add_edge(2000, 1);
+    add_edge(150000, 0);
+    run();
+    CHECK(button.presses == 1);
+    CHECK(latency(0) == ISR_LATENCY_US + WINDOW_US);
+    printf("first edge read low: press reported after %lld us\n", (long long)latency(0));
+}
+
+// Ponowne naciśnięcie w oknie otwartym przez zwolnienie - jego zbocze jest pomijane,
+// naciśnięcie zgłasza koniec okna
+static void test_press_during_release_window(void)
+{
+    reset();
+    press(1000, 100000, 2);
+    int64_t released = edges[edge_count - 1].time_us;
+    press(released + 10000, 100000, 0);
+    run();
+    CHECK(button.presses == 2);
+    CHECK(button.presses == 2 && latency(1) <= WINDOW_US);
+}
+
+// Zakłócenie krótsze od opóźnienia przerwania nie daje naciśnięcia
+static void test_glitch(void)
+{
+    reset();
+    add_edge(1000, 1);
+    add_edge(1002, 0);
+    run();
+    CHECK(button.presses == 0);
+    CHECK(!button.debounce.locked);
+}
+
+int main(void)
+{
+    srand(1);
+    CHECK(input_hal_config_input(BUTTON_PIN, edge_isr, NULL) == ESP_OK);
+
+    test_bouncing_presses();
+    test_short_press();
+    test_first_edge_reads_low();
+    test_press_during_release_window();
+    test_glitch();
+
+    if (failures > 0) {
+        printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("debounce: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,170 @@
+// Test dekodera DHT na syntetycznych przebiegach zboczy w układzie zapisywanym
+// przez dht_capture: zwolnienie linii, preambuła 80/80 us i 40 bitów.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "dht_decode.h"
+
+static int failures;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+#define BIT_LOW_US 50
+#define BIT_ZERO_US 27
+#define BIT_ONE_US 70
+
+typedef struct {
+    dht_edge_t edges[DHT_DECODE_MAX_EDGES];
+    size_t count;
+    uint32_t now_us;
+} capture_t;
+
+static void edge(capture_t *capture, uint32_t after_us, uint8_t level)
+{
+    capture->now_us += after_us;
+    capture->edges[capture->count].time_us = capture->now_us;
+    capture->edges[capture->count].level = level;
+    capture->count++;
+}
+
+// Przebieg odpowiedzi z 5 bajtami danych. high_us[bit] != 0 zastępuje czas stanu wysokiego bitu.
+static void build(capture_t *capture, const uint8_t data[5], const uint32_t *high_us)
+{
+    memset(capture, 0, sizeof(*capture));
+    capture->now_us = 1000;
+    edge(capture, 0, 1);   // zwolnienie linii przez mikrokontroler
+    edge(capture, 30, 0);  // preambuła czujnika
+    edge(capture, 80, 1);
+    edge(capture, 80, 0);
+    for (int bit = 0; bit < DHT_DECODE_BITS; bit++) {
+        bool one = data[bit / 8] & (1 << (7 - bit % 8));
+        uint32_t high = high_us != NULL && high_us[bit] != 0 ? high_us[bit] : (one ? BIT_ONE_US : BIT_ZERO_US);
+        edge(capture, BIT_LOW_US, 1);
+        edge(capture, high, 0);
+    }
+}
+
+// Dane DHT22: wilgotność 65.2 %, temperatura -10.1 stopnia
+static const uint8_t sample[5] = { 0x02, 0x8c, 0x80, 0x65, (0x02 + 0x8c + 0x80 + 0x65) & 0xff };
+
+static void test_clean_capture(void)
+{
+    capture_t capture;
+    int16_t humidity = 0, temperature = 0;
+
+    build(&capture, sample, NULL);
+    CHECK(capture.count == DHT_DECODE_RESPONSE_EDGES);
+    CHECK(dht_decode(capture.edges, capture.count, DHT_TYPE_AM2301, &humidity, &temperature) == DHT_DECODE_OK);
+    CHECK(humidity == 652);
+    CHECK(temperature == -101);
+
+    // DHT11: liczby całkowite w pierwszym bajcie każdej wielkości
+    const uint8_t dht11[5] = { 45, 0, 23, 0, 68 };
+    build(&capture, dht11, NULL);
+    CHECK(dht_decode(capture.edges, capture.count, DHT_TYPE_DHT11, &humidity, &temperature) == DHT_DECODE_OK);
+    CHECK(humidity == 450);
+    CHECK(temperature == 230);
+
+    // Zgubione zbocza preambuły nie przeszkadzają - liczą się ostatnie 40 impulsy
+    build(&capture, sample, NULL);
+    CHECK(dht_decode(capture.edges + 2, capture.count - 2, DHT_TYPE_AM2301, &humidity, &temperature) == DHT_DECODE_OK);
+    CHECK(humidity == 652);
+}
+
+// Bit rozstrzyga próg 48 us stanu wysokiego: do progu "0", powyżej "1"
+static void test_threshold_jitter(void)
+{
+    capture_t capture;
+    uint32_t high_us[DHT_DECODE_BITS];
+    int16_t humidity = 0, temperature = 0;
+
+    // Wszystkie zera i jedynki przesunięte o +-15 us wciąż dekodują się poprawnie
+    for (int jitter = -15; jitter <= 15; jitter += 5) {
+        for (int bit = 0; bit < DHT_DECODE_BITS; bit++) {
+            bool one = sample[bit / 8] & (1 << (7 - bit % 8));
+            high_us[bit] = (one ? BIT_ONE_US : BIT_ZERO_US) + jitter;
+        }
+        build(&capture, sample, high_us);
+        CHECK(dht_decode(capture.edges, capture.count, DHT_TYPE_AM2301, &humidity, &temperature) == DHT_DECODE_OK);
+        CHECK(humidity == 652 && temperature == -101);
+    }
+
+    // Bit 0 danych to "0" - tuż przy progu zostaje zerem, o 1 us dalej staje się jedynką
+    memset(high_us, 0, sizeof(high_us));
+    high_us[0] = 48;
+    build(&capture, sample, high_us);
+    CHECK(dht_decode(capture.edges, capture.count, DHT_TYPE_AM2301, &humidity, &temperature) == DHT_DECODE_OK);
+    high_us[0] = 49;
+    build(&capture, sample, high_us);
+    CHECK(dht_decode(capture.edges, capture.count, DHT_TYPE_AM2301, &humidity, &temperature) == DHT_DECODE_CHECKSUM);
+
+    // Impuls poza tolerancją protokołu
+    memset(high_us, 0, sizeof(high_us));
+    high_us[10] = 101;
+    build(&capture, sample, high_us);
+    CHECK(dht_decode(capture.edges, capture.count, DHT_TYPE_AM2301, &humidity, &temperature) == DHT_DECODE_TIMING);
+    high_us[10] = 5;
+    build(&capture, sample, high_us);
+    CHECK(dht_decode(capture.edges, capture.count, DHT_TYPE_AM2301, &humidity, &temperature) == DHT_DECODE_TIMING);
+}
+
+static void test_missing_edge(void)
+{
+    capture_t capture;
+    int16_t humidity = 0, temperature = 0;
+
+    // Zgubione zbocze opadające w środku skleja dwa impulsy w jeden za długi
+    build(&capture, sample, NULL);
+    size_t drop = 4 + 2 * 20 + 1;
+    CHECK(capture.edges[drop].level == 0);
+    memmove(&capture.edges[drop], &capture.edges[drop + 1], (capture.count - drop - 1) * sizeof(dht_edge_t));
+    capture.count--;
+    CHECK(dht_decode(capture.edges, capture.count, DHT_TYPE_AM2301, &humidity, &temperature) != DHT_DECODE_OK);
+
+    // Brak ostatniego zbocza - impuls preambuły zajmuje miejsce pierwszego bitu
+    build(&capture, sample, NULL);
+    CHECK(dht_decode(capture.edges, capture.count - 1, DHT_TYPE_AM2301, &humidity, &temperature) != DHT_DECODE_OK);
+    // Urwana odpowiedź - bez dwóch ostatnich bitów zostaje mniej niż 40 impulsów,
+    // licząc także zwolnienie linii i preambułę
+    CHECK(dht_decode(capture.edges, capture.count - 5, DHT_TYPE_AM2301, &humidity, &temperature) == DHT_DECODE_SHORT);
+    CHECK(dht_decode(capture.edges, 0, DHT_TYPE_AM2301, &humidity, &temperature) == DHT_DECODE_SHORT);
+}
+
+static void test_bad_checksum(void)
+{
+    capture_t capture;
+    int16_t humidity = 0, temperature = 0;
+    uint8_t data[5];
+
+    memcpy(data, sample, sizeof(data));
+    data[4] ^= 0x01;
+    build(&capture, data, NULL);
+    CHECK(dht_decode(capture.edges, capture.count, DHT_TYPE_AM2301, &humidity, &temperature) == DHT_DECODE_CHECKSUM);
+
+    // Błąd w danych, a nie w sumie
+    memcpy(data, sample, sizeof(data));
+    data[1] ^= 0x10;
+    build(&capture, data, NULL);
+    CHECK(dht_decode(capture.edges, capture.count, DHT_TYPE_AM2301, &humidity, &temperature) == DHT_DECODE_CHECKSUM);
+}
+
+int main(void)
+{
+    test_clean_capture();
+    test_threshold_jitter();
+    test_missing_edge();
+    test_bad_checksum();
+
+    if (failures > 0) {
+        printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("dht_decode: all checks passed\n");
+    return 0;
+}
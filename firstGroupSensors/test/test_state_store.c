@@ -0,0 +1,79 @@
+// Test obciążeniowy seqlocka state_store: dwa wątki zapisują pomiary i stany wyjść,
+// dwa wątki czytają bez blokady. Każdy pomiar ma wilgotność równą minus temperaturze,
+// więc migawka z połową starego i połową nowego zapisu jest od razu widoczna.
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include "state_store.h"
+
+static int failures;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            __atomic_fetch_add(&failures, 1, __ATOMIC_RELAXED); \
+        } \
+    } while (0)
+
+#define WRITES 1000000
+
+static atomic_int writers_running;
+static atomic_ulong reads;
+
+static void *writer(void *arg)
+{
+    int id = (int)(intptr_t)arg;
+    for (int i = 0; i < WRITES; i++) {
+        int16_t value = (int16_t)(id * 16000 + i % 16000);
+        state_store_set_climate(value, (int16_t)-value);
+        if (i % 16 == 0) {
+            state_store_set_actuator((sh_actuator_t)(i / 16 % SH_ACT_COUNT), (i / 16) & 1);
+        }
+    }
+    atomic_fetch_sub(&writers_running, 1);
+    return NULL;
+}
+
+static void *reader(void *arg)
+{
+    (void)arg;
+    uint32_t last = 0;
+    unsigned long count = 0;
+    while (atomic_load(&writers_running) > 0) {
+        node_state_t state;
+        uint32_t version = state_store_read(&state);
+        CHECK(state.humidity == -state.temperature);
+        CHECK(version >= last); // wersja nie cofa się
+        last = version;
+        count++;
+    }
+    atomic_fetch_add(&reads, count);
+    return NULL;
+}
+
+int main(void)
+{
+    pthread_t threads[4];
+    atomic_store(&writers_running, 2);
+    pthread_create(&threads[0], NULL, reader, NULL);
+    pthread_create(&threads[1], NULL, reader, NULL);
+    pthread_create(&threads[2], NULL, writer, (void *)(intptr_t)0);
+    pthread_create(&threads[3], NULL, writer, (void *)(intptr_t)1);
+    for (int i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    // Każdy zapis zwiększa wersję dokładnie o jeden
+    uint32_t expected = 2 * (WRITES + (WRITES + 15) / 16);
+    CHECK(state_store_version() == expected);
+
+    printf("state_store: %u writes, %lu lock-free reads\n", expected, atomic_load(&reads));
+
+    if (failures > 0) {
+        printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("state_store: all checks passed\n");
+    return 0;
+}